@@ -0,0 +1,169 @@
+/**
+ * Capacity Probe — engine
+ * Order matters: every original is read before anything is
+ * written, so on a wrapping card two aliased probes save the
+ * same physical data and the restore is correct either way.
+ */
+
+#include <string.h>
+
+#include "capacity_probe.h"
+#include "io_arena.h"
+
+// Ladder base: 1MB in on real cards, proportionally less on tiny
+// (simulated) ones. The ladder starts one base-length above it.
+static const uint32_t PROBE_BASE_MAX = 2048;
+
+static const uint32_t PROBE_MAGIC = 0x42525043UL;   // "CPRB"
+
+enum ProbeState : uint8_t { PS_OK = 0, PS_NO_ORIGINAL, PS_IO_ERROR };
+
+static void buildTag(uint8_t *buf, uint32_t sector, uint32_t index, uint32_t seed) {
+    uint32_t *w = (uint32_t *)buf;
+    w[0] = PROBE_MAGIC;
+    w[1] = sector;
+    w[2] = index;
+    w[3] = seed;
+    uint32_t x = (sector * 0x9E3779B9UL) ^ seed ^ 0x5BD1E995UL;
+    for (int i = 4; i < 128; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        w[i] = x;
+    }
+}
+
+static bool contains(const uint32_t *list, int n, uint32_t v) {
+    for (int i = 0; i < n; i++) {
+        if (list[i] == v) return true;
+    }
+    return false;
+}
+
+// Ladder first, then one random pick per stratum; sorted ascending
+static int placeProbes(uint32_t sectors, int want, uint32_t seed, uint32_t *out) {
+    uint32_t base = sectors / 64;
+    if (base > PROBE_BASE_MAX) base = PROBE_BASE_MAX;
+    if (base == 0) base = 1;
+
+    int shift = 0;
+    while ((1UL << shift) < base) shift++;
+
+    // Leave at least half the probes for the strata
+    int n = 0;
+    for (int k = shift; k < 32 && n < want / 2; k++) {
+        uint64_t s = (uint64_t)base + (1ULL << k);
+        if (s >= sectors) break;
+        if (n == 0) out[n++] = base;
+        out[n++] = (uint32_t)s;
+    }
+
+    int strata = want - n;
+    uint32_t x = seed ? seed : 1;
+    for (int i = 0; i < strata; i++) {
+        uint64_t lo = base + (uint64_t)(sectors - base) * i / strata;
+        uint64_t hi = base + (uint64_t)(sectors - base) * (i + 1) / strata;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        // Always include the very last sector
+        uint32_t s = (i == strata - 1) ? sectors - 1
+                                       : (uint32_t)(lo + x % (hi - lo));
+        while (contains(out, n, s) && s + 1 < hi) s++;
+        if (!contains(out, n, s)) out[n++] = s;
+    }
+
+    for (int i = 1; i < n; i++) {
+        uint32_t v = out[i];
+        int j = i - 1;
+        while (j >= 0 && out[j] > v) {
+            out[j + 1] = out[j];
+            j--;
+        }
+        out[j + 1] = v;
+    }
+    return n;
+}
+
+ProbeResult probeCapacity(SectorDevice *dev, int probes, uint32_t seed,
+                          ProbeReport &rep, ProbeProgressFn progress) {
+    memset(&rep, 0, sizeof(rep));
+    rep.firstBad = 0xFFFFFFFFUL;
+    rep.sectors = dev->sectorCount();
+
+    if (probes > PROBE_MAX) probes = PROBE_MAX;
+    if (probes < 2 || rep.sectors < (uint32_t)probes * 4) return PROBE_TOO_SMALL;
+
+    uint32_t where[PROBE_MAX];
+    uint8_t state[PROBE_MAX];
+    int n = placeProbes(rep.sectors, probes, seed, where);
+    rep.probes = n;
+
+    // Nothing is restored over a sector that was never saved
+    memset(state, PS_NO_ORIGINAL, sizeof(state));
+
+    ArenaScope scope("probe");
+    uint8_t *saved = arenaAlloc((size_t)n * 512);
+    uint8_t *tag = arenaAlloc(512);
+    uint8_t *buf = arenaAlloc(512);
+    if (!saved || !tag || !buf) return PROBE_NO_MEMORY;
+
+    bool aborted = false;
+    int step = 0;
+    const int steps = n * 3;
+    auto tick = [&]() {
+        step++;
+        if (progress && !progress((uint8_t)(step * 100 / steps))) aborted = true;
+        return !aborted;
+    };
+
+    // --- SAVE ORIGINALS ---
+    for (int i = 0; i < n; i++) {
+        state[i] = dev->readSectors(where[i], saved + i * 512, 1) ? PS_OK : PS_NO_ORIGINAL;
+        if (state[i] != PS_OK) rep.ioErrors++;
+        if (!tick()) break;
+    }
+
+    // --- WRITE TAGS (never over a sector we could not save) ---
+    for (int i = 0; i < n && !aborted; i++) {
+        if (state[i] == PS_OK) {
+            buildTag(tag, where[i], i, seed);
+            if (!dev->writeSectors(where[i], tag, 1)) {
+                state[i] = PS_IO_ERROR;
+                rep.ioErrors++;
+            }
+        }
+        tick();
+    }
+    dev->syncDevice();
+
+    // --- VERIFY ---
+    for (int i = 0; i < n && !aborted; i++) {
+        if (state[i] == PS_OK) {
+            buildTag(tag, where[i], i, seed);
+            if (!dev->readSectors(where[i], buf, 1)) {
+                rep.ioErrors++;
+            } else if (memcmp(buf, tag, 512) == 0) {
+                rep.good++;
+            } else {
+                rep.bad++;
+                if (where[i] < rep.firstBad) rep.firstBad = where[i];
+            }
+        }
+        tick();
+    }
+
+    // --- RESTORE (also after an abort) ---
+    rep.restored = true;
+    for (int i = 0; i < n; i++) {
+        if (state[i] == PS_NO_ORIGINAL) continue;
+        if (!dev->writeSectors(where[i], saved + i * 512, 1)) rep.restored = false;
+    }
+    dev->syncDevice();
+
+    if (aborted) return PROBE_ABORTED;
+    if (rep.bad) return PROBE_FAKE;
+    if (rep.ioErrors) return PROBE_IO_ERROR;
+    return PROBE_OK;
+}
@@ -0,0 +1,45 @@
+/**
+ * Capacity Probe
+ * Fast check for fake-capacity cards: tagged sectors are written
+ * across the advertised size, then read back. A card that wraps
+ * (or drops) writes past its real size returns the wrong tag
+ * somewhere. Original sector contents are saved and restored.
+ *
+ * Probe placement:
+ *  - a power-of-two ladder base + 2^k, which collides with the
+ *    base on cards that wrap at a power-of-two size
+ *  - one random sector per equal stratum for the rest
+ */
+
+#pragma once
+
+#include "sector_device.h"
+
+// The menu runs PROBE_DEFAULT; serial "probe n=" goes up to PROBE_MAX
+constexpr int PROBE_DEFAULT = 64;
+constexpr int PROBE_MAX = 256;
+
+struct ProbeReport {
+    uint32_t sectors;            // Advertised size
+    uint32_t probes;
+    uint32_t good;
+    uint32_t bad;                // Read back someone else's tag (or junk)
+    uint32_t ioErrors;           // Read/write call failed
+    uint32_t firstBad;           // Lowest bad sector, 0xFFFFFFFF if none
+    bool     restored;           // Every original sector written back
+};
+
+enum ProbeResult : uint8_t {
+    PROBE_OK = 0,                // All probes read back
+    PROBE_FAKE,                  // Bad probes — capacity is not real
+    PROBE_IO_ERROR,              // No mismatches but calls failed
+    PROBE_NO_MEMORY,
+    PROBE_TOO_SMALL,             // Fewer than 4 sectors per probe
+    PROBE_ABORTED
+};
+
+// Called once per probe with 0-100. Return false to abort.
+typedef bool (*ProbeProgressFn)(uint8_t percent);
+
+ProbeResult probeCapacity(SectorDevice *dev, int probes, uint32_t seed,
+                          ProbeReport &rep, ProbeProgressFn progress);
@@ -0,0 +1,175 @@
+/**
+ * Card Identity — register decoding and maker table
+ * Register bit n lives in byte (size*8 - 1 - n) / 8, MSB first,
+ * exactly as the card sends it.
+ */
+
+#include <string.h>
+
+#include "card_id.h"
+
+// ===============================
+// CID
+// ===============================
+
+static uint8_t crc7(const uint8_t *data, int len) {
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++) {
+        uint8_t d = data[i];
+        for (int b = 0; b < 8; b++) {
+            crc <<= 1;
+            if ((d ^ crc) & 0x80) crc ^= 0x09;
+            d <<= 1;
+        }
+    }
+    return crc & 0x7F;
+}
+
+static void copyAscii(char *dst, const uint8_t *src, int len) {
+    for (int i = 0; i < len; i++) {
+        dst[i] = (src[i] >= 0x20 && src[i] < 0x7F) ? (char)src[i] : '?';
+    }
+    dst[len] = '\0';
+}
+
+void decodeCid(const uint8_t raw[16], CidInfo &cid) {
+    cid.mid = raw[0];
+    copyAscii(cid.oid, raw + 1, 2);
+    copyAscii(cid.pnm, raw + 3, 5);
+    cid.prvMajor = raw[8] >> 4;
+    cid.prvMinor = raw[8] & 0x0F;
+    cid.psn = ((uint32_t)raw[9] << 24) | ((uint32_t)raw[10] << 16) |
+              ((uint32_t)raw[11] << 8) | raw[12];
+
+    // MDT [19:8]: year offset from 2000 in [19:12], month in [11:8]
+    cid.year  = 2000 + (((raw[13] & 0x0F) << 4) | (raw[14] >> 4));
+    cid.month = raw[14] & 0x0F;
+    if (cid.month > 12) cid.month = 0;
+
+    cid.crcOk = crc7(raw, 15) == (raw[15] >> 1);
+}
+
+// ===============================
+// CSD
+// ===============================
+
+// TRAN_SPEED: time value (x10) and rate unit (kbit/s)
+static const uint8_t TRAN_MULT[16] = { 0, 10, 12, 13, 15, 20, 25, 30,
+                                       35, 40, 45, 50, 55, 60, 70, 80 };
+static const uint32_t TRAN_UNIT_KBIT[4] = { 100, 1000, 10000, 100000 };
+
+void decodeCsd(const uint8_t raw[16], CsdInfo &csd) {
+    memset(&csd, 0, sizeof(csd));
+    csd.structure = raw[0] >> 6;
+
+    csd.tranSpeed = raw[3];
+    uint8_t unit = raw[3] & 0x07;
+    csd.maxKHz = unit < 4 ? TRAN_MULT[(raw[3] >> 3) & 0x0F] * TRAN_UNIT_KBIT[unit] / 10 : 0;
+
+    csd.ccc = ((uint16_t)raw[4] << 4) | (raw[5] >> 4);
+
+    switch (csd.structure) {
+        case 0: {
+            // SDSC: (C_SIZE+1) * 2^(C_SIZE_MULT+2) blocks of 2^READ_BL_LEN bytes
+            uint32_t readBlLen = raw[5] & 0x0F;
+            uint32_t cSize = ((uint32_t)(raw[6] & 0x03) << 10) | ((uint32_t)raw[7] << 2) | (raw[8] >> 6);
+            uint32_t mult = ((raw[9] & 0x03) << 1) | (raw[10] >> 7);
+            uint64_t bytes = (uint64_t)(cSize + 1) << (mult + 2 + readBlLen);
+            csd.sectors = bytes / 512;
+            break;
+        }
+        case 1: {
+            // SDHC/SDXC: 22-bit C_SIZE in 512KB units
+            uint32_t cSize = ((uint32_t)(raw[7] & 0x3F) << 16) | ((uint32_t)raw[8] << 8) | raw[9];
+            csd.sectors = (uint64_t)(cSize + 1) * 1024;
+            break;
+        }
+        case 2: {
+            // SDUC: 28-bit C_SIZE
+            uint32_t cSize = ((uint32_t)(raw[6] & 0x0F) << 24) | ((uint32_t)raw[7] << 16) |
+                             ((uint32_t)raw[8] << 8) | raw[9];
+            csd.sectors = (uint64_t)(cSize + 1) * 1024;
+            break;
+        }
+    }
+
+    csd.eraseBlkEn = (raw[10] >> 6) & 0x01;
+    csd.eraseSectorSize = (((raw[10] & 0x3F) << 1) | (raw[11] >> 7)) + 1;
+    csd.permWriteProtect = (raw[14] >> 5) & 0x01;
+    csd.tmpWriteProtect  = (raw[14] >> 4) & 0x01;
+}
+
+const char* cardCapacityClass(const CsdInfo &csd) {
+    switch (csd.structure) {
+        case 0:  return "SDSC";
+        case 1:  return csd.sectors > 67108864ULL ? "SDXC" : "SDHC";   // > 32GB
+        case 2:  return "SDUC";
+    }
+    return "?";
+}
+
+// ===============================
+// SD Status
+// ===============================
+
+static const uint8_t SPEED_CLASS[5] = { 0, 2, 4, 6, 10 };
+
+// AU_SIZE code → sectors (1 = 16KB ... 0xF = 64MB)
+static const uint32_t AU_SECTORS[16] = {
+    0, 32, 64, 128, 256, 512, 1024, 2048,
+    4096, 8192, 16384, 24576, 32768, 49152, 65536, 131072
+};
+
+void decodeSdStatus(const uint8_t raw[64], SdStatusInfo &sds) {
+    memset(&sds, 0, sizeof(sds));
+
+    sds.speedClass    = raw[8] < 5 ? SPEED_CLASS[raw[8]] : 0;
+    sds.auSectors     = AU_SECTORS[raw[10] >> 4];
+    sds.eraseSize     = ((uint16_t)raw[11] << 8) | raw[12];
+    sds.eraseTimeoutS = raw[13] >> 2;
+    sds.eraseOffsetS  = raw[13] & 0x03;
+    sds.uhsGrade      = raw[14] >> 4;
+    sds.videoClass    = raw[15];
+    sds.appClass      = raw[21] & 0x0F;
+}
+
+// ===============================
+// Manufacturers
+// ===============================
+// From public card-reader dumps; OEM IDs are the common ones,
+// rebadged cards can legitimately differ.
+
+static const CardMaker MAKERS[] = {
+    { 0x01, "PA", "Panasonic" },
+    { 0x02, "TM", "Toshiba/Kioxia" },
+    { 0x03, "SD", "SanDisk" },
+    { 0x06, "RK", "Ritek" },
+    { 0x09, "AP", "ATP" },
+    { 0x13, "KG", "Kingmax" },
+    { 0x19, "DY", "Dynacard" },
+    { 0x1A, "PQ", "PQI" },
+    { 0x1B, "SM", "Samsung" },
+    { 0x1D, "AD", "ADATA" },
+    { 0x27, "PH", "Phison" },
+    { 0x28, "BE", "Lexar" },
+    { 0x31, "SP", "Silicon Power" },
+    { 0x41, "42", "Kingston" },
+    { 0x51, "QI", "Qimonda" },
+    { 0x5D, "SB", "Swissbit" },
+    { 0x61, "NL", "Netlist" },
+    { 0x63, "CT", "Cactus" },
+    { 0x73, "BG", "Bongiovi" },
+    { 0x74, nullptr, "Transcend" },
+    { 0x76, "PT", "Patriot" },
+    { 0x82, nullptr, "Sony" },
+    { 0x9C, nullptr, "Angelbird/Barun" },
+    { 0x9F, nullptr, "Kingston/Team" },
+    { 0xAD, "LS", "Longsys" },
+};
+
+const CardMaker* findMaker(uint8_t mid) {
+    for (const CardMaker &m : MAKERS) {
+        if (m.mid == mid) return &m;
+    }
+    return nullptr;
+}
@@ -0,0 +1,80 @@
+/**
+ * Card Identity
+ * Decoders for the raw CID, CSD and SD Status registers (bit
+ * positions from the SD Physical Layer spec), independent of
+ * SdFat's struct field names, plus a compiled-in manufacturer
+ * table keyed by MID with the OEM ID each maker normally uses.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// ===============================
+// CID
+// ===============================
+
+struct CidInfo {
+    uint8_t  mid;
+    char     oid[3];             // 2 ASCII + NUL
+    char     pnm[6];             // 5 ASCII + NUL
+    uint8_t  prvMajor;
+    uint8_t  prvMinor;
+    uint32_t psn;
+    uint16_t year;               // 2000..2255
+    uint8_t  month;              // 1..12 (0 = invalid)
+    bool     crcOk;
+};
+
+void decodeCid(const uint8_t raw[16], CidInfo &cid);
+
+// ===============================
+// CSD
+// ===============================
+
+struct CsdInfo {
+    uint8_t  structure;          // 0 = SDSC, 1 = SDHC/SDXC, 2 = SDUC
+    uint64_t sectors;            // Capacity from C_SIZE
+    uint16_t ccc;                // Card command classes (bit n = class n)
+    uint8_t  tranSpeed;          // Raw TRAN_SPEED byte
+    uint32_t maxKHz;             // Decoded TRAN_SPEED
+    bool     eraseBlkEn;         // Erase works on single sectors
+    uint8_t  eraseSectorSize;    // Erase unit in sectors when !eraseBlkEn
+    bool     permWriteProtect;
+    bool     tmpWriteProtect;
+};
+
+void decodeCsd(const uint8_t raw[16], CsdInfo &csd);
+
+// ===============================
+// SD Status (ACMD13)
+// ===============================
+
+struct SdStatusInfo {
+    uint8_t  speedClass;         // 0, 2, 4, 6, 10
+    uint8_t  uhsGrade;           // 0, 1, 3
+    uint8_t  videoClass;         // 0, 6, 10, 30, 60, 90
+    uint8_t  appClass;           // 0, 1, 2
+    uint32_t auSectors;          // Allocation unit, 0 = not defined
+    uint16_t eraseSize;          // AUs erased per ERASE_TIMEOUT, 0 = not supported
+    uint8_t  eraseTimeoutS;      // Seconds for eraseSize AUs
+    uint8_t  eraseOffsetS;       // Fixed extra seconds per erase
+};
+
+void decodeSdStatus(const uint8_t raw[64], SdStatusInfo &sds);
+
+// ===============================
+// Manufacturers
+// ===============================
+
+struct CardMaker {
+    uint8_t     mid;
+    const char* oid;             // Usual OEM ID, nullptr = varies
+    const char* name;
+};
+
+// nullptr if the MID is not in the table
+const CardMaker* findMaker(uint8_t mid);
+
+// "SDSC" / "SDHC" / "SDXC" / "SDUC" from the CSD
+const char* cardCapacityClass(const CsdInfo &csd);
@@ -0,0 +1,259 @@
+/**
+ * Card Image — backup and restore engines
+ * Both directions move IMAGE_RECORD_SECTORS at a time so the card
+ * sees large multi-block reads and writes. Zero runs carry over
+ * from one read to the next, so an empty card is a single record.
+ */
+
+#include "card_image.h"
+#include "io_arena.h"
+
+static const uint32_t IMAGE_LINK_TIMEOUT_MS = 5000;
+
+// ===============================
+// CRC-32
+// ===============================
+
+uint32_t imageCrc32(uint32_t crc, const uint8_t *data, size_t len) {
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int b = 0; b < 8; b++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        ready = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// ===============================
+// Link helpers
+// ===============================
+
+static bool sendAll(Stream &io, const void *src, size_t len, ImageStats &st) {
+    if (io.write((const uint8_t *)src, len) != len) return false;
+    st.wireBytes += len;
+    return true;
+}
+
+static bool sendRecord(Stream &io, uint8_t type, uint32_t first, uint32_t count,
+                       ImageStats &st) {
+    ImageRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type  = type;
+    rec.first = first;
+    rec.count = count;
+    st.records++;
+    return sendAll(io, &rec, sizeof(rec), st);
+}
+
+// Block until `len` bytes arrive; false if the host goes quiet
+static bool receiveAll(Stream &io, void *dst, size_t len, ImageStats &st) {
+    uint8_t *p = (uint8_t *)dst;
+    size_t got = 0;
+    uint32_t last = millis();
+
+    while (got < len) {
+        int avail = io.available();
+        if (avail > 0) {
+            size_t n = len - got < (size_t)avail ? len - got : (size_t)avail;
+            got += io.readBytes(p + got, n);
+            last = millis();
+        } else if (millis() - last > IMAGE_LINK_TIMEOUT_MS) {
+            return false;
+        } else {
+            delay(1);
+        }
+    }
+    st.wireBytes += len;
+    return true;
+}
+
+static bool isZeroSector(const uint8_t *sector) {
+    const uint32_t *w = (const uint32_t *)sector;
+    for (int i = 0; i < 128; i++) {
+        if (w[i]) return false;
+    }
+    return true;
+}
+
+// ===============================
+// Backup
+// ===============================
+
+ImageResult imageBackup(SectorDevice *dev, Stream &io, ImageStats &st,
+                        ImageProgressFn progress) {
+    memset(&st, 0, sizeof(st));
+    uint32_t start = millis();
+
+    const uint32_t sectors = dev->sectorCount();
+
+    ImageHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.sectors = sectors;
+    dev->readCID(hdr.cid);
+
+    ArenaScope scope("image");
+    uint8_t *buf = arenaAlloc(IMAGE_RECORD_SECTORS * 512);
+    if (!buf) return IMAGE_NO_MEMORY;
+
+    ImageResult res = IMAGE_OK;
+    uint32_t zeroFirst = 0, zeroCount = 0;
+
+    if (!sendAll(io, &hdr, sizeof(hdr), st)) res = IMAGE_LINK_ERROR;
+
+    for (uint32_t pos = 0; pos < sectors && res == IMAGE_OK; pos += IMAGE_RECORD_SECTORS) {
+        const uint32_t n = sectors - pos < IMAGE_RECORD_SECTORS ? sectors - pos : IMAGE_RECORD_SECTORS;
+        if (!dev->readSectors(pos, buf, n)) {
+            res = IMAGE_IO_ERROR;
+            break;
+        }
+
+        uint32_t i = 0;
+        while (i < n) {
+            if (isZeroSector(buf + i * 512)) {
+                if (zeroCount == 0) zeroFirst = pos + i;
+                zeroCount++;
+                i++;
+                continue;
+            }
+
+            // Data: close the zero run, then send every data sector up to the next zero
+            if (zeroCount) {
+                if (!sendRecord(io, IMAGE_ZERO, zeroFirst, zeroCount, st)) break;
+                st.zeroSectors += zeroCount;
+                zeroCount = 0;
+            }
+            uint32_t j = i + 1;
+            while (j < n && !isZeroSector(buf + j * 512)) j++;
+
+            const uint8_t *data = buf + i * 512;
+            const size_t len = (j - i) * 512;
+            uint32_t crc = imageCrc32(0, data, len);
+            if (!sendRecord(io, IMAGE_DATA, pos + i, j - i, st) ||
+                !sendAll(io, data, len, st) ||
+                !sendAll(io, &crc, sizeof(crc), st)) {
+                break;
+            }
+            st.dataSectors += j - i;
+            i = j;
+        }
+        if (i < n) {
+            res = IMAGE_LINK_ERROR;
+            break;
+        }
+
+        st.sectors = pos + n;
+        if (progress && !progress((uint64_t)st.sectors * 100 / sectors)) res = IMAGE_ABORTED;
+    }
+
+    if (res == IMAGE_OK && zeroCount) {
+        if (sendRecord(io, IMAGE_ZERO, zeroFirst, zeroCount, st)) st.zeroSectors += zeroCount;
+        else res = IMAGE_LINK_ERROR;
+    }
+    if (res == IMAGE_OK && !sendRecord(io, IMAGE_END, 0, st.sectors, st)) res = IMAGE_LINK_ERROR;
+    io.flush();
+
+    st.elapsedMs = millis() - start;
+    return res;
+}
+
+// ===============================
+// Restore
+// ===============================
+
+static ImageResult restoreRecords(SectorDevice *dev, Stream &io, const ImageHeader &hdr,
+                                  uint8_t *buf, ImageStats &st, ImageProgressFn progress) {
+    while (true) {
+        ImageRecord rec;
+        if (!receiveAll(io, &rec, sizeof(rec), st)) return IMAGE_LINK_ERROR;
+        st.records++;
+
+        if (rec.type == IMAGE_END) {
+            return rec.count == st.sectors ? IMAGE_OK : IMAGE_BAD_STREAM;
+        }
+        if (rec.first != st.sectors || rec.count == 0 || rec.count > hdr.sectors - rec.first) {
+            return IMAGE_BAD_STREAM;
+        }
+
+        if (rec.type == IMAGE_DATA) {
+            const size_t len = rec.count * 512;
+            uint32_t crc;
+            if (rec.count > IMAGE_RECORD_SECTORS) return IMAGE_BAD_STREAM;
+            if (!receiveAll(io, buf, len, st) || !receiveAll(io, &crc, sizeof(crc), st)) {
+                return IMAGE_LINK_ERROR;
+            }
+            if (crc != imageCrc32(0, buf, len)) return IMAGE_BAD_STREAM;
+            if (!dev->writeSectors(rec.first, buf, rec.count)) return IMAGE_IO_ERROR;
+            st.dataSectors += rec.count;
+
+        } else if (rec.type == IMAGE_ZERO) {
+            // Written here from RAM, so it still costs no link time
+            if (!(hdr.flags & IMAGE_FLAG_SKIP_ZERO)) {
+                memset(buf, 0, IMAGE_RECORD_SECTORS * 512);
+                for (uint32_t done = 0; done < rec.count; done += IMAGE_RECORD_SECTORS) {
+                    uint32_t n = rec.count - done < IMAGE_RECORD_SECTORS ? rec.count - done
+                                                                         : IMAGE_RECORD_SECTORS;
+                    if (!dev->writeSectors(rec.first + done, buf, n)) return IMAGE_IO_ERROR;
+
+                    // A long run takes a while; keep the screen moving
+                    if (progress && !progress((uint64_t)(st.sectors + done + n) * 100 / hdr.sectors)) {
+                        return IMAGE_ABORTED;
+                    }
+                }
+            }
+            st.zeroSectors += rec.count;
+
+        } else {
+            return IMAGE_BAD_STREAM;
+        }
+
+        st.sectors += rec.count;
+        const uint8_t ack = IMAGE_ACK;
+        if (!sendAll(io, &ack, 1, st)) return IMAGE_LINK_ERROR;
+
+        if (progress && !progress((uint64_t)st.sectors * 100 / hdr.sectors)) return IMAGE_ABORTED;
+    }
+}
+
+ImageResult imageRestore(SectorDevice *dev, Stream &io, ImageStats &st,
+                         ImageProgressFn progress) {
+    memset(&st, 0, sizeof(st));
+    uint32_t start = millis();
+    const uint8_t nak = IMAGE_NAK;
+
+    ImageHeader hdr;
+    if (!receiveAll(io, &hdr, sizeof(hdr), st)) return IMAGE_LINK_ERROR;
+    if (memcmp(hdr.magic, IMAGE_MAGIC, sizeof(hdr.magic)) != 0) {
+        sendAll(io, &nak, 1, st);
+        return IMAGE_BAD_STREAM;
+    }
+    if (hdr.sectors > dev->sectorCount()) {
+        sendAll(io, &nak, 1, st);
+        return IMAGE_TOO_BIG;
+    }
+
+    ArenaScope scope("image");
+    uint8_t *buf = arenaAlloc(IMAGE_RECORD_SECTORS * 512);
+    if (!buf) {
+        sendAll(io, &nak, 1, st);
+        return IMAGE_NO_MEMORY;
+    }
+
+    const uint8_t ack = IMAGE_ACK;
+    ImageResult res = sendAll(io, &ack, 1, st) ? IMAGE_OK : IMAGE_LINK_ERROR;
+    if (res == IMAGE_OK) res = restoreRecords(dev, io, hdr, buf, st, progress);
+    if (!dev->syncDevice() && res == IMAGE_OK) res = IMAGE_IO_ERROR;
+
+    // Last answer: ACK once everything is on the card, NAK on a failure
+    if (res != IMAGE_LINK_ERROR) sendAll(io, res == IMAGE_OK ? &ack : &nak, 1, st);
+
+    st.elapsedMs = millis() - start;
+    return res;
+}
@@ -0,0 +1,93 @@
+/**
+ * Card Image
+ * Whole-card backup and restore over a byte stream (USB CDC),
+ * so a card can be saved before a reformat without a PC card
+ * reader. Runs of all-zero sectors travel as 12-byte skip records,
+ * so a mostly empty card streams in a fraction of its size.
+ * tools/sdimage.py is the host side and uses the same format;
+ * its .sdimg files are the stream, byte for byte.
+ *
+ * Stream (little-endian):
+ *   ImageHeader
+ *   ImageRecord 'D' + count * 512 data bytes + CRC-32 of the data
+ *   ImageRecord 'Z'                     (count zero sectors)
+ *   ...
+ *   ImageRecord 'E' with first = 0, count = sectors covered
+ * Records are contiguous from sector 0 and hold at most
+ * IMAGE_RECORD_SECTORS sectors of data.
+ *
+ * Restore is acknowledged: the device answers the header, each
+ * record and finally 'E' (once the data is on the card) with one
+ * byte, IMAGE_ACK or IMAGE_NAK, and the host waits for it before
+ * sending more. The host may set IMAGE_FLAG_SKIP_ZERO in the
+ * header it sends; otherwise zero runs are written out as zeros.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "sector_device.h"
+
+// Largest 'D' record, and the size of every card read / write
+constexpr uint32_t IMAGE_RECORD_SECTORS = 128;     // 64KB
+
+constexpr char IMAGE_MAGIC[8] = { 'S', 'D', 'I', 'M', 'G', '0', '0', '1' };
+
+constexpr uint8_t IMAGE_DATA = 'D';
+constexpr uint8_t IMAGE_ZERO = 'Z';
+constexpr uint8_t IMAGE_END  = 'E';
+
+constexpr uint8_t IMAGE_ACK = 'K';
+constexpr uint8_t IMAGE_NAK = 'N';
+
+// Restore: target is known to read as zeros, skip 'Z' records
+constexpr uint32_t IMAGE_FLAG_SKIP_ZERO = 1;
+
+struct ImageHeader {
+    char     magic[8];
+    uint32_t sectors;            // Card size at backup
+    uint32_t flags;
+    uint8_t  cid[16];            // Raw CID of the source card
+};
+
+struct ImageRecord {
+    uint8_t  type;
+    uint8_t  reserved[3];
+    uint32_t first;
+    uint32_t count;
+};
+
+static_assert(sizeof(ImageHeader) == 32, "ImageHeader is a wire format");
+static_assert(sizeof(ImageRecord) == 12, "ImageRecord is a wire format");
+
+struct ImageStats {
+    uint32_t sectors;            // Covered by the stream
+    uint32_t dataSectors;
+    uint32_t zeroSectors;
+    uint32_t records;
+    uint64_t wireBytes;          // Sent or received
+    uint32_t elapsedMs;
+};
+
+enum ImageResult : uint8_t {
+    IMAGE_OK = 0,
+    IMAGE_IO_ERROR,              // Card read / write failed
+    IMAGE_LINK_ERROR,            // Host stopped reading / sending
+    IMAGE_BAD_STREAM,            // Bad magic, CRC or record order
+    IMAGE_TOO_BIG,               // Image larger than this card
+    IMAGE_NO_MEMORY,
+    IMAGE_ABORTED
+};
+
+// Called after each record with 0-100. Return false to abort.
+typedef bool (*ImageProgressFn)(uint8_t percent);
+
+// Standard CRC-32 (zlib / IEEE 802.3)
+uint32_t imageCrc32(uint32_t crc, const uint8_t *data, size_t len);
+
+ImageResult imageBackup(SectorDevice *dev, Stream &io, ImageStats &st,
+                        ImageProgressFn progress);
+
+ImageResult imageRestore(SectorDevice *dev, Stream &io, ImageStats &st,
+                         ImageProgressFn progress);
@@ -0,0 +1,39 @@
+/**
+ * Test Checkpoints — NVS storage
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "checkpoint.h"
+
+static const char* CKPT_NAMESPACE = "sdtool";
+static const char* CKPT_KEY = "ckpt";
+
+bool checkpointSave(Checkpoint &ck) {
+    Preferences prefs;
+    if (!prefs.begin(CKPT_NAMESPACE, false)) return false;
+
+    ck.version = CHECKPOINT_VERSION;
+    bool ok = prefs.putBytes(CKPT_KEY, &ck, sizeof(ck)) == sizeof(ck);
+    prefs.end();
+    return ok;
+}
+
+bool checkpointLoad(Checkpoint &ck) {
+    Preferences prefs;
+    if (!prefs.begin(CKPT_NAMESPACE, true)) return false;
+
+    bool ok = prefs.getBytesLength(CKPT_KEY) == sizeof(ck) &&
+              prefs.getBytes(CKPT_KEY, &ck, sizeof(ck)) == sizeof(ck);
+    prefs.end();
+
+    return ok && ck.version == CHECKPOINT_VERSION && ck.test != CKPT_NONE;
+}
+
+void checkpointClear() {
+    Preferences prefs;
+    if (!prefs.begin(CKPT_NAMESPACE, false)) return;
+    prefs.remove(CKPT_KEY);
+    prefs.end();
+}
@@ -0,0 +1,36 @@
+/**
+ * Test Checkpoints
+ * Progress of a long-running test saved to NVS, so a reset or
+ * power loss costs minutes instead of hours. One slot: only one
+ * test runs at a time.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+enum CheckpointTest : uint8_t {
+    CKPT_NONE      = 0,
+    CKPT_INTEGRITY = 1
+};
+
+struct Checkpoint {
+    uint8_t  version;            // CHECKPOINT_VERSION
+    uint8_t  test;               // CheckpointTest
+    uint8_t  phase;              // Test-defined
+    uint8_t  mid;                // Card the test was started on
+    uint32_t psn;
+    uint32_t seed;               // Pattern seed
+    uint32_t errors;
+    uint64_t limit;              // Bytes the test covers
+    uint64_t position;           // Bytes written/verified and synced
+    uint32_t cycle;              // For repeating tests
+    uint32_t writeMs;            // Time spent so far, per phase
+    uint32_t readMs;
+};
+
+constexpr uint8_t CHECKPOINT_VERSION = 1;
+
+bool checkpointSave(Checkpoint &ck);
+bool checkpointLoad(Checkpoint &ck);   // False if none / stale format
+void checkpointClear();
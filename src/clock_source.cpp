@@ -0,0 +1,30 @@
+/**
+ * Clock Source — device and host implementations
+ */
+
+#include "clock_source.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+uint32_t clockMillis() { return millis(); }
+uint32_t clockMicros() { return micros(); }
+void clockDelayUs(uint32_t us) { delayMicroseconds(us); }
+
+#else
+
+#include <chrono>
+#include <thread>
+
+static uint64_t sinceStart() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+uint32_t clockMillis() { return (uint32_t)(sinceStart() / 1000); }
+uint32_t clockMicros() { return (uint32_t)sinceStart(); }
+void clockDelayUs(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+#endif
@@ -0,0 +1,14 @@
+/**
+ * Clock Source
+ * The time base for the engines that must also build on a host
+ * (soak, sim card): Arduino's timers on the device, std::chrono
+ * in the native test build. Same wrap-around as millis()/micros().
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+uint32_t clockMillis();
+uint32_t clockMicros();
+void clockDelayUs(uint32_t us);
@@ -0,0 +1,428 @@
+/**
+ * FAT Analyzer
+ * Two passes over the card, both read-only:
+ *  1. Stream the FAT with multi-sector reads, one bit per
+ *     allocated cluster (popcount gives used/free).
+ *  2. Walk every directory and follow each chain, clearing bits
+ *     as clusters are claimed. A clear bit on the way means a
+ *     cross-link; bits left at the end are lost clusters.
+ * RAM, all from the arena: one bit per cluster (128KB for a 64GB
+ * card at 64KB clusters), then a FAT window of up to 16KB in what
+ * is left, down to a single sector.
+ */
+
+#include <Arduino.h>
+
+#include "fat_analyzer.h"
+#include "io_arena.h"
+
+// ===============================
+// Buffers
+// ===============================
+
+// FAT is streamed through a window of up to 32 sectors (16KB),
+// smaller when the bitmap leaves less of the arena than that
+static const uint32_t FAT_WINDOW_SECTORS = 32;
+
+// FAT16 values are widened to these FAT32 equivalents
+static const uint32_t FAT_ENTRY_BAD = 0x0FFFFFF7;
+static const uint32_t FAT_ENTRY_EOC = 0x0FFFFFF8;   // ≥ this ends a chain
+
+// Directories are at most 65536 entries (2MB)
+static const uint32_t MAX_DIR_SECTORS = 65536 * 32 / 512;
+static const int MAX_DIR_DEPTH = 16;
+
+// ===============================
+// Cluster bitmap
+// ===============================
+// One bit per cluster in a single arena block, valid while the
+// analyzer's ArenaScope is open.
+
+struct ClusterBitmap {
+    uint32_t *words;
+    uint32_t wordCount;
+
+    bool begin(uint32_t bits) {
+        wordCount = (bits + 31) / 32;
+        words = (uint32_t *)arenaAlloc((size_t)wordCount * 4);
+        if (!words) return false;
+        memset(words, 0, (size_t)wordCount * 4);
+        return true;
+    }
+
+    inline void set(uint32_t bit)   { words[bit / 32] |=  (1UL << (bit & 31)); }
+    inline void clear(uint32_t bit) { words[bit / 32] &= ~(1UL << (bit & 31)); }
+    inline bool test(uint32_t bit)  { return words[bit / 32] & (1UL << (bit & 31)); }
+
+    uint32_t count() {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < wordCount; i++) n += __builtin_popcount(words[i]);
+        return n;
+    }
+};
+
+// ===============================
+// Analyzer state
+// ===============================
+
+struct Analyzer {
+    SdCard *card;
+    FatReport *rep;
+    FatProgressFn progress;
+    const FatVolumeInfo *vol;
+    ClusterBitmap map;
+
+    uint8_t *fatWindow;          // winSectors, from the arena
+    uint8_t *dirSector;
+    uint32_t winSectors;         // Window size, FAT_WINDOW_SECTORS or less
+
+    uint32_t entryBytes;         // 2 (FAT16) or 4 (FAT32)
+    uint32_t winFirst;           // FAT-relative first sector in window
+    uint32_t winCount;
+    bool ioError;
+    bool aborted;
+
+    uint32_t claimed;            // For pass 2 progress
+    uint8_t lastPercent;
+};
+
+static inline uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline bool isDataCluster(const Analyzer &a, uint32_t c) {
+    return c >= 2 && c < a.vol->clusterCount + 2;
+}
+
+static inline uint32_t clusterSector(const Analyzer &a, uint32_t c) {
+    return a.vol->dataStart + (c - 2) * a.vol->sectorsPerCluster;
+}
+
+static bool report(Analyzer &a, uint8_t percent) {
+    if (percent == a.lastPercent || !a.progress) return true;
+    a.lastPercent = percent;
+    if (!a.progress(percent)) a.aborted = true;
+    return !a.aborted;
+}
+
+// -------------------------------
+// FAT window
+// -------------------------------
+
+static bool loadWindow(Analyzer &a, uint32_t fatSector) {
+    uint32_t n = a.vol->fatSize - fatSector;
+    if (n > a.winSectors) n = a.winSectors;
+
+    if (!a.card->readSectors(a.vol->fatStart + fatSector, a.fatWindow, n)) {
+        a.ioError = true;
+        a.winCount = 0;
+        return false;
+    }
+    a.winFirst = fatSector;
+    a.winCount = n;
+    return true;
+}
+
+static inline uint32_t decodeEntry(const Analyzer &a, const uint8_t *p) {
+    if (a.entryBytes == 4) return rd32(p) & 0x0FFFFFFF;
+
+    uint32_t v = rd16(p);
+    if (v >= 0xFFF8) return FAT_ENTRY_EOC;
+    if (v == 0xFFF7) return FAT_ENTRY_BAD;
+    return v;
+}
+
+// Random access for chain walking — files are mostly contiguous,
+// so the window rarely moves
+static uint32_t fatEntry(Analyzer &a, uint32_t cluster) {
+    uint32_t offset = cluster * a.entryBytes;
+    uint32_t sector = offset / 512;
+
+    if (sector < a.winFirst || sector >= a.winFirst + a.winCount) {
+        if (!loadWindow(a, sector)) return FAT_ENTRY_EOC;
+    }
+    return decodeEntry(a, &a.fatWindow[(sector - a.winFirst) * 512 + offset % 512]);
+}
+
+// ===============================
+// Pass 1 — stream the FAT
+// ===============================
+
+static bool streamFat(Analyzer &a) {
+    const uint32_t last = a.vol->clusterCount + 2;   // One past the last cluster
+
+    for (uint32_t sec = 0; sec < a.vol->fatSize; sec += a.winSectors) {
+        if (!loadWindow(a, sec)) return false;
+
+        uint32_t first = sec * 512 / a.entryBytes;
+        uint32_t count = a.winCount * 512 / a.entryBytes;
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t c = first + i;
+            if (c < 2) continue;
+            if (c >= last) break;
+
+            uint32_t v = decodeEntry(a, &a.fatWindow[i * a.entryBytes]);
+            if (v == 0) continue;
+            if (v == FAT_ENTRY_BAD) {
+                a.rep->badClusters++;
+                continue;
+            }
+            a.map.set(c - 2);
+        }
+
+        if (first + count >= last) break;
+        if (!report(a, (uint8_t)((uint64_t)sec * 70 / a.vol->fatSize))) return false;
+    }
+    return true;
+}
+
+// ===============================
+// Pass 2 — claim chains
+// ===============================
+
+static void formatShortName(const uint8_t *e, char *out) {
+    int n = 0;
+    for (int i = 0; i < 8 && e[i] != ' '; i++) out[n++] = (char)e[i];
+    if (e[8] != ' ') {
+        out[n++] = '.';
+        for (int i = 8; i < 11 && e[i] != ' '; i++) out[n++] = (char)e[i];
+    }
+    out[n] = 0;
+}
+
+static void rankFragmented(FatReport &r, const uint8_t *entry,
+                           uint32_t fragments, uint32_t clusters) {
+    int slot = FAT_WORST_FILES;
+    while (slot > 0 && r.worst[slot - 1].fragments < fragments) slot--;
+    if (slot == FAT_WORST_FILES) return;
+
+    for (int i = FAT_WORST_FILES - 1; i > slot; i--) r.worst[i] = r.worst[i - 1];
+    formatShortName(entry, r.worst[slot].name);
+    r.worst[slot].fragments = fragments;
+    r.worst[slot].clusters = clusters;
+}
+
+// Follow a chain from `start`, clearing each cluster's bit.
+// Returns false if the head was already claimed (don't descend).
+static bool claimChain(Analyzer &a, uint32_t start,
+                       uint32_t &clusters, uint32_t &fragments) {
+    FatReport &r = *a.rep;
+    clusters = 0;
+    fragments = 0;
+
+    if (!isDataCluster(a, start)) {
+        r.brokenChains++;
+        return false;
+    }
+
+    uint32_t c = start;
+    uint32_t prev = 0;
+
+    while (true) {
+        if (!a.map.test(c - 2)) {
+            uint32_t v = fatEntry(a, c);
+            if (v == 0 || v == FAT_ENTRY_BAD) {
+                r.brokenChains++;
+            } else {
+                r.crossLinks++;
+            }
+            return clusters != 0;
+        }
+
+        a.map.clear(c - 2);
+        if (c != prev + 1) fragments++;
+        clusters++;
+        prev = c;
+
+        if ((++a.claimed & 0x0FFF) == 0 && r.usedClusters) {
+            report(a, (uint8_t)(70 + (uint64_t)a.claimed * 29 / r.usedClusters));
+        }
+
+        uint32_t next = fatEntry(a, c);
+        if (a.ioError) return false;
+        if (next >= FAT_ENTRY_EOC) return true;
+        if (!isDataCluster(a, next)) {
+            r.brokenChains++;
+            return true;
+        }
+        c = next;
+    }
+}
+
+struct DirCursor {
+    uint32_t cluster;            // 0 = FAT16 fixed root directory
+    uint32_t sector;             // Within cluster / fixed root
+    uint32_t sectorsRead;
+    uint8_t  entry;              // Next entry in the sector
+};
+
+static bool walkDirectories(Analyzer &a) {
+    FatReport &r = *a.rep;
+    const FatVolumeInfo &v = *a.vol;
+    const uint32_t clusterBytes = v.sectorsPerCluster * 512;
+
+    DirCursor stack[MAX_DIR_DEPTH];
+    int depth = 0;
+    stack[0] = { 0, 0, 0, 0 };
+
+    if (v.fatType == 32) {
+        uint32_t n, frags;
+        if (!claimChain(a, v.rootCluster, n, frags)) return !a.ioError;
+        stack[0].cluster = v.rootCluster;
+    }
+
+    while (depth >= 0) {
+        if (a.aborted || a.ioError) return false;
+
+        DirCursor &d = stack[depth];
+        uint32_t lba;
+
+        if (d.cluster == 0) {
+            if (d.sector >= v.rootDirSectors) { depth--; continue; }
+            lba = v.rootDirStart + d.sector;
+        } else {
+            if (d.sector >= v.sectorsPerCluster) {
+                uint32_t next = fatEntry(a, d.cluster);
+                if (!isDataCluster(a, next)) { depth--; continue; }
+                d.cluster = next;
+                d.sector = 0;
+            }
+            lba = clusterSector(a, d.cluster) + d.sector;
+        }
+
+        if (++d.sectorsRead > MAX_DIR_SECTORS) { depth--; continue; }
+
+        if (!a.card->readSector(lba, a.dirSector)) {
+            a.ioError = true;
+            return false;
+        }
+
+        bool endOfDir = false;
+        bool descended = false;
+
+        for (; d.entry < 16; d.entry++) {
+            const uint8_t *e = &a.dirSector[d.entry * 32];
+            const uint8_t attr = e[11];
+
+            if (e[0] == 0x00) { endOfDir = true; break; }
+            if (e[0] == 0xE5) continue;                 // Deleted
+            if ((attr & 0x0F) == 0x0F) continue;        // LFN
+            if (attr & 0x08) continue;                  // Volume label
+            if (e[0] == '.') continue;                  // . and ..
+
+            uint32_t start = rd16(&e[26]);
+            if (v.fatType == 32) start |= (uint32_t)rd16(&e[20]) << 16;
+
+            uint32_t n, frags;
+
+            if (attr & 0x10) {
+                r.dirs++;
+                if (!claimChain(a, start, n, frags)) continue;
+                if (depth + 1 >= MAX_DIR_DEPTH) {
+                    r.skippedDirs++;
+                    continue;
+                }
+                d.entry++;
+                stack[++depth] = { start, 0, 0, 0 };
+                descended = true;
+                break;
+            }
+
+            r.files++;
+            uint32_t size = rd32(&e[28]);
+            if (start == 0) {
+                if (size != 0) r.sizeMismatches++;
+                continue;
+            }
+
+            claimChain(a, start, n, frags);
+            if (a.ioError) return false;
+
+            if (n != (size + clusterBytes - 1) / clusterBytes) r.sizeMismatches++;
+            r.fragments += frags;
+            if (frags > 1) {
+                r.fragmentedFiles++;
+                rankFragmented(r, e, frags, n);
+            }
+        }
+
+        if (descended) continue;
+        if (endOfDir) { depth--; continue; }
+
+        d.entry = 0;
+        d.sector++;
+    }
+    return true;
+}
+
+// ===============================
+// Entry point
+// ===============================
+
+FatAnalyzeResult analyzeFat(SdCard *card, FatReport &rep, FatProgressFn progress) {
+    memset(&rep, 0, sizeof(rep));
+
+    ArenaScope scope("analyzer");
+    uint8_t *dirSector = arenaAlloc(512);
+    if (!dirSector) return ANALYZE_NO_MEMORY;
+
+    // Locate the volume (MBR partition or superfloppy)
+    if (!card->readSector(0, dirSector)) return ANALYZE_READ_ERROR;
+    uint32_t partStart = mbrFirstPartition(dirSector);
+    if (partStart && !card->readSector(partStart, dirSector)) return ANALYZE_READ_ERROR;
+
+    if (!parseFatBootSector(dirSector, partStart, rep.vol)) {
+        return rep.vol.fatType == FAT_VOL_EXFAT ? ANALYZE_EXFAT : ANALYZE_NOT_FAT;
+    }
+    if (rep.vol.fatType == 12) return ANALYZE_FAT12;
+
+    Analyzer a;
+    memset(&a, 0, sizeof(a));
+
+    // The bitmap first: the window takes what is left
+    if (!a.map.begin(rep.vol.clusterCount)) return ANALYZE_NO_MEMORY;
+    a.winSectors = arenaFree() / 512;
+    if (a.winSectors > FAT_WINDOW_SECTORS) a.winSectors = FAT_WINDOW_SECTORS;
+    a.fatWindow = a.winSectors ? arenaAlloc(a.winSectors * 512) : nullptr;
+    if (!a.fatWindow) return ANALYZE_NO_MEMORY;
+
+    a.card = card;
+    a.dirSector = dirSector;
+    a.rep = &rep;
+    a.progress = progress;
+    a.vol = &rep.vol;
+    a.entryBytes = rep.vol.fatType == 32 ? 4 : 2;
+    a.lastPercent = 0xFF;
+
+    FatAnalyzeResult result = ANALYZE_OK;
+
+    // --- Pass 1 ---
+    uint32_t t = millis();
+    bool ok = streamFat(a);
+    rep.fatMs = millis() - t;
+
+    if (ok) {
+        rep.usedClusters = a.map.count();
+        rep.freeClusters = rep.vol.clusterCount - rep.usedClusters - rep.badClusters;
+
+        // --- Pass 2 ---
+        t = millis();
+        ok = walkDirectories(a);
+        rep.walkMs = millis() - t;
+    }
+
+    if (ok) {
+        rep.lostClusters = a.map.count();
+        report(a, 100);
+    } else {
+        result = a.aborted ? ANALYZE_ABORTED : ANALYZE_READ_ERROR;
+    }
+
+    return result;
+}
@@ -0,0 +1,60 @@
+/**
+ * FAT Analyzer
+ * Streams the FAT of a FAT16/FAT32 card into a compact cluster
+ * bitmap, then walks every directory to report free space,
+ * fragmentation per file, lost clusters and cross-links.
+ */
+
+#pragma once
+
+#include <SdFat.h>
+
+#include "fat_layout.h"
+
+// Files listed on the "worst fragmented" page
+constexpr int FAT_WORST_FILES = 5;
+
+struct FatFileFrag {
+    char     name[13];           // 8.3 short name
+    uint32_t fragments;
+    uint32_t clusters;
+};
+
+struct FatReport {
+    FatVolumeInfo vol;
+
+    uint32_t freeClusters;
+    uint32_t usedClusters;
+    uint32_t badClusters;        // Marked bad in the FAT
+
+    uint32_t files;
+    uint32_t dirs;
+    uint32_t fragmentedFiles;    // More than one run of clusters
+    uint32_t fragments;          // Runs across all files
+
+    uint32_t lostClusters;       // Allocated but owned by nothing
+    uint32_t crossLinks;         // Cluster reached from two chains (or a loop)
+    uint32_t brokenChains;       // Chain into a free / out-of-range cluster
+    uint32_t sizeMismatches;     // Chain length disagrees with file size
+    uint32_t skippedDirs;        // Deeper than the walker's stack
+
+    FatFileFrag worst[FAT_WORST_FILES];
+
+    uint32_t fatMs;              // FAT streaming pass
+    uint32_t walkMs;             // Directory walk
+};
+
+enum FatAnalyzeResult : uint8_t {
+    ANALYZE_OK = 0,
+    ANALYZE_READ_ERROR,
+    ANALYZE_NOT_FAT,             // No FAT volume found
+    ANALYZE_EXFAT,               // exFAT is not analysed
+    ANALYZE_FAT12,               // FAT12 is not analysed
+    ANALYZE_NO_MEMORY,           // Bitmap does not fit in the arena
+    ANALYZE_ABORTED
+};
+
+// Called between chunks with 0-100. Return false to abort.
+typedef bool (*FatProgressFn)(uint8_t percent);
+
+FatAnalyzeResult analyzeFat(SdCard *card, FatReport &rep, FatProgressFn progress);
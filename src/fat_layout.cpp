@@ -0,0 +1,162 @@
+/**
+ * FAT32 Layout Solver — compile-time validation and BPB decoding
+ * Layout bugs fail the build instead of wearing out real cards.
+ */
+
+#include "fat_layout.h"
+
+#include <string.h>
+
+// -------------------------------
+// Known card sizes
+// -------------------------------
+// Sector counts as reported by real SanDisk / Samsung cards.
+
+// 8GB
+static_assert(planFat32Layout(15523840).fatSize == 1895, "8GB FAT size");
+static_assert(planFat32Layout(15523840).clusterCount == 242468, "8GB clusters");
+
+// 32GB — last size on 32KB clusters
+static_assert(planFat32Layout(62333952).fatSize == 7608, "32GB FAT size");
+static_assert(planFat32Layout(62333952).dataStart == 17296, "32GB data start");
+
+// 64GB / 128GB — 64KB clusters
+static_assert(planFat32Layout(124735488).fatSize == 7613, "64GB FAT size");
+static_assert(planFat32Layout(249737216).fatSize == 15241, "128GB FAT size");
+
+// 2TB is the FAT32 / SPI ceiling; one sector more is SDUC
+static_assert(planFat32Layout(FAT32_MAX_CARD_SECTORS).status == LAYOUT_OK, "2TB fits");
+static_assert(planFat32Layout(FAT32_MAX_CARD_SECTORS).clusterCount == 33550320, "2TB clusters");
+static_assert(planFat32Layout(FAT32_MAX_CARD_SECTORS + 1).status == LAYOUT_TOO_LARGE, "SDUC rejected");
+static_assert(planFat32Layout(256ULL << 31).status == LAYOUT_TOO_LARGE, "128TB SDUC rejected");
+
+// Too few clusters for FAT32 is reported, not silently formatted
+static_assert(solveFat32Layout(4194304, 2048, 64).status == LAYOUT_TOO_SMALL, "2GB @ 32KB is FAT16");
+static_assert(solveFat32Layout(62333952, 2048, 48).status == LAYOUT_BAD_PARAMS, "cluster not pow2");
+
+// -------------------------------
+// Full sweep: 64MB → 2TB
+// -------------------------------
+// One pass on 64MB boundaries and one on an odd stride so
+// unaligned sector counts are covered too.
+static_assert(fat32LayoutSweep(131072, FAT32_MAX_CARD_SECTORS, 131072),
+              "FAT32 layout invalid on a 64MB boundary");
+static_assert(fat32LayoutSweep(131072 + 1, FAT32_MAX_CARD_SECTORS, 131072 + 4093),
+              "FAT32 layout invalid on an unaligned size");
+
+// -------------------------------
+// Erase-block aligned layouts
+// -------------------------------
+// 32GB card with a 4MB erase block: partition and data on 4MB
+static_assert(alignFat32Layout(62333952, 8192).partStart == 8192, "32GB aligned partition");
+static_assert(alignFat32Layout(62333952, 8192).dataStart % 8192 == 0, "32GB aligned data");
+static_assert(fat32LayoutIsValid(alignFat32Layout(62333952, 8192)), "32GB aligned valid");
+
+// A 64KB flash page raises 32KB clusters to 64KB
+static_assert(alignFat32Layout(62333952, 8192, 128).sectorsPerCluster == 128, "page-sized clusters");
+
+// No geometry = the default plan
+static_assert(alignFat32Layout(62333952, 0).dataStart == 17296, "unaligned fallback");
+
+static_assert(fat32AlignedSweep(4194304 + 1, FAT32_MAX_CARD_SECTORS, 1048576 + 4093, 8192),
+              "4MB-aligned layout invalid");
+static_assert(fat32AlignedSweep(4194304 + 1, FAT32_MAX_CARD_SECTORS, 1048576 + 8191, 16384),
+              "8MB-aligned layout invalid");
+
+// ===============================
+// Boot sector decoding
+// ===============================
+
+static inline uint16_t le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool looksLikeBootSector(const uint8_t *s) {
+    if (s[510] != 0x55 || s[511] != 0xAA) return false;
+    if (s[0] != 0xEB && s[0] != 0xE9) return false;
+    return true;
+}
+
+uint32_t mbrFirstPartition(const uint8_t *mbr) {
+    if (mbr[510] != 0x55 || mbr[511] != 0xAA) return 0;
+
+    // A VBR at sector 0 also ends in 55AA — the jump opcode and a
+    // sane bytes-per-sector field tell the two apart
+    if (looksLikeBootSector(mbr) && le16(&mbr[11]) == 512) return 0;
+
+    for (int i = 0; i < 4; i++) {
+        const uint8_t *p = &mbr[446 + i * 16];
+        uint32_t start = le32(&p[8]);
+        if (p[4] != 0x00 && start != 0) return start;
+    }
+    return 0;
+}
+
+bool parseFatBootSector(const uint8_t *vbr, uint32_t partStart, FatVolumeInfo &v) {
+    memset(&v, 0, sizeof(v));
+    v.partStart = partStart;
+
+    if (!looksLikeBootSector(vbr)) return false;
+
+    if (memcmp(&vbr[3], "EXFAT   ", 8) == 0) {
+        v.fatType = FAT_VOL_EXFAT;
+        return false;
+    }
+
+    // Only 512-byte sectors exist on SD cards
+    if (le16(&vbr[11]) != 512) return false;
+
+    const uint8_t spc = vbr[13];
+    if (spc == 0 || (spc & (spc - 1)) != 0) return false;
+
+    const uint32_t rootEntries = le16(&vbr[17]);
+    const uint32_t total16     = le16(&vbr[19]);
+    const uint32_t fatSize16   = le16(&vbr[22]);
+
+    v.sectorsPerCluster = spc;
+    v.reservedSectors   = le16(&vbr[14]);
+    v.numFats           = vbr[16];
+    v.totalSectors      = total16 ? total16 : le32(&vbr[32]);
+    v.fatSize           = fatSize16 ? fatSize16 : le32(&vbr[36]);
+
+    if (v.reservedSectors == 0 || v.numFats == 0 || v.fatSize == 0) return false;
+
+    v.fatStart       = partStart + v.reservedSectors;
+    v.rootDirStart   = v.fatStart + v.numFats * v.fatSize;
+    v.rootDirSectors = (rootEntries * 32 + 511) / 512;
+    v.dataStart      = v.rootDirStart + v.rootDirSectors;
+
+    const uint32_t meta = v.dataStart - partStart;
+    if (meta >= v.totalSectors) return false;
+    v.clusterCount = (v.totalSectors - meta) / spc;
+
+    // FAT type is defined by cluster count alone
+    if (v.clusterCount < 4085) {
+        v.fatType = 12;
+    } else if (v.clusterCount < FAT32_MIN_CLUSTERS) {
+        v.fatType = 16;
+    } else {
+        v.fatType = 32;
+        v.rootCluster = le32(&vbr[44]);
+    }
+    return true;
+}
+
+const char* fat32LayoutMismatch(const Fat32Layout &l, const FatVolumeInfo &v) {
+    if (v.fatType != 32)                         return "FAT type";
+    if (v.partStart != l.partStart)              return "partition start";
+    if (v.totalSectors != l.partSectors)         return "total sectors";
+    if (v.reservedSectors != l.reservedSectors)  return "reserved sectors";
+    if (v.numFats != FAT32_NUM_FATS)             return "FAT count";
+    if (v.sectorsPerCluster != l.sectorsPerCluster) return "cluster size";
+    if (v.fatSize != l.fatSize)                  return "FAT size";
+    if (v.dataStart != l.dataStart)              return "data start";
+    if (v.clusterCount != l.clusterCount)        return "cluster count";
+    if (v.rootCluster != 2)                      return "root cluster";
+    return nullptr;
+}
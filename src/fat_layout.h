@@ -0,0 +1,298 @@
+/**
+ * FAT32 Layout Solver
+ * Closed-form, 64-bit FAT sizing used by quickFormat().
+ * Everything here is constexpr so known card sizes can be
+ * checked at compile time (see fat_layout.cpp).
+ * Also decodes the boot sector of volumes already on a card.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// ===============================
+// Layout constants
+// ===============================
+
+constexpr uint32_t FAT32_MIN_CLUSTERS     = 65525;        // Below this it is FAT16
+constexpr uint32_t FAT32_MAX_CLUSTERS     = 0x0FFFFFF5;   // 28-bit entries, minus reserved values
+constexpr uint64_t FAT32_MAX_CARD_SECTORS = 1ULL << 32;   // 2TB — 32-bit LBA in MBR/BPB and SPI mode
+constexpr uint32_t FAT32_RESERVED_SECTORS = 32;           // BPB + FSInfo + backup etc.
+constexpr uint32_t FAT32_NUM_FATS         = 2;
+constexpr uint32_t FAT32_ENTRIES_PER_SECTOR = 512 / 4;
+
+enum FatLayoutStatus : uint8_t {
+    LAYOUT_OK = 0,
+    LAYOUT_BAD_PARAMS,   // Zero / non power-of-two cluster, or no room after partStart
+    LAYOUT_TOO_SMALL,    // Fewer than 65525 clusters — FAT16 territory
+    LAYOUT_TOO_LARGE     // > 2TB (SDUC) or too many clusters — needs exFAT
+};
+
+// Absolute sector positions (from the start of the card)
+struct Fat32Layout {
+    FatLayoutStatus status;
+    uint32_t partStart;
+    uint32_t partSectors;
+    uint32_t reservedSectors;
+    uint32_t sectorsPerCluster;
+    uint32_t fatSize;          // Sectors per FAT
+    uint32_t fatStart;
+    uint32_t dataStart;        // First sector of cluster 2 (root dir)
+    uint32_t clusterCount;
+};
+
+// -------------------------------
+// Cluster size selection
+// -------------------------------
+// FAT32 rules:
+//  - ≤32GB → 32KB clusters
+//  - ≥64GB → 64KB clusters
+//  - FAT16 only for ≤2GB
+constexpr uint32_t chooseClusterSize(uint64_t sizeMB) {
+    if (sizeMB <= 2048) {
+        // FAT16 case — handled separately in quickFormat()
+        return 0;
+    }
+    if (sizeMB <= 32768) {
+        return 32 * 1024;   // 32KB
+    }
+    return 64 * 1024;       // 64KB
+}
+
+// -------------------------------
+// Partition alignment
+// -------------------------------
+// SDXC requires 1MB alignment.
+// SDHC can use 128KB or 1MB — we use 1MB for simplicity.
+constexpr uint32_t partitionStartSector(uint64_t /*sizeMB*/) {
+    return 2048;   // 2048 * 512 = 1MB
+}
+
+// -------------------------------
+// Closed-form FAT size
+// -------------------------------
+// The FAT must hold an entry for every data cluster plus the two
+// reserved entries, and the data region shrinks as the FAT grows:
+//
+//   128 * F >= floor((P - R - N*F) / spc) + 2
+//
+// Dropping the floor gives a sufficient bound that solves directly:
+//
+//   F = ceil((P - R + 2*spc) / (128*spc + N))
+//
+// The floor can make that one sector larger than needed, so one
+// correction step makes the result minimal.
+constexpr bool fat32FatFits(uint64_t partSectors, uint32_t reserved,
+                            uint32_t spc, uint64_t fatSize) {
+    uint64_t used = (uint64_t)reserved + FAT32_NUM_FATS * fatSize;
+    if (used >= partSectors) return false;
+    uint64_t clusters = (partSectors - used) / spc;
+    return fatSize * FAT32_ENTRIES_PER_SECTOR >= clusters + 2;
+}
+
+constexpr uint64_t fat32FatSectors(uint64_t partSectors, uint32_t reserved,
+                                   uint32_t spc) {
+    const uint64_t div = (uint64_t)FAT32_ENTRIES_PER_SECTOR * spc + FAT32_NUM_FATS;
+    uint64_t fatSize = (partSectors - reserved + 2ULL * spc + div - 1) / div;
+
+    if (fatSize > 1 && fat32FatFits(partSectors, reserved, spc, fatSize - 1)) {
+        fatSize--;
+    }
+    return fatSize;
+}
+
+// -------------------------------
+// Full layout
+// -------------------------------
+constexpr Fat32Layout solveFat32Layout(
+    uint64_t cardSectors,
+    uint32_t partStart,
+    uint32_t sectorsPerCluster,
+    uint32_t reservedSectors = FAT32_RESERVED_SECTORS
+) {
+    Fat32Layout l{};
+    l.status = LAYOUT_BAD_PARAMS;
+    l.partStart = partStart;
+    l.reservedSectors = reservedSectors;
+    l.sectorsPerCluster = sectorsPerCluster;
+
+    const uint32_t spc = sectorsPerCluster;
+    if (spc == 0 || spc > 128 || (spc & (spc - 1)) != 0) return l;
+    if (reservedSectors < 8) return l;   // BPB, FSInfo and backups at +6/+7
+
+    if (cardSectors > FAT32_MAX_CARD_SECTORS) {
+        l.status = LAYOUT_TOO_LARGE;
+        return l;
+    }
+    if (cardSectors <= (uint64_t)partStart + reservedSectors) return l;
+
+    const uint64_t part = cardSectors - partStart;
+    const uint64_t fatSize = fat32FatSectors(part, reservedSectors, spc);
+    const uint64_t used = reservedSectors + FAT32_NUM_FATS * fatSize;
+    if (used >= part) {
+        l.status = LAYOUT_TOO_SMALL;
+        return l;
+    }
+
+    const uint64_t clusters = (part - used) / spc;
+    if (clusters < FAT32_MIN_CLUSTERS) {
+        l.status = LAYOUT_TOO_SMALL;
+        return l;
+    }
+    if (clusters > FAT32_MAX_CLUSTERS) {
+        l.status = LAYOUT_TOO_LARGE;
+        return l;
+    }
+
+    l.partSectors  = (uint32_t)part;
+    l.fatSize      = (uint32_t)fatSize;
+    l.fatStart     = partStart + reservedSectors;
+    l.dataStart    = (uint32_t)(l.fatStart + FAT32_NUM_FATS * fatSize);
+    l.clusterCount = (uint32_t)clusters;
+    l.status       = LAYOUT_OK;
+    return l;
+}
+
+// Layout for a card of the given size using the tool's own policy
+// (cluster size and partition alignment above).
+constexpr Fat32Layout planFat32Layout(uint64_t cardSectors) {
+    const uint64_t sizeMB = cardSectors * 512ULL / (1024ULL * 1024ULL);
+    return solveFat32Layout(cardSectors,
+                            partitionStartSector(sizeMB),
+                            chooseClusterSize(sizeMB) / 512);
+}
+
+// -------------------------------
+// Erase-block alignment
+// -------------------------------
+// With the card's erase block known (flash_geometry.h), start the
+// partition on one and pad the reserved area until cluster 2 does
+// too, so no cluster straddles two erase blocks and the FATs stop
+// sharing a block with file data. Padding shrinks the FAT a little,
+// which moves dataStart back, so repeat until it settles.
+// Clusters are raised to the flash page size when that is larger.
+constexpr uint32_t FAT32_MAX_RESERVED_SECTORS = 0xFFFF;   // 16-bit BPB field
+
+constexpr bool isPowerOfTwo(uint32_t v) {
+    return v && (v & (v - 1)) == 0;
+}
+
+constexpr Fat32Layout alignFat32Layout(uint64_t cardSectors,
+                                       uint32_t eraseSectors,
+                                       uint32_t pageSectors = 0) {
+    const uint64_t sizeMB = cardSectors * 512ULL / (1024ULL * 1024ULL);
+
+    uint32_t spc = chooseClusterSize(sizeMB) / 512;
+    if (isPowerOfTwo(pageSectors) && pageSectors > spc && pageSectors <= 128) {
+        spc = pageSectors;
+    }
+
+    uint32_t partStart = partitionStartSector(sizeMB);
+    if (!isPowerOfTwo(eraseSectors) || eraseSectors > FAT32_MAX_RESERVED_SECTORS / 2) {
+        return solveFat32Layout(cardSectors, partStart, spc);
+    }
+    if (eraseSectors > partStart) partStart = eraseSectors;
+
+    uint32_t reserved = FAT32_RESERVED_SECTORS;
+    Fat32Layout l = solveFat32Layout(cardSectors, partStart, spc, reserved);
+
+    for (int i = 0; i < 8 && l.status == LAYOUT_OK; i++) {
+        const uint32_t off = l.dataStart % eraseSectors;
+        if (off == 0) return l;
+
+        reserved += eraseSectors - off;
+        if (reserved > FAT32_MAX_RESERVED_SECTORS) break;
+        l = solveFat32Layout(cardSectors, partStart, spc, reserved);
+    }
+
+    // Could not settle (never seen) — a valid unaligned layout
+    return l.status == LAYOUT_OK && l.dataStart % eraseSectors == 0
+        ? l : solveFat32Layout(cardSectors, partStart, spc);
+}
+
+// -------------------------------
+// Layout invariants
+// -------------------------------
+// Every cluster mapped, nothing past the end of the partition,
+// and the FAT is the smallest one that works.
+constexpr bool fat32LayoutIsValid(const Fat32Layout &l) {
+    if (l.status != LAYOUT_OK) return false;
+
+    const uint64_t partEnd = (uint64_t)l.partStart + l.partSectors;
+    const uint64_t dataEnd =
+        (uint64_t)l.dataStart + (uint64_t)l.clusterCount * l.sectorsPerCluster;
+
+    return l.fatStart == l.partStart + l.reservedSectors &&
+           l.dataStart == l.fatStart + FAT32_NUM_FATS * l.fatSize &&
+           partEnd <= FAT32_MAX_CARD_SECTORS &&
+           dataEnd <= partEnd &&
+           partEnd - dataEnd < l.sectorsPerCluster &&
+           (uint64_t)l.fatSize * FAT32_ENTRIES_PER_SECTOR >= (uint64_t)l.clusterCount + 2 &&
+           !fat32FatFits(l.partSectors, l.reservedSectors,
+                         l.sectorsPerCluster, (uint64_t)l.fatSize - 1) &&
+           l.clusterCount >= FAT32_MIN_CLUSTERS &&
+           l.clusterCount <= FAT32_MAX_CLUSTERS;
+}
+
+// Sweep card sizes [first, last] in `step` sectors. Sizes the tool
+// formats as FAT32 (> 2GB) must give a valid layout; smaller sizes
+// go to SdFat's FAT16 formatter and are skipped.
+constexpr bool fat32LayoutSweep(uint64_t first, uint64_t last, uint64_t step) {
+    for (uint64_t n = first; n <= last; n += step) {
+        const uint64_t sizeMB = n * 512ULL / (1024ULL * 1024ULL);
+        if (chooseClusterSize(sizeMB) == 0) continue;
+        if (!fat32LayoutIsValid(planFat32Layout(n))) return false;
+    }
+    return true;
+}
+
+// Same sweep through the aligned planner: still valid, and the
+// partition and cluster 2 both start on an erase block.
+constexpr bool fat32AlignedSweep(uint64_t first, uint64_t last, uint64_t step,
+                                 uint32_t eraseSectors) {
+    for (uint64_t n = first; n <= last; n += step) {
+        const uint64_t sizeMB = n * 512ULL / (1024ULL * 1024ULL);
+        if (chooseClusterSize(sizeMB) == 0) continue;
+
+        const Fat32Layout l = alignFat32Layout(n, eraseSectors);
+        if (!fat32LayoutIsValid(l)) return false;
+        if (l.partStart % eraseSectors != 0 || l.dataStart % eraseSectors != 0) return false;
+    }
+    return true;
+}
+
+// ===============================
+// Existing volumes
+// ===============================
+// Decoded BPB of a FAT volume already on a card. Used by the
+// analyzer and to check what quickFormat() just wrote.
+
+struct FatVolumeInfo {
+    uint8_t  fatType;            // 12 / 16 / 32, FAT_VOL_EXFAT, 0 = unknown
+    uint8_t  numFats;
+    uint32_t partStart;
+    uint32_t totalSectors;
+    uint32_t reservedSectors;
+    uint32_t sectorsPerCluster;
+    uint32_t fatSize;
+    uint32_t fatStart;
+    uint32_t rootDirStart;       // FAT12/16 fixed root directory
+    uint32_t rootDirSectors;
+    uint32_t rootCluster;        // FAT32 root directory chain
+    uint32_t dataStart;
+    uint32_t clusterCount;
+};
+
+constexpr uint8_t FAT_VOL_EXFAT = 64;
+
+// Start of the first partition in an MBR, 0 if the sector is
+// not an MBR (e.g. a superfloppy card with the VBR at sector 0).
+uint32_t mbrFirstPartition(const uint8_t *mbr);
+
+// Decode a volume boot record. False if it is not FAT12/16/32;
+// exFAT is recognised (fatType = FAT_VOL_EXFAT) but not decoded.
+bool parseFatBootSector(const uint8_t *vbr, uint32_t partStart, FatVolumeInfo &v);
+
+// Compare a decoded volume with the layout quickFormat() wrote.
+// Returns the first field that differs, nullptr if they match.
+const char* fat32LayoutMismatch(const Fat32Layout &l, const FatVolumeInfo &v);
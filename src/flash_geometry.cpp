@@ -0,0 +1,312 @@
+/**
+ * Flash Geometry Probe — timing engine and inference
+ * All tests run in a 16MB-aligned area half way into the card,
+ * away from the FAT area that many controllers treat specially.
+ * Each timing keeps the fastest of several runs so SPI and
+ * scheduling noise drop out.
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "flash_geometry.h"
+#include "io_arena.h"
+
+static const uint32_t GEO_AREA_ALIGN = 32768;        // 16MB
+static const uint32_t GEO_MIN_CARD = 2097152;        // 1GB
+static const int GEO_ALIGN_REPS = 8;
+
+static const uint32_t GEO_WRITE_MAX_SECTORS = 128;   // 64KB buffer
+static const uint32_t GEO_WRITE_TOTAL = 1024;        // 512KB per run
+
+static const uint32_t GEO_OPEN_CHUNK = 32;           // 16KB writes
+static const uint32_t GEO_OPEN_TOTAL = 4096;         // 2MB per N
+static const uint32_t GEO_DEFAULT_ERASE = 8192;      // 4MB if unknown
+
+// A boundary counts when it costs this much more than the quietest one
+static const int32_t GEO_NOISE_US = 15;
+
+// Largest plausible flash page; a first jump above this is the erase block
+static const uint32_t GEO_MAX_PAGE_SECTORS = 128;
+
+// ===============================
+// Align test
+// ===============================
+
+static bool timeRead(SectorDevice *dev, uint32_t sector, uint8_t *buf, uint32_t &best) {
+    uint32_t t0 = micros();
+    if (!dev->readSectors(sector, buf, 2)) return false;
+    uint32_t us = micros() - t0;
+    if (us < best) best = us;
+    return true;
+}
+
+static GeoResult alignTest(SectorDevice *dev, uint32_t area, uint8_t *buf,
+                           FlashGeometry &geo, GeoProgressFn progress) {
+
+    for (int p = 0; p < GEO_ALIGN_POINTS; p++) {
+        const uint32_t block = GEO_ALIGN_MIN_SECTORS << p;
+        uint32_t pre = UINT32_MAX, on = UINT32_MAX, post = UINT32_MAX;
+
+        // Odd multiples: on a `block` boundary but not a 2*block one
+        for (int j = 0; j < GEO_ALIGN_REPS; j++) {
+            const uint32_t b = area + (2 * j + 1) * block;
+            if (!timeRead(dev, b - 2, buf, pre) ||
+                !timeRead(dev, b - 1, buf, on) ||
+                !timeRead(dev, b, buf, post)) {
+                return GEO_IO_ERROR;
+            }
+        }
+
+        geo.align[p].blockSectors = block;
+        geo.align[p].onUs = on;
+        geo.align[p].diffUs = (int32_t)on - (int32_t)((pre + post) / 2);
+
+        if (progress && !progress(GEO_STAGE_ALIGN, (p + 1) * 100 / GEO_ALIGN_POINTS)) {
+            return GEO_ABORTED;
+        }
+    }
+    return GEO_OK;
+}
+
+// Page = first boundary size that costs extra (and keeps costing);
+// erase block = where the cost steps up again
+static void inferPageAndErase(FlashGeometry &geo) {
+    geo.pageSectors = 0;
+    geo.eraseSectors = 0;
+
+    int32_t base = geo.align[0].diffUs;
+    for (int i = 1; i < GEO_ALIGN_POINTS; i++) {
+        if (geo.align[i].diffUs < base) base = geo.align[i].diffUs;
+    }
+    const int32_t threshold = base + GEO_NOISE_US;
+
+    int first = -1;
+    for (int i = 0; i < GEO_ALIGN_POINTS; i++) {
+        bool here = geo.align[i].diffUs >= threshold;
+        bool next = i + 1 == GEO_ALIGN_POINTS || geo.align[i + 1].diffUs >= threshold;
+        if (here && next) {
+            first = i;
+            break;
+        }
+    }
+    if (first < 0) return;
+
+    // Only one step, and too big for a page: it is the erase block
+    if (geo.align[first].blockSectors > GEO_MAX_PAGE_SECTORS) {
+        geo.eraseSectors = geo.align[first].blockSectors;
+        return;
+    }
+    geo.pageSectors = geo.align[first].blockSectors;
+
+    const int32_t pageDiff = geo.align[first].diffUs;
+    int32_t maxDiff = pageDiff;
+    for (int i = first + 1; i < GEO_ALIGN_POINTS; i++) {
+        if (geo.align[i].diffUs > maxDiff) maxDiff = geo.align[i].diffUs;
+    }
+    if (maxDiff - pageDiff < GEO_NOISE_US) return;
+
+    const int32_t step = pageDiff + (maxDiff - pageDiff) / 2;
+    for (int i = first + 1; i < GEO_ALIGN_POINTS; i++) {
+        if (geo.align[i].diffUs >= step) {
+            geo.eraseSectors = geo.align[i].blockSectors;
+            return;
+        }
+    }
+}
+
+// ===============================
+// Write size / alignment test
+// ===============================
+
+// Writes of `size` sectors every 2*size, starting `shift` in
+static bool timedWrites(SectorDevice *dev, uint32_t start, uint32_t size,
+                        uint32_t shift, const uint8_t *buf, uint32_t &kbs) {
+    const uint32_t count = GEO_WRITE_TOTAL / size;
+    uint32_t t0 = millis();
+
+    for (uint32_t k = 0; k < count; k++) {
+        if (!dev->writeSectors(start + shift + k * 2 * size, buf, size)) return false;
+    }
+    dev->syncDevice();
+
+    uint32_t ms = millis() - t0;
+    kbs = ms ? (GEO_WRITE_TOTAL / 2) * 1000 / ms : 0;
+    return true;
+}
+
+static GeoResult writeTest(SectorDevice *dev, uint32_t area, const uint8_t *buf,
+                           FlashGeometry &geo, GeoProgressFn progress) {
+    for (int p = 0; p < GEO_WRITE_POINTS; p++) {
+        const uint32_t size = GEO_ALIGN_MIN_SECTORS << p;
+        GeoWritePoint &w = geo.write[p];
+        w.sizeSectors = size;
+
+        if (!timedWrites(dev, area, size, 0, buf, w.alignedKBs) ||
+            !timedWrites(dev, area, size, size / 2, buf, w.offsetKBs)) {
+            return GEO_IO_ERROR;
+        }
+
+        if (progress && !progress(GEO_STAGE_WRITE, (p + 1) * 100 / GEO_WRITE_POINTS)) {
+            return GEO_ABORTED;
+        }
+    }
+    return GEO_OK;
+}
+
+// ===============================
+// Open erase blocks test
+// ===============================
+
+static GeoResult openTest(SectorDevice *dev, uint32_t area, const uint8_t *buf,
+                          FlashGeometry &geo, GeoProgressFn progress) {
+    uint32_t au = geo.eraseSectors ? geo.eraseSectors : GEO_DEFAULT_ERASE;
+    if (au < GEO_OPEN_CHUNK * 4) au = GEO_OPEN_CHUNK * 4;
+
+    geo.openPoints = 0;
+    for (int n = 1; n <= GEO_MAX_OPEN; n++) {
+        uint32_t total = GEO_OPEN_TOTAL;
+        if (total > n * au) total = n * au;
+        const uint32_t writes = total / GEO_OPEN_CHUNK;
+
+        uint32_t t0 = millis();
+        for (uint32_t w = 0; w < writes; w++) {
+            uint32_t sector = area + (w % n) * au + (w / n) * GEO_OPEN_CHUNK;
+            if (!dev->writeSectors(sector, buf, GEO_OPEN_CHUNK)) return GEO_IO_ERROR;
+
+            if (progress && w % 16 == 15 &&
+                !progress(GEO_STAGE_OPEN, ((n - 1) * writes + w) * 100 / (GEO_MAX_OPEN * writes))) {
+                return GEO_ABORTED;
+            }
+        }
+        dev->syncDevice();
+        uint32_t ms = millis() - t0;
+
+        GeoOpenPoint &o = geo.open[geo.openPoints++];
+        o.segments = n;
+        o.kbs = ms ? total / 2 * 1000 / ms : 0;
+    }
+
+    // Open segments = last N before the speed halves
+    geo.openSegments = 1;
+    for (int i = 1; i < geo.openPoints; i++) {
+        if (geo.open[i].kbs * 2 < geo.open[0].kbs) break;
+        geo.openSegments = geo.open[i].segments;
+    }
+    return GEO_OK;
+}
+
+// ===============================
+// Run
+// ===============================
+
+GeoResult probeGeometry(SectorDevice *dev, FlashGeometry &geo, GeoProgressFn progress) {
+    memset(&geo, 0, sizeof(geo));
+
+    const uint32_t sectors = dev->sectorCount();
+    if (sectors < GEO_MIN_CARD) return GEO_TOO_SMALL;
+
+    const uint32_t area = (sectors / 2) & ~(GEO_AREA_ALIGN - 1);
+
+    ArenaScope scope("geometry");
+    uint8_t *buf = arenaAlloc(GEO_WRITE_MAX_SECTORS * 512);
+    if (!buf) return GEO_NO_MEMORY;
+
+    GeoResult res = alignTest(dev, area, buf, geo, progress);
+    if (res != GEO_OK) return res;
+    inferPageAndErase(geo);
+
+    // Incompressible data, in case the controller is clever
+    uint32_t x = 0x2545F491UL;
+    for (uint32_t i = 0; i < GEO_WRITE_MAX_SECTORS * 128; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        ((uint32_t *)buf)[i] = x;
+    }
+
+    res = writeTest(dev, area, buf, geo, progress);
+
+    // Open-AU blocks start on a 16MB boundary past the write test
+    if (res == GEO_OK) res = openTest(dev, area + 2 * GEO_AREA_ALIGN, buf, geo, progress);
+    return res;
+}
+
+// ===============================
+// NVS
+// ===============================
+
+static const char* GEO_NAMESPACE = "sdtool";
+static const char* GEO_NEXT_KEY = "geonext";     // Slot the next new card takes
+static const uint8_t GEO_VERSION = 1;
+
+struct GeometrySaved {
+    uint8_t  version;
+    uint8_t  mid;
+    uint8_t  openSegments;
+    uint8_t  reserved;
+    uint32_t psn;
+    uint32_t pageSectors;
+    uint32_t eraseSectors;
+};
+
+static void slotKey(int slot, char key[8]) {
+    snprintf(key, 8, "geo%d", slot);
+}
+
+static bool readSlot(Preferences &prefs, int slot, GeometrySaved &g) {
+    char key[8];
+    slotKey(slot, key);
+    return prefs.getBytesLength(key) == sizeof(g) &&
+           prefs.getBytes(key, &g, sizeof(g)) == sizeof(g) && g.version == GEO_VERSION;
+}
+
+// Slot holding this card, -1 if none
+static int findSlot(Preferences &prefs, uint8_t mid, uint32_t psn, GeometrySaved &g) {
+    for (int i = 0; i < GEO_SLOTS; i++) {
+        if (readSlot(prefs, i, g) && g.mid == mid && g.psn == psn) return i;
+    }
+    return -1;
+}
+
+bool geometrySave(uint8_t mid, uint32_t psn, const FlashGeometry &geo) {
+    Preferences prefs;
+    if (!prefs.begin(GEO_NAMESPACE, false)) return false;
+
+    GeometrySaved g;
+    int slot = findSlot(prefs, mid, psn, g);
+    if (slot < 0) {
+        slot = prefs.getUChar(GEO_NEXT_KEY, 0) % GEO_SLOTS;
+        prefs.putUChar(GEO_NEXT_KEY, (slot + 1) % GEO_SLOTS);
+    }
+
+    memset(&g, 0, sizeof(g));
+    g.version      = GEO_VERSION;
+    g.mid          = mid;
+    g.openSegments = geo.openSegments;
+    g.psn          = psn;
+    g.pageSectors  = geo.pageSectors;
+    g.eraseSectors = geo.eraseSectors;
+
+    char key[8];
+    slotKey(slot, key);
+    bool ok = prefs.putBytes(key, &g, sizeof(g)) == sizeof(g);
+    prefs.end();
+    return ok;
+}
+
+bool geometryLoad(uint8_t mid, uint32_t psn, uint32_t &pageSectors,
+                  uint32_t &eraseSectors, uint8_t &openSegments) {
+    GeometrySaved g;
+    Preferences prefs;
+    if (!prefs.begin(GEO_NAMESPACE, true)) return false;
+
+    bool ok = findSlot(prefs, mid, psn, g) >= 0;
+    prefs.end();
+    if (!ok) return false;
+
+    pageSectors  = g.pageSectors;
+    eraseSectors = g.eraseSectors;
+    openSegments = g.openSegments;
+    return true;
+}
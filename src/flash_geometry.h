@@ -0,0 +1,79 @@
+/**
+ * Flash Geometry Probe
+ * flashbench-style timing to find what the card will not say:
+ *  - align test (reads): a 1KB read straddling a boundary costs
+ *    more when that boundary is a flash page or erase block
+ *  - write test: writes of growing size, aligned vs half-offset
+ *  - open-AU test: round-robin writes into N erase blocks; speed
+ *    collapses once N exceeds the card's open segments
+ * DESTRUCTIVE: writes a test area in the middle of the card.
+ * The result feeds alignFat32Layout() for the quick format.
+ */
+
+#pragma once
+
+#include "sector_device.h"
+
+// Boundary sizes tried by the align test: 4KB .. 16MB
+constexpr int GEO_ALIGN_POINTS = 13;
+constexpr uint32_t GEO_ALIGN_MIN_SECTORS = 8;
+
+// Write sizes: 4KB .. 64KB
+constexpr int GEO_WRITE_POINTS = 5;
+
+// Erase blocks written round-robin: 1 .. 8
+constexpr int GEO_MAX_OPEN = 8;
+
+struct GeoAlignPoint {
+    uint32_t blockSectors;       // Boundary spacing under test
+    uint32_t onUs;               // Fastest read across the boundary
+    int32_t  diffUs;             // on - mean(before, after)
+};
+
+struct GeoWritePoint {
+    uint32_t sizeSectors;
+    uint32_t alignedKBs;
+    uint32_t offsetKBs;          // Same writes shifted by half a size
+};
+
+struct GeoOpenPoint {
+    uint8_t  segments;
+    uint32_t kbs;
+};
+
+struct FlashGeometry {
+    GeoAlignPoint align[GEO_ALIGN_POINTS];
+    GeoWritePoint write[GEO_WRITE_POINTS];
+    GeoOpenPoint  open[GEO_MAX_OPEN];
+    int openPoints;
+
+    // Inferred, 0 = not found
+    uint32_t pageSectors;
+    uint32_t eraseSectors;
+    uint8_t  openSegments;       // GEO_MAX_OPEN means "at least"
+};
+
+enum GeoResult : uint8_t {
+    GEO_OK = 0,
+    GEO_IO_ERROR,
+    GEO_NO_MEMORY,
+    GEO_TOO_SMALL,               // Needs a card of at least 1GB
+    GEO_ABORTED
+};
+
+enum GeoStage : uint8_t { GEO_STAGE_ALIGN = 0, GEO_STAGE_WRITE, GEO_STAGE_OPEN };
+
+// Called often with the stage and 0-100. Return false to abort.
+typedef bool (*GeoProgressFn)(GeoStage stage, uint8_t percent);
+
+GeoResult probeGeometry(SectorDevice *dev, FlashGeometry &geo, GeoProgressFn progress);
+
+// Cards whose last result is kept; a new card beyond that
+// replaces the one saved longest ago
+constexpr int GEO_SLOTS = 8;
+
+// Last result per card (MID + PSN), kept in NVS so a later format
+// of that card can use it
+bool geometrySave(uint8_t mid, uint32_t psn, const FlashGeometry &geo);
+bool geometryLoad(uint8_t mid, uint32_t psn, uint32_t &pageSectors,
+                  uint32_t &eraseSectors, uint8_t &openSegments);
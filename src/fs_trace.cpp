@@ -0,0 +1,187 @@
+/**
+ * FS Trace — classifying block device
+ */
+
+#include <Arduino.h>
+
+#include "fs_trace.h"
+#include "fat_layout.h"
+#include "io_arena.h"
+
+// Longest root directory chain followed at attach()
+static const uint32_t TRACE_MAX_CHAIN = 1024;
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ===============================
+// Layout
+// ===============================
+
+bool FsTrace::attach(FsBlockDevice *d) {
+    dev = d;
+    known = false;
+    fatStart = fatEnd = rootStart = rootEnd = dataStart = 0;
+    clusterSectors = clusterCount = 0;
+    dirRunCount = 0;
+    bitmap = {0, 0};
+    memset(caches, 0, sizeof(caches));
+    reset();
+
+    // Read straight from the card: the layout reads are not the test's
+    ArenaScope scope("trace");
+    uint8_t *buf = arenaAlloc(512);
+    if (!buf || !dev->readSector(0, buf)) return false;
+
+    const uint32_t part = mbrFirstPartition(buf);
+    if (part && !dev->readSector(part, buf)) return false;
+
+    FatVolumeInfo v;
+    if (parseFatBootSector(buf, part, v)) {
+        fatStart       = v.fatStart;
+        fatEnd         = v.fatStart + v.numFats * v.fatSize;
+        rootStart      = v.rootDirStart;
+        rootEnd        = v.rootDirStart + v.rootDirSectors;
+        dataStart      = v.dataStart;
+        clusterSectors = v.sectorsPerCluster;
+        clusterCount   = v.clusterCount;
+        known = true;
+        if (v.fatType == 32) walkRootChain(buf, v.rootCluster, 0x0FFFFFFF);
+        return true;
+    }
+
+    // --- exFAT: offsets from the volume start, 512-byte sectors only ---
+    if (v.fatType != FAT_VOL_EXFAT || buf[108] != 9 || buf[109] > 16) return false;
+
+    const uint8_t numFats = buf[110] ? buf[110] : 1;
+    fatStart       = part + le32(&buf[80]);
+    fatEnd         = fatStart + numFats * le32(&buf[84]);
+    dataStart      = part + le32(&buf[88]);
+    clusterCount   = le32(&buf[92]);
+    clusterSectors = 1UL << buf[109];
+    known = true;
+
+    // The allocation bitmap is named in the root directory
+    if (walkRootChain(buf, le32(&buf[96]), 0xFFFFFFFF) && dirRunCount > 0 &&
+        dev->readSector(dirRuns[0].first, buf)) {
+        findExFatBitmap(buf);
+    }
+    return true;
+}
+
+// Follows the root directory through the FAT into dirRuns
+bool FsTrace::walkRootChain(uint8_t *buf, uint32_t cluster, uint32_t entryMask) {
+    uint32_t loaded = UINT32_MAX;
+    for (uint32_t n = 0; n < TRACE_MAX_CHAIN; n++) {
+        if (cluster < 2 || cluster >= clusterCount + 2) break;    // End of chain (or junk)
+
+        const uint32_t first = dataStart + (cluster - 2) * clusterSectors;
+        if (dirRunCount > 0 && dirRuns[dirRunCount - 1].end == first) {
+            dirRuns[dirRunCount - 1].end += clusterSectors;
+        } else if (dirRunCount < TRACE_DIR_RUNS) {
+            dirRuns[dirRunCount++] = { first, first + clusterSectors };
+        } else {
+            break;
+        }
+
+        const uint32_t fatSector = fatStart + cluster / 128;
+        if (fatSector != loaded) {
+            if (!dev->readSector(fatSector, buf)) return false;
+            loaded = fatSector;
+        }
+        cluster = le32(&buf[(cluster % 128) * 4]) & entryMask;
+    }
+    return true;
+}
+
+void FsTrace::findExFatBitmap(const uint8_t *dirSector) {
+    for (int i = 0; i < 512; i += 32) {
+        const uint8_t *e = &dirSector[i];
+        if (e[0] == 0x00) return;                // End of directory
+        if (e[0] != 0x81) continue;              // Allocation bitmap entry
+
+        const uint32_t cluster = le32(&e[20]);
+        const uint32_t bytes = le32(&e[24]);     // High half is 0 for any SD card
+        if (cluster < 2 || cluster >= clusterCount + 2) return;
+        bitmap.first = dataStart + (cluster - 2) * clusterSectors;
+        bitmap.end = bitmap.first + (bytes + 511) / 512;
+        return;
+    }
+}
+
+TraceKind FsTrace::classify(uint32_t sector) const {
+    if (!known) return TRACE_DATA;
+    if (sector < fatStart) return TRACE_BOOT;
+    if (sector < fatEnd) return TRACE_FAT;
+    if (sector >= rootStart && sector < rootEnd) return TRACE_DIR;
+    if (sector < dataStart) return TRACE_BOOT;       // exFAT: gap before the cluster heap
+    if (sector >= bitmap.first && sector < bitmap.end) return TRACE_FAT;
+    for (int i = 0; i < dirRunCount; i++) {
+        if (sector >= dirRuns[i].first && sector < dirRuns[i].end) return TRACE_DIR;
+    }
+    return TRACE_DATA;
+}
+
+// ===============================
+// Counting
+// ===============================
+
+void FsTrace::reset() {
+    memset(&c, 0, sizeof(c));
+}
+
+bool FsTrace::isCache(const uint8_t *buf) const {
+    for (int i = 0; i < TRACE_CACHES; i++) {
+        if (caches[i] && caches[i] == buf) return true;
+    }
+    return false;
+}
+
+// SdFat reads metadata only through its caches
+void FsTrace::learnCache(TraceKind kind, const uint8_t *buf) {
+    if (kind == TRACE_DATA || isCache(buf)) return;
+    for (int i = 0; i < TRACE_CACHES; i++) {
+        if (!caches[i]) {
+            caches[i] = buf;
+            return;
+        }
+    }
+}
+
+bool FsTrace::readSector(uint32_t sector, uint8_t *dst) {
+    return readSectors(sector, dst, 1);
+}
+
+bool FsTrace::readSectors(uint32_t sector, uint8_t *dst, size_t ns) {
+    const TraceKind kind = classify(sector);
+    const uint32_t t0 = micros();
+    const bool ok = ns == 1 ? dev->readSector(sector, dst) : dev->readSectors(sector, dst, ns);
+    c.us[kind] += micros() - t0;
+
+    c.readSectors[kind] += ns;
+    learnCache(kind, dst);
+    if (isCache(dst)) c.cacheMisses += ns;
+    return ok;
+}
+
+bool FsTrace::writeSector(uint32_t sector, const uint8_t *src) {
+    return writeSectors(sector, src, 1);
+}
+
+bool FsTrace::writeSectors(uint32_t sector, const uint8_t *src, size_t ns) {
+    const TraceKind kind = classify(sector);
+    const uint32_t t0 = micros();
+    const bool ok = ns == 1 ? dev->writeSector(sector, src) : dev->writeSectors(sector, src, ns);
+    c.us[kind] += micros() - t0;
+
+    c.writeSectors[kind] += ns;
+    c.writeOps[kind]++;
+    if (isCache(src)) c.cacheFlushes += ns;
+    return ok;
+}
+
+const char* FsTrace::kindName(TraceKind kind) {
+    static const char* names[TRACE_KINDS] = { "boot", "fat", "dir", "data" };
+    return kind < TRACE_KINDS ? names[kind] : "?";
+}
@@ -0,0 +1,106 @@
+/**
+ * FS Trace
+ * A block device that sits between SdFat and the card and sorts
+ * every sector transfer by what it touched: boot / reserved, FAT
+ * (or the exFAT allocation bitmap), directory, or file data. A slow
+ * write can then be split into our data and SdFat's own metadata
+ * traffic, and the time each took.
+ *
+ * Transfers in or out of one of SdFat's sector caches are counted
+ * separately: a read into a cache is a cache miss, a write from one
+ * a flush. The cache buffers are recognised as the ones metadata
+ * sectors are read into, which only ever happens through a cache.
+ *
+ * Directory sectors are the FAT12/16 root directory, or the root
+ * directory's cluster chain as it was when the tracer was attached
+ * (the tests only use the root). Needs USE_BLOCK_DEVICE_INTERFACE=1
+ * (platformio.ini) so that SdFat reaches its card through a
+ * FsBlockDeviceInterface that can be wrapped.
+ */
+
+#pragma once
+
+#include <SdFat.h>
+
+#if !USE_BLOCK_DEVICE_INTERFACE
+#error "fs_trace.h needs -DUSE_BLOCK_DEVICE_INTERFACE=1"
+#endif
+
+enum TraceKind : uint8_t {
+    TRACE_BOOT = 0,              // MBR, boot sector, FSInfo, reserved
+    TRACE_FAT,                   // FAT copies, exFAT allocation bitmap
+    TRACE_DIR,
+    TRACE_DATA,
+    TRACE_KINDS
+};
+
+constexpr int TRACE_DIR_RUNS = 8;        // Root directory fragments tracked
+constexpr int TRACE_CACHES = 2;          // Sector cache + separate FAT cache
+
+struct TraceCounts {
+    uint32_t readSectors[TRACE_KINDS];
+    uint32_t writeSectors[TRACE_KINDS];
+    uint32_t writeOps[TRACE_KINDS];      // writeSector(s) calls: a dir update is one
+    uint32_t us[TRACE_KINDS];            // Time in the card, reads + writes
+    uint32_t cacheMisses;                // Sectors read into an SdFat cache
+    uint32_t cacheFlushes;               // Sectors written back from one
+};
+
+class FsTrace : public FsBlockDeviceInterface {
+public:
+    // Reads the layout of the volume on `dev` (first partition) and
+    // forwards to it from now on. False if it is not FAT or exFAT;
+    // transfers are then forwarded but all count as data.
+    bool attach(FsBlockDevice *dev);
+
+    // Zero the counts (the layout and known caches stay)
+    void reset();
+
+    const TraceCounts& counts() const { return c; }
+    bool layoutKnown() const { return known; }
+    static const char* kindName(TraceKind kind);
+
+    // --- FsBlockDeviceInterface ---
+    void end() override { dev->end(); }
+    bool isBusy() override { return dev->isBusy(); }
+    uint32_t sectorCount() override { return dev->sectorCount(); }
+    bool syncDevice() override { return dev->syncDevice(); }
+    bool hasDedicatedSpi() override { return dev->hasDedicatedSpi(); }
+    bool isDedicatedSpi() override { return dev->isDedicatedSpi(); }
+    bool setDedicatedSpi(bool value) override { return dev->setDedicatedSpi(value); }
+
+    bool readSector(uint32_t sector, uint8_t *dst) override;
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t ns) override;
+    bool writeSector(uint32_t sector, const uint8_t *src) override;
+    bool writeSectors(uint32_t sector, const uint8_t *src, size_t ns) override;
+
+private:
+    struct Run {
+        uint32_t first;
+        uint32_t end;            // Exclusive
+    };
+
+    TraceKind classify(uint32_t sector) const;
+    bool isCache(const uint8_t *buf) const;
+    void learnCache(TraceKind kind, const uint8_t *buf);
+    bool walkRootChain(uint8_t *buf, uint32_t rootCluster, uint32_t entryMask);
+    void findExFatBitmap(const uint8_t *dirSector);
+
+    FsBlockDevice *dev = nullptr;
+    TraceCounts c = {};
+    bool known = false;
+
+    uint32_t fatStart = 0;
+    uint32_t fatEnd = 0;         // Exclusive, all copies
+    uint32_t rootStart = 0;      // FAT12/16 fixed root directory
+    uint32_t rootEnd = 0;
+    uint32_t dataStart = 0;      // First sector of cluster 2
+    uint32_t clusterSectors = 0;
+    uint32_t clusterCount = 0;
+
+    Run dirRuns[TRACE_DIR_RUNS];
+    int dirRunCount = 0;
+    Run bitmap = {0, 0};         // exFAT allocation bitmap
+
+    const uint8_t *caches[TRACE_CACHES] = {};
+};
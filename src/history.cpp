@@ -0,0 +1,115 @@
+/**
+ * Results History — LittleFS ring
+ * The file is HISTORY_SLOTS fixed records. There is no header:
+ * the slot after the highest seq is the next one to overwrite,
+ * so an append is a single 32-byte write and a reset mid-write
+ * costs at most that one record.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "history.h"
+
+static const char* HISTORY_PATH = "/history.bin";
+
+static bool historyReady = false;
+static uint32_t nextSlot = 0;
+static uint32_t nextSeq = 1;
+
+static bool createHistoryFile() {
+    File f = LittleFS.open(HISTORY_PATH, "w");
+    if (!f) return false;
+
+    HistoryRecord empty;
+    memset(&empty, 0, sizeof(empty));
+    for (int i = 0; i < HISTORY_SLOTS; i++) {
+        if (f.write((const uint8_t *)&empty, sizeof(empty)) != sizeof(empty)) {
+            f.close();
+            return false;
+        }
+    }
+    f.close();
+    return true;
+}
+
+bool historyBegin() {
+    historyReady = false;
+
+    // Format on first use — the partition is ours alone
+    if (!LittleFS.begin(true)) return false;
+
+    File f = LittleFS.open(HISTORY_PATH, "r");
+    if (!f || f.size() != HISTORY_SLOTS * sizeof(HistoryRecord)) {
+        if (f) f.close();
+        if (!createHistoryFile()) return false;
+        f = LittleFS.open(HISTORY_PATH, "r");
+        if (!f) return false;
+    }
+
+    // Head = slot after the newest record
+    uint32_t maxSeq = 0;
+    uint32_t maxSlot = HISTORY_SLOTS - 1;
+    HistoryRecord r;
+
+    for (uint32_t i = 0; i < HISTORY_SLOTS; i++) {
+        if (f.read((uint8_t *)&r, sizeof(r)) != sizeof(r)) break;
+        if (r.seq > maxSeq) {
+            maxSeq = r.seq;
+            maxSlot = i;
+        }
+    }
+    f.close();
+
+    nextSeq = maxSeq + 1;
+    nextSlot = (maxSlot + 1) % HISTORY_SLOTS;
+    historyReady = true;
+    return true;
+}
+
+bool historyAppend(HistoryRecord &rec) {
+    if (!historyReady) return false;
+
+    File f = LittleFS.open(HISTORY_PATH, "r+");
+    if (!f) return false;
+
+    rec.seq = nextSeq;
+    bool ok = f.seek(nextSlot * sizeof(HistoryRecord)) &&
+              f.write((const uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+    f.close();
+
+    if (ok) {
+        nextSeq++;
+        nextSlot = (nextSlot + 1) % HISTORY_SLOTS;
+    }
+    return ok;
+}
+
+int historyLoad(uint8_t mid, uint32_t psn, uint8_t test,
+                HistoryRecord *out, int max) {
+    if (!historyReady || max <= 0) return 0;
+
+    File f = LittleFS.open(HISTORY_PATH, "r");
+    if (!f) return 0;
+
+    // Slots from the head onwards are already in age order; keep
+    // a sliding window of the newest `max` matches
+    int n = 0;
+    HistoryRecord r;
+
+    for (uint32_t i = 0; i < HISTORY_SLOTS; i++) {
+        uint32_t slot = (nextSlot + i) % HISTORY_SLOTS;
+        if (i == 0 || slot == 0) f.seek(slot * sizeof(HistoryRecord));
+        if (f.read((uint8_t *)&r, sizeof(r)) != sizeof(r)) break;
+
+        if (r.seq == 0 || r.mid != mid || r.psn != psn || r.test != test) continue;
+
+        if (n == max) {
+            memmove(out, out + 1, (max - 1) * sizeof(HistoryRecord));
+            n--;
+        }
+        out[n++] = r;
+    }
+    f.close();
+    return n;
+}
@@ -0,0 +1,45 @@
+/**
+ * Results History
+ * Fixed-size binary records in a ring on LittleFS, keyed by the
+ * card's CID serial, so a card can be compared with itself over
+ * its lifetime ("used to write 18 MB/s, now 9").
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Ring capacity across all cards (32 bytes each → 8KB file)
+constexpr int HISTORY_SLOTS = 256;
+
+enum HistoryTest : uint8_t {
+    HIST_SPEED     = 1,
+    HIST_INTEGRITY = 2,
+    HIST_SOAK      = 3           // Last cycle's speeds, total bad sectors
+};
+
+struct HistoryRecord {
+    uint32_t seq;                // Monotonic, 0 = empty slot
+    uint32_t psn;                // CID product serial number
+    uint8_t  mid;                // CID manufacturer ID
+    uint8_t  test;               // HistoryTest
+    uint8_t  reserved[2];
+    uint32_t sizeMB;             // Amount of data the test moved (a fill run: whole card)
+    uint32_t writeKBs;           // KB/s
+    uint32_t readKBs;            // KB/s
+    uint32_t maxLatencyUs;       // Worst single write call
+    uint32_t errors;
+};
+
+static_assert(sizeof(HistoryRecord) == 32, "HistoryRecord is an on-flash format");
+
+// Mount LittleFS (formatting it on first use) and find the ring head
+bool historyBegin();
+
+// Store a record; seq is assigned here
+bool historyAppend(HistoryRecord &rec);
+
+// Most recent `max` records for one card and test, oldest first.
+// Returns the number copied into `out`.
+int historyLoad(uint8_t mid, uint32_t psn, uint8_t test,
+                HistoryRecord *out, int max);
@@ -0,0 +1,106 @@
+/**
+ * Keyboard Input — scan task and key queue
+ * The task runs on core 0, away from loop() on core 1, so the
+ * scan does not take time from a running test either.
+ */
+
+#include <M5Cardputer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include "input.h"
+
+static const int INPUT_QUEUE_LEN = 16;
+
+// ENTER, BKSP, then these; one bit each in the scan masks
+static const char SCAN_KEYS[] = ";.abcdefghijklmnopqrstuvwxyz";
+static const int KEY_COUNT = 2 + sizeof(SCAN_KEYS) - 1;
+static const uint32_t BACK_BIT = 1UL << 1;
+static const uint32_t NAV_BITS = (1UL << 2) | (1UL << 3);      // ';' and '.'
+
+static_assert(KEY_COUNT <= 32, "scan masks are 32 bits");
+
+static QueueHandle_t keyQueue = nullptr;
+static volatile bool abortFlag = false;
+
+static bool keyDown(int i) {
+    if (i == 0) return M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER);
+    if (i == 1) return M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE);
+    return M5Cardputer.Keyboard.isKeyPressed(SCAN_KEYS[i - 2]);
+}
+
+static char keyCode(int i) {
+    if (i == 0) return INPUT_ENTER;
+    if (i == 1) return INPUT_BACK;
+    return SCAN_KEYS[i - 2];
+}
+
+static void sendKeys(uint32_t bits) {
+    for (int i = 0; i < KEY_COUNT; i++) {
+        if (!(bits & (1UL << i))) continue;
+        char c = keyCode(i);
+        xQueueSend(keyQueue, &c, 0);         // Full: the UI is busy, drop it
+    }
+}
+
+static void inputTask(void *) {
+    TickType_t wake = xTaskGetTickCount();
+    uint32_t held = 0;
+    uint32_t repeatAt = 0;
+
+    while (true) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(INPUT_SCAN_MS));
+        M5Cardputer.update();
+
+        // Only walk the keys when the matrix changed
+        uint32_t down = held;
+        if (M5Cardputer.Keyboard.isChange()) {
+            down = 0;
+            for (int i = 0; i < KEY_COUNT; i++) {
+                if (keyDown(i)) down |= 1UL << i;
+            }
+        }
+
+        const uint32_t now = millis();
+        const uint32_t pressed = down & ~held;
+        if (pressed & BACK_BIT) abortFlag = true;
+        sendKeys(pressed);
+
+        // Scrolling keys repeat while held
+        if (pressed & NAV_BITS) {
+            repeatAt = now + INPUT_REPEAT_DELAY_MS;
+        } else if ((down & held & NAV_BITS) && (int32_t)(now - repeatAt) >= 0) {
+            sendKeys(down & NAV_BITS);
+            repeatAt = now + INPUT_REPEAT_MS;
+        }
+        held = down;
+    }
+}
+
+void inputBegin() {
+    if (keyQueue) return;
+    keyQueue = xQueueCreate(INPUT_QUEUE_LEN, sizeof(char));
+    xTaskCreatePinnedToCore(inputTask, "input", 3072, nullptr, 1, nullptr, 0);
+}
+
+char inputGetKey(uint32_t waitMs) {
+    TickType_t ticks = waitMs == INPUT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(waitMs);
+    char c;
+    if (xQueueReceive(keyQueue, &c, ticks) != pdTRUE) return 0;
+
+    // A BKSP taken as a key press is not also an abort
+    if (c == INPUT_BACK) abortFlag = false;
+    return c;
+}
+
+bool inputAbort() {
+    if (!abortFlag) return false;
+    abortFlag = false;
+    return true;
+}
+
+void inputFlush() {
+    xQueueReset(keyQueue);
+    abortFlag = false;
+}
@@ -0,0 +1,35 @@
+/**
+ * Keyboard Input
+ * The keyboard is scanned by its own task on a fixed timer. Key
+ * presses land in a queue and BKSP also raises an abort flag, so
+ * screens block on the queue instead of spinning on delay(), and
+ * test loops only read a flag: no keyboard scan ever runs inside
+ * an I/O loop. The scan task is the only caller of
+ * M5Cardputer.update().
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// Keys without a character of their own
+constexpr char INPUT_ENTER = '\n';
+constexpr char INPUT_BACK  = '\b';
+
+constexpr uint32_t INPUT_FOREVER = 0xFFFFFFFF;
+
+constexpr uint32_t INPUT_SCAN_MS         = 10;
+constexpr uint32_t INPUT_REPEAT_DELAY_MS = 400;    // Held ';' / '.' start repeating
+constexpr uint32_t INPUT_REPEAT_MS       = 120;
+
+// Start the scan task (after M5Cardputer.begin())
+void inputBegin();
+
+// Next key press; 0 if none arrives within waitMs
+char inputGetKey(uint32_t waitMs = INPUT_FOREVER);
+
+// True once per BKSP press during a test. Just a flag read.
+bool inputAbort();
+
+// Forget queued presses and a pending abort
+void inputFlush();
@@ -0,0 +1,116 @@
+/**
+ * I/O Buffer Arena — bump allocator with scoped release
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#endif
+
+#include "io_arena.h"
+
+static uint8_t *arena = nullptr;
+static size_t arenaBytes = 0;
+static size_t used = 0;
+static size_t peak = 0;
+static bool inPsram = false;
+
+static ArenaModeStats modes[ARENA_MAX_MODES];
+static int modeCount = 0;
+static int currentMode = -1;
+static size_t currentMark = 0;           // `used` when the current mode's scope opened
+
+bool arenaBegin() {
+    if (arena) return true;
+
+#ifndef ARDUINO
+    // Native tests: the PSRAM-sized arena from the host heap
+    arena = (uint8_t *)aligned_alloc(ARENA_ALIGN, ARENA_PSRAM_BYTES);
+    if (!arena) return false;
+    arenaBytes = ARENA_PSRAM_BYTES;
+    return true;
+#else
+    if (psramFound()) {
+        arena = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, ARENA_PSRAM_BYTES,
+                                                   MALLOC_CAP_SPIRAM);
+        if (arena) {
+            arenaBytes = ARENA_PSRAM_BYTES;
+            inPsram = true;
+            return true;
+        }
+    }
+
+    // Internal RAM: as much as fits under the cap, leaving the reserve
+    const uint32_t caps = MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL;
+    size_t freeBytes = heap_caps_get_free_size(caps);
+    size_t want = heap_caps_get_largest_free_block(caps);
+    if (want > ARENA_INTERNAL_MAX) want = ARENA_INTERNAL_MAX;
+    if (freeBytes < ARENA_HEAP_RESERVE) want = 0;
+    else if (want > freeBytes - ARENA_HEAP_RESERVE) want = freeBytes - ARENA_HEAP_RESERVE;
+
+    // The block size is a guess at what fits once aligned — shrink until it does
+    for (want &= ~(size_t)4095; want >= ARENA_INTERNAL_MIN; want -= 4096) {
+        arena = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, want, caps);
+        if (arena) {
+            arenaBytes = want;
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
+uint8_t* arenaAlloc(size_t bytes) {
+    const size_t size = (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (!arena || size > arenaBytes - used) return nullptr;
+
+    uint8_t *p = arena + used;
+    used += size;
+    if (used > peak) peak = used;
+    if (currentMode >= 0 && used - currentMark > modes[currentMode].peakBytes) {
+        modes[currentMode].peakBytes = used - currentMark;
+    }
+    return p;
+}
+
+size_t arenaSize()    { return arenaBytes; }
+size_t arenaFree()    { return arenaBytes - used; }
+size_t arenaPeak()    { return peak; }
+bool   arenaInPsram() { return inPsram; }
+
+int arenaModes(const ArenaModeStats *&list) {
+    list = modes;
+    return modeCount;
+}
+
+// ===============================
+// Scopes
+// ===============================
+
+static int findMode(const char *name) {
+    for (int i = 0; i < modeCount; i++) {
+        if (strcmp(modes[i].name, name) == 0) return i;
+    }
+    if (modeCount == ARENA_MAX_MODES) return -1;     // Still works, just not reported
+
+    modes[modeCount].name = name;
+    modes[modeCount].peakBytes = 0;
+    modes[modeCount].uses = 0;
+    return modeCount++;
+}
+
+ArenaScope::ArenaScope(const char *mode)
+    : mark(used), outerMode(currentMode), outerMark(currentMark) {
+    currentMode = findMode(mode);
+    currentMark = used;
+    if (currentMode >= 0) modes[currentMode].uses++;
+}
+
+ArenaScope::~ArenaScope() {
+    used = mark;
+    currentMode = outerMode;
+    currentMark = outerMark;
+}
@@ -0,0 +1,64 @@
+/**
+ * I/O Buffer Arena
+ * One aligned block, claimed at startup, that every engine borrows
+ * its transfer buffers from instead of keeping a static array or
+ * calling malloc() per test. It lives in PSRAM when the module has
+ * some, else in DMA-capable internal RAM, so the largest transfer
+ * a mode can use is set by the memory there is rather than by a
+ * constant in each file. (The SPI driver moves sector data through
+ * its own internal bounce buffers, so PSRAM is fine for it.)
+ *
+ * Borrowing is a stack: an ArenaScope gives back everything taken
+ * while it was open. Each scope names a mode, and the arena keeps
+ * the most that mode ever held for the memory report. The native
+ * test build takes ARENA_PSRAM_BYTES from the host heap instead.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr size_t ARENA_ALIGN = 64;                       // Cache line
+
+constexpr size_t ARENA_PSRAM_BYTES    = 1024 * 1024;
+constexpr size_t ARENA_INTERNAL_MAX   = 160 * 1024;
+constexpr size_t ARENA_INTERNAL_MIN   = 48 * 1024;
+constexpr size_t ARENA_HEAP_RESERVE   = 64 * 1024;      // Left for SdFat, LittleFS, the display
+
+constexpr int ARENA_MAX_MODES = 16;
+
+struct ArenaModeStats {
+    const char *name;
+    size_t   peakBytes;          // Most held at once
+    uint32_t uses;               // Scopes opened
+};
+
+// Claim the arena (setup(), before any test runs)
+bool arenaBegin();
+
+// ARENA_ALIGN-aligned, nullptr if it does not fit. Only valid
+// while the enclosing ArenaScope is open.
+uint8_t* arenaAlloc(size_t bytes);
+
+size_t arenaSize();
+size_t arenaFree();
+size_t arenaPeak();              // Across all modes
+bool   arenaInPsram();
+
+// Modes seen so far, in first-use order
+int arenaModes(const ArenaModeStats *&modes);
+
+class ArenaScope {
+public:
+    explicit ArenaScope(const char *mode);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    size_t mark;
+    int    outerMode;
+    size_t outerMark;
+};
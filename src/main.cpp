@@ -1,12 +1,35 @@
 /**
  * M5Stack Cardputer ADV - SD Card Tool
- * Features: CID Info, Speed Test, Integrity Check, Quick Format
+ * Features: Card Triage, Speed Test, Integrity Check, Capacity Probe,
+ *           Soak Test, Flash Geometry, Quick Format, Secure Erase,
+ *           USB Image backup/restore, FAT Analyzer, Results History,
+ *           Simulated-card self-test, serial command protocol
  */
 
 #include <M5Unified.h>
 #include <M5Cardputer.h>
 #include <SdFat.h>
 #include <FatLib/FatFormatter.h>
+#include <ExFatLib/ExFatFormatter.h>
+
+#include "fat_layout.h"
+#include "fat_analyzer.h"
+#include "history.h"
+#include "checkpoint.h"
+#include "sd_spi_dma.h"
+#include "soak.h"
+#include "capacity_probe.h"
+#include "sim_selftest.h"
+#include "sd_card_device.h"
+#include "flash_geometry.h"
+#include "triage.h"
+#include "secure_erase.h"
+#include "card_image.h"
+#include "serial_cmd.h"
+#include "input.h"
+#include "io_arena.h"
+#include "multi_stream.h"
+#include "fs_trace.h"
 
 // --- SD SPI Pins for Cardputer ADV ---
 #define SD_SCK_PIN   40
@@ -16,43 +39,84 @@ static const int SD_CS_PIN = 12;
 
 #define SPI_CLOCK SD_SCK_MHZ(20)
 
+// --- Build variant (the sdfat-* environments in platformio.ini) ---
+// Reported by the bench command, so results from different builds
+// of the same card can be told apart.
+#ifndef SDTOOL_BUILD
+#define SDTOOL_BUILD "default"
+#endif
+
+// SdFat keeps the bus between commands when the card has it to itself
+#if SDTOOL_DEDICATED_SPI
+#define SD_SPI_OPTION DEDICATED_SPI
+#else
+#define SD_SPI_OPTION SHARED_SPI
+#endif
+
+// Shared by every mount so a remount reuses the same bus setup
+#define SD_CONFIG SdSpiConfig(SD_CS_PIN, SD_SPI_OPTION, SPI_CLOCK, &sdDriver)
+
 SdFat sd;
 SPIClass sdSpi(HSPI);
 
+// SdFat user SPI driver (SPI_DRIVER_SELECT=3) — DMA by default,
+// Arduino SPIClass path kept for comparison
+SdSpiDmaDriver sdDriver(sdSpi, SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
+
+// Between SdFat and the card during the file-level tests (initSDTraced)
+FsTrace fsTrace;
+
 // --- Key helpers ---
 inline bool isUp(char k)    { return k == ';'; }
 inline bool isDown(char k)  { return k == '.'; }
 
-char pollKey() {
-    const char keys[] = { ';', '.', 0 };
-    for (int i = 0; keys[i]; i++) {
-        if (M5Cardputer.Keyboard.isKeyPressed(keys[i])) {
-            return keys[i];
-        }
-    }
-    return 0;
-}
-
-enum State { MENU, INFO, SPEED, H2TEST, FORMAT };
+enum State { MENU, INFO, SPEED, H2TEST, PROBE, SOAK, GEOMETRY, FORMAT, ERASE, IMAGE, ANALYZE, HISTORY, SIMTEST, MEMORY };
 State currentState = MENU;
 
 int menuIndex = 0;
+int menuTop = 0;
 const char* menuItems[] = {
-    " 1. Card Info",
+    " 1. Card Triage",
     " 2. Speed Test",
     " 3. Integrity Check",
-    " 4. Format (Quick) WIP",
-    " 5. Reboot"
+    " 4. Capacity Probe",
+    " 5. Soak Test",
+    " 6. Flash Geometry",
+    " 7. Format (Quick) WIP",
+    " 8. Secure Erase",
+    " 9. USB Image",
+    " 10. FAT Analyzer",
+    " 11. History",
+    " 12. Sim Self-Test",
+    " 13. Memory",
+    " 14. Reboot"
 };
+const int MENU_COUNT = sizeof(menuItems) / sizeof(menuItems[0]);
+const int MENU_ROWS  = 6;   // Rows that fit under the header
 
 // --- Forward declarations ---
 void drawMenu();
 void showCardInfo();
 void runSpeedTest();
 void runIntegrityCheck();
+void offerResume();
+void runCapacityProbe();
+void runSoakTest();
+void runGeometryProbe();
+void runSimSelfTest();
 void runFormat();
+void runSecureErase();
+void runUsbImage();
+void runAnalyzer();
+void showHistory();
+void showMemory();
 void waitForInput();
+bool waitForEnter();
+bool abortPressed();
 bool initSD();
+bool initSDTraced();
+bool initCard();
+void runSerialCommand(char *line);
 
 // ------------------------------------------------------------
 // NEW: Require SD card removal at startup
@@ -60,7 +124,7 @@ bool initSD();
 void requireCardRemovedAtStartup() {
     // Try a non-blocking check first
     bool cardPresent = sd.cardBegin(
-    SdSpiConfig(SD_CS_PIN, DEDICATED_SPI, SD_SCK_MHZ(20), &sdSpi)
+    SdSpiConfig(SD_CS_PIN, DEDICATED_SPI, SD_SCK_MHZ(20), &sdDriver)
 );
 
     if (!cardPresent) {
@@ -81,10 +145,9 @@ void requireCardRemovedAtStartup() {
 
     // Wait until card is removed
     while (true) {
-        M5Cardputer.update();
         delay(200);
 
-        if (!sd.cardBegin(SdSpiConfig(SD_CS_PIN, SHARED_SPI, SPI_CLOCK, &sdSpi))) {
+        if (!sd.cardBegin(SD_CONFIG)) {
             break;
         }
     }
@@ -101,57 +164,77 @@ void requireCardRemovedAtStartup() {
 
 void setup() {
     M5Cardputer.begin();
+    inputBegin();
+
+    // Transfer buffers for every test, claimed before anything else
+    // can fragment the heap
+    arenaBegin();
     M5.Display.setRotation(1);
     M5.Display.setTextSize(1.5);
     M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
 
     sdSpi.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
 
+    // USB CDC for card images: room for a burst of a 64KB record,
+    // and a host that pauses to write its file doesn't cut a backup
+    Serial.setRxBufferSize(4096);
+    Serial.begin(115200);
+    Serial.setTxTimeoutMs(2000);
+
+    // Results history on internal flash — tests still run without it
+    historyBegin();
+
     // NEW: Safety check before showing menu
     requireCardRemovedAtStartup();
 
+    // Pick up a long test cut short by reset / power loss
+    offerResume();
+
     drawMenu();
 }
 
 void loop() {
-    M5Cardputer.update();
-    char key = pollKey();
+    // Sleeps until a key press, waking often enough to serve the host
+    char key = inputGetKey(20);
+
+    // Host commands (serial_cmd.h) are taken while the menu is up
+    static char hostLine[CMD_MAX_LINE];
+    static size_t hostLen = 0;
+    if (currentState == MENU && cmdPoll(Serial, hostLine, sizeof(hostLine), hostLen)) {
+        runSerialCommand(hostLine);
+        return;
+    }
 
     if (currentState == MENU) {
 
         if (isUp(key)) {
-            menuIndex = (menuIndex + 4) % 5;
+            menuIndex = (menuIndex + MENU_COUNT - 1) % MENU_COUNT;
             drawMenu();
-            delay(150);
         }
 
         if (isDown(key)) {
-            menuIndex = (menuIndex + 1) % 5;
+            menuIndex = (menuIndex + 1) % MENU_COUNT;
             drawMenu();
-            delay(150);
         }
 
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER)) {
-            while (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER)) {
-                M5Cardputer.update();
-                delay(10);
-            }
-
+        if (key == INPUT_ENTER) {
             switch (menuIndex) {
                 case 0: currentState = INFO;   showCardInfo();      break;
                 case 1: currentState = SPEED;  runSpeedTest();      break;
                 case 2: currentState = H2TEST; runIntegrityCheck(); break;
-                case 3: currentState = FORMAT; runFormat();         break;
-                case 4: ESP.restart();                              break;
+                case 3: currentState = PROBE;  runCapacityProbe();  break;
+                case 4: currentState = SOAK;   runSoakTest();       break;
+                case 5: currentState = GEOMETRY; runGeometryProbe(); break;
+                case 6: currentState = FORMAT; runFormat();         break;
+                case 7: currentState = ERASE;  runSecureErase();    break;
+                case 8: currentState = IMAGE;  runUsbImage();       break;
+                case 9: currentState = ANALYZE; runAnalyzer();      break;
+                case 10: currentState = HISTORY; showHistory();     break;
+                case 11: currentState = SIMTEST; runSimSelfTest();  break;
+                case 12: currentState = MEMORY; showMemory();       break;
+                case 13: ESP.restart();                             break;
             }
         }
-
-    } else if (currentState == MENU &&
-           M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-
-        currentState = MENU;
-        drawMenu();
-        delay(150);
     }
 }
 
@@ -164,7 +247,11 @@ void drawMenu() {
     M5.Display.println(" ENTER: select/back");
     M5.Display.println(" BKSP: abort\n");
 
-    for (int i = 0; i < 5; i++) {
+    // Keep the selection inside the visible window
+    if (menuIndex < menuTop) menuTop = menuIndex;
+    if (menuIndex >= menuTop + MENU_ROWS) menuTop = menuIndex - MENU_ROWS + 1;
+
+    for (int i = menuTop; i < MENU_COUNT && i < menuTop + MENU_ROWS; i++) {
         bool sel = (i == menuIndex);
         M5.Display.setTextColor(sel ? TFT_BLACK : TFT_GREEN,
                                 sel ? TFT_WHITE : TFT_BLACK);
@@ -177,14 +264,40 @@ void drawMenu() {
 // --- SD Init ---
 
 bool initSD() {
-    SdSpiConfig cfg(
-        SD_CS_PIN,
-        SHARED_SPI,          // Cardputer uses shared SPI bus
-        SD_SCK_MHZ(20),      // Safe speed for ADV
-        &sdSpi
-    );
+    // Cardputer uses shared SPI bus, 20MHz is a safe speed for ADV
+    if (!sd.begin(SD_CONFIG)) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("SD Init Failed!");
+        return false;
+    }
+    return true;
+}
+
+// Mounted as initSD() does, but with the volume on fsTrace so the
+// test's sector transfers are sorted into data and metadata. Counts
+// start from zero here; a later plain mount goes straight to the card.
+bool initSDTraced() {
+    if (!initSD()) return false;
+    fsTrace.attach(sd.card());
+    if (!sd.vol()->begin(&fsTrace)) return initSD();
+    fsTrace.reset();
+    return true;
+}
 
-    if (!sd.begin(cfg)) {
+// Two lines: where the last traced test's writes went
+static void showTrace() {
+    if (!fsTrace.layoutKnown()) return;
+    const TraceCounts &c = fsTrace.counts();
+    M5.Display.printf(" wr data %lu FAT %lu\n", (unsigned long)c.writeSectors[TRACE_DATA],
+                      (unsigned long)c.writeSectors[TRACE_FAT]);
+    M5.Display.printf(" dir upd %lu miss %lu fl %lu\n", (unsigned long)c.writeOps[TRACE_DIR],
+                      (unsigned long)c.cacheMisses, (unsigned long)c.cacheFlushes);
+}
+
+// Card only — for tools that read raw sectors and must work
+// whatever (if any) filesystem is on the card
+bool initCard() {
+    if (!sd.cardBegin(SD_CONFIG)) {
         M5.Display.setTextColor(TFT_RED, TFT_BLACK);
         M5.Display.println("SD Init Failed!");
         return false;
@@ -192,240 +305,685 @@ bool initSD() {
     return true;
 }
 
-// --- Card Info ---
+// --- CID serial (PSN), independent of SdFat's cid_t layout ---
+static uint32_t cidSerial(const cid_t &cid) {
+    static_assert(sizeof(cid_t) == 16, "cid_t is the raw CID register");
+    const uint8_t *raw = reinterpret_cast<const uint8_t *>(&cid);
+    return ((uint32_t)raw[9] << 24) | ((uint32_t)raw[10] << 16) |
+           ((uint32_t)raw[11] << 8) | raw[12];
+}
+
+// --- Decoded CSD / SD Status of the inserted card ---
+static bool readCsdInfo(SdCard *card, CsdInfo &info) {
+    static_assert(sizeof(csd_t) == 16, "csd_t is the raw CSD register");
+    csd_t csd;
+    if (!card->readCSD(&csd)) return false;
+    decodeCsd(reinterpret_cast<const uint8_t *>(&csd), info);
+    return true;
+}
+
+static bool readSdStatusInfo(SdCard *card, SdStatusInfo &info) {
+    static_assert(sizeof(sds_t) == 64, "sds_t is the raw SD Status register");
+    sds_t sds;
+    if (!card->readSDS(&sds)) return false;
+    decodeSdStatus(reinterpret_cast<const uint8_t *>(&sds), info);
+    return true;
+}
+
+// "FAT32" / "exFAT" / ... from SdFat's fatType()
+static const char* fsTypeName(uint8_t type) {
+    switch (type) {
+        case FAT_TYPE_EXFAT: return "exFAT";
+        case 32:             return "FAT32";
+        case 16:             return "FAT16";
+        case 12:             return "FAT12";
+    }
+    return "No FS";
+}
+
+// Sectors as "16K" / "4M"
+static void printBlockSize(const char *fmt, uint32_t sectors) {
+    char size[8];
+    if (sectors >= 2048) sprintf(size, "%luM", (unsigned long)(sectors / 2048));
+    else                 sprintf(size, "%luK", (unsigned long)(sectors / 2));
+    M5.Display.printf(fmt, size);
+}
+
+// --- Store a finished test in the per-card history ---
+static void recordHistory(uint8_t test, uint32_t sizeMB,
+                          uint32_t writeKBs, uint32_t readKBs,
+                          uint32_t maxLatencyUs, uint32_t errors) {
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) return;
+
+    HistoryRecord r;
+    memset(&r, 0, sizeof(r));
+    r.mid          = cid.mid;
+    r.psn          = cidSerial(cid);
+    r.test         = test;
+    r.sizeMB       = sizeMB;
+    r.writeKBs     = writeKBs;
+    r.readKBs      = readKBs;
+    r.maxLatencyUs = maxLatencyUs;
+    r.errors       = errors;
+    historyAppend(r);
+}
+
+// --- Card Triage ---
+// Decoded CID / CSD / SD Status, a ~1s raw benchmark, a short
+// capacity probe and a PASS / SUSPECT verdict. Card-level only,
+// no mount needed.
+
+// False if the CID can't be read
+static bool gatherTriage(SdCard *card, TriageReport &r) {
+    memset(&r, 0, sizeof(r));
+
+    cid_t cid;
+    if (!card->readCID(&cid)) return false;
+    decodeCid(reinterpret_cast<const uint8_t *>(&cid), r.cid);
+
+    r.haveCsd = readCsdInfo(card, r.csd);
+    r.haveSds = readSdStatusInfo(card, r.sds);
+
+    r.maker = findMaker(r.cid.mid);
+    r.reportedSectors = card->sectorCount();
+
+    SdCardDevice dev(card);
+    triageBench(&dev, r.bench);
+    r.probeResult = probeCapacity(&dev, TRIAGE_PROBES, r.cid.psn, r.probe, nullptr);
+    triageVerdict(r);
+    return true;
+}
 
 void showCardInfo() {
     M5.Display.fillScreen(TFT_BLACK);
     M5.Display.setCursor(0, 0);
 
-    if (!initSD()) { 
-        waitForInput(); 
-        return; 
+    if (!initCard()) {
+        waitForInput();
+        return;
     }
 
-    
-    cid_t cid;
-    if (!sd.card()->readCID(&cid)) {
+    static TriageReport r;
+    M5.Display.println(" Benchmarking...");
+    if (!gatherTriage(sd.card(), r)) {
         M5.Display.setTextColor(TFT_RED, TFT_BLACK);
         M5.Display.println("Read CID Failed");
         waitForInput();
         return;
     }
 
-    const char* maker = "Unknown";
-    switch (cid.mid) {
-        case 0x03: maker = "SanDisk";        break;
-        case 0x1B: maker = "Samsung";        break;
-        case 0x1D: maker = "Kingston";       break;
-        case 0x27: maker = "Phison";         break;
-        case 0x28: maker = "Lexar";          break;
-        case 0x31: maker = "Silicon Power";  break;
+    uint8_t fs = sd.volumeBegin() ? sd.fatType() : 0;
+
+    // --- SUMMARY ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.printf(" %s %s\n", r.maker ? r.maker->name : "Unknown", r.cid.pnm);
+    M5.Display.printf(" %02X/%s rev %d.%d SN %08lX\n", r.cid.mid, r.cid.oid,
+                      r.cid.prvMajor, r.cid.prvMinor, (unsigned long)r.cid.psn);
+    M5.Display.printf(" Made %d-%02d  %s\n", r.cid.year, r.cid.month, fsTypeName(fs));
+    M5.Display.printf(" %lu MB %s\n", (unsigned long)(r.reportedSectors / 2048),
+                      r.haveCsd ? cardCapacityClass(r.csd) : "");
+
+    if (r.haveSds) {
+        M5.Display.printf(" C%d U%d V%d A%d", r.sds.speedClass, r.sds.uhsGrade,
+                          r.sds.videoClass, r.sds.appClass);
+        if (r.sds.auSectors) printBlockSize("  AU %s", r.sds.auSectors);
+        M5.Display.println();
+    } else {
+        M5.Display.println(" No SD Status");
+    }
+
+    M5.Display.printf(" Seq R %.2f W %.2f MB/s\n",
+                      r.bench.seqReadKBs / 1024.0f, r.bench.seqWriteKBs / 1024.0f);
+    M5.Display.printf(" 4K R %lu W %lu IOPS\n",
+                      (unsigned long)r.bench.rndReadIops, (unsigned long)r.bench.rndWriteIops);
+
+    M5.Display.setTextColor(r.suspect ? TFT_RED : TFT_GREEN, TFT_BLACK);
+    M5.Display.printf(" %s  (%.1f s)\n", r.suspect ? "SUSPECT" : "PASS",
+                      r.bench.elapsedMs / 1000.0f);
+    for (int i = 0; i < r.reasonCount && i < 2; i++) {
+        M5.Display.printf(" - %s\n", r.reasons[i]);
     }
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println(" ENTER: details");
 
-    uint64_t sizeMB =
-        (uint64_t)sd.card()->sectorCount() * 512ULL / 1024ULL / 1024ULL;
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
 
-    M5.Display.printf("Manufacturer: %s\n", maker);
-    M5.Display.printf("Product Name: %c%c%c%c%c\n",
-        cid.pnm[0], cid.pnm[1], cid.pnm[2], cid.pnm[3], cid.pnm[4]);
+    // --- DETAILS ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
 
-    M5.Display.printf("Capacity: %llu MB\n", sizeMB);
+    if (r.haveCsd) {
+        M5.Display.printf(" CSD v%d.0  CCC %03X\n", r.csd.structure + 1, r.csd.ccc);
+        M5.Display.printf(" Max %lu MHz  WP %s\n", (unsigned long)(r.csd.maxKHz / 1000),
+                          r.csd.permWriteProtect ? "perm" :
+                          r.csd.tmpWriteProtect ? "temp" : "none");
+        if (r.csd.eraseBlkEn) {
+            M5.Display.println(" Erase: any sector range");
+        } else {
+            M5.Display.printf(" Erase unit: %d sectors\n", r.csd.eraseSectorSize);
+        }
+    } else {
+        M5.Display.println(" Read CSD failed");
+    }
 
-    uint8_t fs = sd.fatType();
-    M5.Display.print("Filesystem: ");
-    switch (fs) {
-       case FAT_TYPE_EXFAT: M5.Display.println("exFAT"); break;
-       case 32:             M5.Display.println("FAT32"); break;
-       case 16:             M5.Display.println("FAT16"); break;
-       case 12:             M5.Display.println("FAT12"); break;
-       default:             M5.Display.println("Unknown"); break;
+    if (r.haveSds && r.sds.eraseSize) {
+        M5.Display.printf(" Erase %u AU in %d+%d s\n", r.sds.eraseSize,
+                          r.sds.eraseTimeoutS, r.sds.eraseOffsetS);
     }
+    M5.Display.printf(" CID CRC: %s\n", r.cid.crcOk ? "ok" : "BAD");
+    M5.Display.printf(" Max write: %.1f ms\n", r.bench.maxWriteUs / 1000.0f);
 
-    M5.Display.printf("\nMID: 0x%02X\n", cid.mid);
-    M5.Display.printf("OID: %c%c\n", cid.oid[0], cid.oid[1]);
+    if (r.reasonCount) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        for (int i = 0; i < r.reasonCount; i++) {
+            M5.Display.printf(" - %s\n", r.reasons[i]);
+        }
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    }
 
     waitForInput();
 }
 
 // --- Speed Test ---
 
-void runSpeedTest() {
-    M5.Display.fillScreen(TFT_BLACK);
-    M5.Display.setCursor(0, 0);
-    M5.Display.println("\n");
-    M5.Display.println(" Speed Test\n");
-    M5.Display.println(" BKSP: abort\n");
+struct SpeedResult {
+    float writeMBs;
+    float readMBs;
+    uint32_t maxLatencyUs;       // Slowest single 4KB write
+};
 
-    if (!initSD()) { 
-        waitForInput(); 
-        return; 
-    }
+// The menu test: 5MB in 4KB blocks
+static const uint32_t SPEED_BLOCK_BYTES = 4096;
+static const uint32_t SPEED_BLOCKS = 1280;
+static const uint32_t SPEED_MB = (SPEED_BLOCK_BYTES * SPEED_BLOCKS) >> 20;     // History size
+
+// False from keepGoing aborts the pass
+typedef bool (*KeepGoingFn)();
+
+static bool keysKeepGoing() {
+    return !abortPressed();
+}
+
+// One write + read of spd.tmp, `blocks` x `blockBytes`, on whichever
+// driver is active. Returns nullptr, or why the pass failed.
+static const char* speedPass(SpeedResult &res, uint32_t blockBytes, uint32_t blocks,
+                             KeepGoingFn keepGoing) {
+    ArenaScope scope("speed");
+    uint8_t *buf = arenaAlloc(blockBytes);
+    if (!buf) return "Not enough RAM";
+    memset(buf, 0xA5, blockBytes);
 
-    static uint8_t buf[4096];
     SdFile f;
-    if (!f.open("spd.tmp", O_RDWR | O_CREAT | O_TRUNC)) {
-        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
-        M5.Display.println("Open spd.tmp failed");
-        waitForInput();
-        return;
-    }
+    if (!f.open("spd.tmp", O_RDWR | O_CREAT | O_TRUNC)) return "Open spd.tmp failed";
+
+    const float totalMB = (float)blockBytes * blocks / 1048576.0f;
+    const char *err = nullptr;
 
     // --- WRITE TEST ---
+    res.maxLatencyUs = 0;
     uint32_t s = millis();
-    for (int i = 0; i < 1280; i++) {
+    for (uint32_t i = 0; i < blocks && !err; i++) {
 
         // Abort check
-        M5Cardputer.update();
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-            while (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-                M5Cardputer.update();
-                delay(10);
-            }
-            M5.Display.println("\nAborted by user");
-            f.close();
-            sd.remove("spd.tmp");
-            waitForInput();
-            return;
+        if (!keepGoing()) {
+            err = "Aborted by user";
+            break;
         }
 
-        f.write(buf, 4096);
+        uint32_t t0 = micros();
+        if (f.write(buf, blockBytes) != blockBytes) err = "Write failed";
+        uint32_t lat = micros() - t0;
+        if (lat > res.maxLatencyUs) res.maxLatencyUs = lat;
     }
     f.sync();
 
-    float writeTime = (millis() - s) / 1000.0f;
-    M5.Display.printf(" Write: %.2f MB/s\n", 5.0f / writeTime);
+    res.writeMBs = totalMB / ((millis() - s) / 1000.0f);
 
     // --- READ TEST ---
     f.rewind();
     s = millis();
-    while (f.read(buf, 4096) > 0) {
+    while (!err && f.read(buf, blockBytes) > 0) {
 
         // Abort check
-        M5Cardputer.update();
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-            while (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-                M5Cardputer.update();
-                delay(10);
-            }
-            M5.Display.println("\nAborted by user");
-            f.close();
-            sd.remove("spd.tmp");
-            waitForInput();
-            return;
-        }
+        if (!keepGoing()) err = "Aborted by user";
     }
 
-    float readTime = (millis() - s) / 1000.0f;
-    M5.Display.printf(" Read:  %.2f MB/s\n", 5.0f / readTime);
+    res.readMBs = totalMB / ((millis() - s) / 1000.0f);
 
     f.close();
     sd.remove("spd.tmp");
+    return err;
+}
 
-    waitForInput();
+// --- Cold / warm reads ---
+// speedPass() reads spd.tmp straight after writing it, so the card
+// can serve part of that from its write cache. Here the cold pass
+// reads spdcold.bin instead: larger than any card's cache, written
+// before this run's spd.tmp (and kept, so from the second run on it
+// dates from an earlier session), read once in shuffled order so
+// read-ahead can't help either. The warm pass re-reads a small
+// window of spd.tmp and times the second pass: the cached figure.
+// spdcold.bin is created contiguous, and contiguousRange() tells
+// SdFat so again after every reopen: seeks then don't walk the
+// cluster chain through SdFat's cache, and the aligned 4KB reads go
+// straight into our buffer, so the cold figure is the card's alone.
+
+static const char *COLD_FILE = "spdcold.bin";
+static const uint32_t COLD_FILE_BYTES = 16UL << 20;
+static const uint32_t WARM_WINDOW_BYTES = 256UL << 10;
+
+struct CacheReadResult {
+    float writeMBs;              // spd.tmp, written between the two
+    float warmMBs;
+    float coldMBs;
+    bool  coldFresh;             // spdcold.bin had to be written this run
+};
+
+static void shuffleBlocks(uint32_t *order, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) order[i] = i;
+    for (uint32_t i = count - 1; i > 0; i--) {
+        uint32_t j = esp_random() % (i + 1);
+        uint32_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
 }
 
+// Reads the listed blocks of `f` in that order
+static const char* readBlocks(SdFile &f, uint8_t *buf, uint32_t blockBytes, uint32_t base,
+                              const uint32_t *order, uint32_t count, KeepGoingFn keepGoing,
+                              float &mbs) {
+    uint32_t s = micros();
+    for (uint32_t i = 0; i < count; i++) {
+        if (!keepGoing()) return "Aborted by user";
+        if (!f.seekSet(base + order[i] * blockBytes) ||
+            f.read(buf, blockBytes) != (int)blockBytes) {
+            return "Read failed";
+        }
+    }
+    uint32_t us = micros() - s;
+    mbs = us ? (float)blockBytes * count / us * 1000000.0f / 1048576.0f : 0;
+    return nullptr;
+}
 
-// --- Integrity Check (H2TestW‑style, Cardputer‑optimised layout) ---
-void runIntegrityCheck() {
-    M5.Display.fillScreen(TFT_BLACK);
-    M5.Display.setCursor(0, 0);
-    M5.Display.println(" Integrity Check (50MB)");
+static const char* writeBlocks(SdFile &f, uint8_t *buf, uint32_t blockBytes, uint32_t count,
+                               KeepGoingFn keepGoing) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!keepGoing()) return "Aborted by user";
+        if (f.write(buf, blockBytes) != blockBytes) return "Write failed";
+    }
+    return f.sync() ? nullptr : "Write failed";
+}
 
-    M5.Display.setCursor(0, 20);
-    M5.Display.println(" ENTER: start");
+// Returns nullptr, or why the pass failed
+static const char* cacheReadPass(CacheReadResult &res, uint32_t blockBytes,
+                                 KeepGoingFn keepGoing) {
+    const uint32_t coldBlocks = COLD_FILE_BYTES / blockBytes;
+    const uint32_t warmBlocks = WARM_WINDOW_BYTES / blockBytes ? WARM_WINDOW_BYTES / blockBytes : 1;
+
+    ArenaScope scope("cacheread");
+    uint8_t *buf = arenaAlloc(blockBytes);
+    uint32_t *order = (uint32_t *)arenaAlloc(coldBlocks * sizeof(uint32_t));
+    if (!buf || !order) return "Not enough RAM";
+    memset(buf, 0x5A, blockBytes);
+
+    const char *err = nullptr;
+    SdFile cold, f;
+    uint32_t first, last;
+
+    // --- COLD REGION: kept from an earlier run if it is there ---
+    // (and contiguous: older builds wrote it as a plain file)
+    res.coldFresh = !cold.open(COLD_FILE, O_RDONLY) || cold.fileSize() != COLD_FILE_BYTES ||
+                    !cold.contiguousRange(&first, &last);
+    if (res.coldFresh) {
+        if (cold.isOpen()) cold.close();
+        sd.remove(COLD_FILE);
+        if (!cold.createContiguous(COLD_FILE, COLD_FILE_BYTES)) err = "No contiguous space";
+        else err = writeBlocks(cold, buf, blockBytes, coldBlocks, keepGoing);
+    }
 
-    M5.Display.setCursor(0, 35);
-    M5.Display.println(" BKSP: abort");
+    // --- Something newer than it ---
+    if (!err && !f.open("spd.tmp", O_RDWR | O_CREAT | O_TRUNC)) err = "Open spd.tmp failed";
+    if (!err) {
+        uint32_t s = millis();
+        err = writeBlocks(f, buf, blockBytes, SPEED_BLOCKS, keepGoing);
+        uint32_t ms = millis() - s;
+        res.writeMBs = ms ? (float)blockBytes * SPEED_BLOCKS / 1048576.0f / (ms / 1000.0f) : 0;
+    }
 
-    // Wait for ENTER or BACKSPACE
-    while (!M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER)) {
-        M5Cardputer.update();
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-            currentState = MENU;
-            drawMenu();
-            return;
+    // --- WARM: last window of what was just written, second read ---
+    if (!err) {
+        const uint32_t n = warmBlocks < SPEED_BLOCKS ? warmBlocks : SPEED_BLOCKS;
+        const uint32_t base = (SPEED_BLOCKS - n) * blockBytes;
+        shuffleBlocks(order, n);
+        err = readBlocks(f, buf, blockBytes, base, order, n, keepGoing, res.warmMBs);
+        if (!err) err = readBlocks(f, buf, blockBytes, base, order, n, keepGoing, res.warmMBs);
+    }
+
+    // --- COLD: every block once, shuffled ---
+    if (!err) {
+        shuffleBlocks(order, coldBlocks);
+        err = readBlocks(cold, buf, blockBytes, 0, order, coldBlocks, keepGoing, res.coldMBs);
+    }
+
+    f.close();
+    cold.close();
+    sd.remove("spd.tmp");
+    if (err && res.coldFresh) sd.remove(COLD_FILE);     // Half written: not cold data
+    return err;
+}
+
+static void runCacheReadTest() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Cold vs warm read\n");
+    M5.Display.println(" BKSP: abort\n");
+
+    CacheReadResult res;
+    const char *err = nullptr;
+    if (!initSDTraced() || (err = cacheReadPass(res, SPEED_BLOCK_BYTES, keysKeepGoing))) {
+        if (err) {
+            M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+            M5.Display.printf(" %s\n", err);
+            M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
         }
-        delay(10);
+        waitForInput();
+        return;
+    }
+
+    M5.Display.printf(" Write     %6.2f MB/s\n", res.writeMBs);
+    M5.Display.printf(" Warm read %6.2f MB/s\n", res.warmMBs);
+    M5.Display.printf(" Cold read %6.2f MB/s\n", res.coldMBs);
+    if (res.coldMBs > 0) {
+        M5.Display.printf(" Cache gain x%.1f\n", res.warmMBs / res.coldMBs);
+    }
+    if (res.coldFresh) {
+        M5.Display.setTextColor(TFT_YELLOW, TFT_BLACK);
+        M5.Display.println(" Cold file new, rerun later");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
     }
+    showTrace();
+    waitForInput();
+}
+
+// --- Multi-stream ---
+
+static const uint32_t MULTI_PHASE_MS = 5000;
 
-    // Debounce ENTER
-    while (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER)) {
-        M5Cardputer.update();
-        delay(10);
+static bool multiProgress(int phase, uint8_t percent) {
+    M5.Display.setCursor(0, 60);
+    if (phase < MS_DEFAULT_COUNT) {
+        M5.Display.printf(" %s alone: %d%%      ", MS_DEFAULT_STREAMS[phase].name, percent);
+    } else {
+        M5.Display.printf(" All together: %d%%      ", percent);
     }
+    return !abortPressed();
+}
 
-    // Init SD
-    if (!initSD()) {
+static void runMultiStreamTest() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Multi-stream\n");
+    M5.Display.printf(" %d streams, %lus per phase\n", MS_DEFAULT_COUNT,
+                      (unsigned long)(MULTI_PHASE_MS / 1000));
+    M5.Display.println(" BKSP: abort");
+
+    if (!initSDTraced()) {
         waitForInput();
         return;
     }
 
-    SdFile f;
-    if (!f.open("test.h2w", O_RDWR | O_CREAT | O_TRUNC)) {
+    static MsReport rep;
+    MsResult res = runMultiStream(sd, MS_DEFAULT_STREAMS, MS_DEFAULT_COUNT, MULTI_PHASE_MS,
+                                  rep, multiProgress);
+    if (res != MS_OK) {
         M5.Display.setTextColor(TFT_RED, TFT_BLACK);
-        M5.Display.setCursor(0, 60);
-        M5.Display.println("Open test.h2w failed");
+        M5.Display.setCursor(0, 80);
+        M5.Display.println(res == MS_ABORTED   ? " Aborted by user" :
+                           res == MS_NO_MEMORY ? " Not enough RAM" : " Create stream file failed");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
         waitForInput();
         return;
     }
 
-    uint8_t buf[512];
-    uint32_t limit = 50 * 1024 * 1024;  // 50MB
-    uint32_t total = 0;
+    // --- RESULT SCREEN: mixed figures, change from running alone ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Stream  KB/s  avg ms  lat");
+    for (int i = 0; i < rep.count; i++) {
+        const MsStreamReport &s = rep.streams[i];
+        const uint32_t solo = msKBs(s.solo), mixed = msKBs(s.mixed);
+        const uint32_t lat = msInterference(s);
+
+        M5.Display.setTextColor(lat >= 200 || s.mixed.late ? TFT_YELLOW : TFT_GREEN, TFT_BLACK);
+        M5.Display.printf(" %-6.6s %5lu %6.1f x%lu.%lu\n", MS_DEFAULT_STREAMS[i].name,
+                          (unsigned long)mixed, msAvgUs(s.mixed) / 1000.0f,
+                          (unsigned long)(lat / 100), (unsigned long)(lat % 100 / 10));
+        M5.Display.printf("  solo %lu max %.0fms", (unsigned long)solo, s.mixed.maxUs / 1000.0f);
+        if (s.mixed.late) M5.Display.printf(" L%lu", (unsigned long)s.mixed.late);
+        M5.Display.println();
+    }
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println(" lat: x slower than solo");
+    M5.Display.println(" L: records started late");
+    showTrace();
 
-    // H2testw-style monotonic counter
-    uint32_t counter = 0;
+    waitForInput();
+}
 
-    // --- WRITE PHASE ---
+// Same pass on the Arduino SPIClass driver and on the DMA driver,
+// back to back on the same card
+void runSpeedTest() {
     M5.Display.fillScreen(TFT_BLACK);
     M5.Display.setCursor(0, 0);
-    M5.Display.println(" Writing blocks...");
+    M5.Display.println(" Speed Test\n");
+    M5.Display.println(" ENTER: write / read");
+    M5.Display.println(" C: cold vs warm read");
+    M5.Display.println(" M: multi-stream");
+    M5.Display.println(" BKSP: back");
 
-    M5.Display.setCursor(0, 25);
-    M5.Display.println(" Progress:");
+    inputFlush();
+    while (true) {
+        char key = inputGetKey();
+        if (key == INPUT_BACK) {
+            currentState = MENU;
+            drawMenu();
+            return;
+        }
+        if (key == 'c') {
+            runCacheReadTest();
+            return;
+        }
+        if (key == 'm') {
+            runMultiStreamTest();
+            return;
+        }
+        if (key == INPUT_ENTER) break;
+    }
 
-    while (total < limit) {
-        uint32_t* p = (uint32_t*)buf;
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println("\n");
+    M5.Display.println(" Speed Test\n");
+    M5.Display.println(" BKSP: abort\n");
 
-        // Fill block with monotonic pattern
-        for (int i = 0; i < 128; i++) {
-            p[i] = counter++;
-        }
+    static const SdDriverMode modes[2] = { SD_DRIVER_ARDUINO, SD_DRIVER_DMA };
+    SpeedResult res[2];
 
-        if (f.write(buf, 512) != 512) {
-            M5.Display.setTextColor(TFT_RED, TFT_BLACK);
-            M5.Display.setCursor(0, 60);
-            M5.Display.println("Write error");
-            break;
+    for (int m = 0; m < 2; m++) {
+        sdDriver.setMode(modes[m]);
+
+        const char *err = nullptr;
+        if (!initSDTraced() ||
+            (err = speedPass(res[m], SPEED_BLOCK_BYTES, SPEED_BLOCKS, keysKeepGoing))) {
+            if (err) {
+                M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+                M5.Display.printf("\n %s\n", err);
+                M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+            }
+            sdDriver.setMode(SD_DRIVER_DMA);
+            waitForInput();
+            return;
         }
 
-        total += 512;
+        M5.Display.printf(" %-7s W %5.2f R %5.2f\n",
+                          sdDriver.modeName(), res[m].writeMBs, res[m].readMBs);
+    }
 
-        // Update progress every 1MB
-        if ((total % (1024 * 1024)) == 0) {
-            M5.Display.setCursor(0, 45);
-            M5.Display.printf(" Written: %d MB   ", total / 1024 / 1024);
-            M5Cardputer.update();
-        }
+    M5.Display.printf(" Max write: %.1f ms\n", res[1].maxLatencyUs / 1000.0f);
+    showTrace();                 // DMA pass
 
-        // Keep UI responsive
-        if ((total & 0xFFF) == 0) {
-            M5Cardputer.update();
-            delay(1);
-        }
+    // History tracks the driver the rest of the tool runs on
+    recordHistory(HIST_SPEED, SPEED_MB,
+                  (uint32_t)(res[1].writeMBs * 1024),
+                  (uint32_t)(res[1].readMBs * 1024),
+                  res[1].maxLatencyUs, 0);
 
-        // Abort
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-            M5.Display.setCursor(0, 70);
-            M5.Display.println("Aborted by user");
-            break;
-        }
+    waitForInput();
+}
+
+
+// --- Integrity Check (H2TestW‑style, Cardputer‑optimised layout) ---
+
+// Test data is split into 1GB files (FAT32 caps a file at 4GB)
+static const uint64_t H2W_SEGMENT_BYTES = 1024ULL * 1024 * 1024;
+static const uint32_t H2W_BLOCK = 4096;
+static const uint64_t H2W_CHECKPOINT_BYTES = 64ULL * 1024 * 1024;
+static const uint64_t H2W_QUICK_BYTES = 50ULL * 1024 * 1024;
+
+enum IntegrityPhase : uint8_t { H2W_WRITE = 0, H2W_VERIFY = 1 };
+
+static void h2wName(char *name, uint32_t segment) {
+    sprintf(name, "test%03lu.h2w", (unsigned long)segment);
+}
+
+// Pattern word at any offset, so a resumed run regenerates
+// exactly what was written before the reset
+static inline uint32_t h2wWord(uint64_t wordIndex, uint32_t seed) {
+    return (uint32_t)wordIndex ^
+           ((uint32_t)(wordIndex >> 32) * 0x9E3779B9UL) ^ seed;
+}
+
+// Open the segment holding `offset` and seek to it
+static bool h2wOpen(SdFile &f, uint64_t offset, bool writing) {
+    char name[16];
+    h2wName(name, (uint32_t)(offset / H2W_SEGMENT_BYTES));
+
+    uint64_t inSegment = offset % H2W_SEGMENT_BYTES;
+    oflag_t flags = O_RDWR;
+    if (writing) flags |= O_CREAT;
+    if (writing && inSegment == 0) flags |= O_TRUNC;
+
+    if (f.isOpen()) f.close();
+    return f.open(name, flags) && f.seekSet(inSegment);
+}
+
+static void h2wRemoveAll(uint64_t limit) {
+    char name[16];
+    uint32_t segments = (uint32_t)((limit + H2W_SEGMENT_BYTES - 1) / H2W_SEGMENT_BYTES);
+    for (uint32_t i = 0; i < segments; i++) {
+        h2wName(name, i);
+        sd.remove(name);
     }
+}
 
-    f.sync();
-    sd.card()->syncDevice();  // Ensure SPI flush
-    delay(200);
-    f.rewind();
+static void h2wProgress(const char *verb, uint64_t done, uint64_t limit) {
+    M5.Display.setCursor(0, 45);
+    M5.Display.printf(" %s: %lu MB   \n", verb, (unsigned long)(done >> 20));
+    M5.Display.printf(" of %lu MB (%d%%)   ", (unsigned long)(limit >> 20),
+                      (int)(done * 100 / limit));
+}
+
+// Runs (or resumes) the test described by `ck`. Returns false if
+// the user aborted; a reset leaves the checkpoint for next boot.
+static bool integrityRun(Checkpoint &ck) {
+    ArenaScope scope("integrity");
+    uint8_t *buf = arenaAlloc(H2W_BLOCK);
+    SdFile f;
+
+    if (!buf) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println(" Not enough RAM");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        return false;
+    }
+
+    // --- WRITE PHASE ---
+    if (ck.phase == H2W_WRITE) {
+        M5.Display.fillScreen(TFT_BLACK);
+        M5.Display.setCursor(0, 0);
+        M5.Display.println(" Writing blocks...");
+
+        M5.Display.setCursor(0, 25);
+        M5.Display.println(" Progress:");
+
+        uint32_t baseMs = ck.writeMs;
+        uint32_t phaseStart = millis();
+        uint64_t p = ck.position;
+
+        while (p < ck.limit) {
+            if (p == ck.position || p % H2W_SEGMENT_BYTES == 0) {
+                if (!h2wOpen(f, p, true)) {
+                    M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+                    M5.Display.setCursor(0, 80);
+                    M5.Display.println(" Open test file failed");
+                    break;
+                }
+            }
+
+            // Fill block with the position-derived pattern
+            uint32_t* w = (uint32_t*)buf;
+            uint64_t word = p / 4;
+            for (uint32_t i = 0; i < H2W_BLOCK / 4; i++) {
+                w[i] = h2wWord(word + i, ck.seed);
+            }
+
+            if (f.write(buf, H2W_BLOCK) != H2W_BLOCK) {
+                M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+                M5.Display.setCursor(0, 80);
+                M5.Display.println(" Write error");
+                break;
+            }
+            p += H2W_BLOCK;
+
+            // Checkpoint only what has been synced to the card
+            if (p % H2W_CHECKPOINT_BYTES == 0) {
+                f.sync();
+                ck.position = p;
+                ck.writeMs = baseMs + (millis() - phaseStart);
+                checkpointSave(ck);
+            }
+
+            // Update progress (and keep UI responsive) every 1MB
+            if ((p & 0xFFFFF) == 0) {
+                h2wProgress("Written", p, ck.limit);
+                if (abortPressed()) {
+                    M5.Display.setCursor(0, 80);
+                    M5.Display.println(" Aborted by user");
+                    f.close();
+                    return false;
+                }
+            }
+        }
+
+        f.sync();
+        f.close();
+        sd.card()->syncDevice();  // Ensure SPI flush
+
+        // A write failure shortens the test rather than ending it
+        ck.limit = p;
+        ck.writeMs = baseMs + (millis() - phaseStart);
+        ck.phase = H2W_VERIFY;
+        ck.position = 0;
+        checkpointSave(ck);
+        delay(200);
+    }
 
     // --- VERIFY PHASE ---
     M5.Display.fillScreen(TFT_BLACK);
@@ -435,669 +993,2346 @@ void runIntegrityCheck() {
     M5.Display.setCursor(0, 25);
     M5.Display.println("Progress:");
 
-    uint32_t r = 0;
-    uint32_t expected = 0;
-    uint32_t err = 0;
+    uint32_t baseMs = ck.readMs;
+    uint32_t phaseStart = millis();
+    uint64_t r = ck.position;
+
+    while (r < ck.limit) {
+        if (r == ck.position || r % H2W_SEGMENT_BYTES == 0) {
+            if (!h2wOpen(f, r, false)) {
+                M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+                M5.Display.setCursor(0, 80);
+                M5.Display.println(" Open test file failed");
+                ck.errors++;
+                break;
+            }
+        }
 
-    while (r < total) {
-        int n = f.read(buf, 512);
-        if (n != 512) {
+        if (f.read(buf, H2W_BLOCK) != (int)H2W_BLOCK) {
             M5.Display.setTextColor(TFT_RED, TFT_BLACK);
-            M5.Display.setCursor(0, 60);
-            M5.Display.println("Read error");
+            M5.Display.setCursor(0, 80);
+            M5.Display.println(" Read error");
+            ck.errors++;
             break;
         }
 
-        uint32_t* p = (uint32_t*)buf;
-
         // Compare block
-        for (int i = 0; i < 128; i++) {
-            if (p[i] != expected++) {
-                err++;
+        uint32_t* w = (uint32_t*)buf;
+        uint64_t word = r / 4;
+        for (uint32_t i = 0; i < H2W_BLOCK / 4; i++) {
+            if (w[i] != h2wWord(word + i, ck.seed)) {
+                ck.errors++;
             }
         }
+        r += H2W_BLOCK;
 
-        r += 512;
-
-        // Update progress every 1MB
-        if ((r % (1024 * 1024)) == 0) {
-            M5.Display.setCursor(0, 45);
-            M5.Display.printf(" Verified: %d MB   ", r / 1024 / 1024);
-            M5Cardputer.update();
-        }
-
-        // Keep UI responsive
-        if ((r & 0xFFF) == 0) {
-            M5Cardputer.update();
-            delay(1);
+        if (r % H2W_CHECKPOINT_BYTES == 0) {
+            ck.position = r;
+            ck.readMs = baseMs + (millis() - phaseStart);
+            checkpointSave(ck);
         }
 
-        // Abort
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-            M5.Display.setCursor(0, 70);
-            M5.Display.println("Aborted by user");
-            break;
+        if ((r & 0xFFFFF) == 0) {
+            h2wProgress("Verified", r, ck.limit);
+            if (abortPressed()) {
+                M5.Display.setCursor(0, 80);
+                M5.Display.println(" Aborted by user");
+                f.close();
+                return false;
+            }
         }
     }
 
     f.close();
-    sd.remove("test.h2w");
+    ck.position = r;
+    ck.readMs = baseMs + (millis() - phaseStart);
+    return true;
+}
 
-    // --- RESULT SCREEN ---
-    M5.Display.fillScreen(err ? TFT_RED : TFT_GREEN);
+// Shared tail of a fresh and a resumed run
+static void integrityFinish(Checkpoint &ck) {
+    bool done = integrityRun(ck);
+
+    h2wRemoveAll(ck.limit);
+    checkpointClear();
+
+    if (!done) {
+        waitForInput();
+        return;
+    }
+
+    uint64_t kb = ck.limit / 1024;
+    recordHistory(HIST_INTEGRITY, (uint32_t)(ck.limit >> 20),
+                  ck.writeMs ? (uint32_t)(kb * 1000 / ck.writeMs) : 0,
+                  ck.readMs ? (uint32_t)(kb * 1000 / ck.readMs) : 0,
+                  0, ck.errors);
+
+    // --- RESULT SCREEN ---
+    M5.Display.fillScreen(ck.errors ? TFT_RED : TFT_GREEN);
+    M5.Display.setCursor(0, 0);
+    M5.Display.printf(" Result: %s\nErrors: %lu\n",
+                      ck.errors ? "FAIL" : "PASS", (unsigned long)ck.errors);
+    M5.Display.printf(" Tested: %lu MB\n", (unsigned long)(ck.limit >> 20));
+
+    waitForInput();
+}
+
+void runIntegrityCheck() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Integrity Check");
+
+    M5.Display.setCursor(0, 20);
+    M5.Display.println(" ENTER: 50MB test");
+
+    M5.Display.setCursor(0, 35);
+    M5.Display.println(" F: fill free space");
+
+    M5.Display.setCursor(0, 50);
+    M5.Display.println(" BKSP: abort");
+
+    // Wait for ENTER, F or BACKSPACE
+    bool fill = false;
+    inputFlush();
+    while (true) {
+        char key = inputGetKey();
+        if (key == INPUT_BACK) {
+            currentState = MENU;
+            drawMenu();
+            return;
+        }
+        if (key == INPUT_ENTER) break;
+        if (key == 'f') {
+            fill = true;
+            break;
+        }
+    }
+
+    // Init SD
+    M5.Display.setCursor(0, 70);
+    if (!initSD()) {
+        waitForInput();
+        return;
+    }
+
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("Read CID Failed");
+        waitForInput();
+        return;
+    }
+
+    Checkpoint ck;
+    memset(&ck, 0, sizeof(ck));
+    ck.test  = CKPT_INTEGRITY;
+    ck.phase = H2W_WRITE;
+    ck.mid   = cid.mid;
+    ck.psn   = cidSerial(cid);
+    ck.seed  = esp_random();
+    ck.limit = H2W_QUICK_BYTES;
+
+    if (fill) {
+        // Leave 2MB for directory growth; whole blocks only
+        uint64_t freeBytes = (uint64_t)sd.vol()->freeClusterCount() *
+                             sd.vol()->sectorsPerCluster() * 512;
+        uint64_t margin = 2ULL * 1024 * 1024;
+        ck.limit = freeBytes > margin ? (freeBytes - margin) & ~(uint64_t)(H2W_BLOCK - 1) : 0;
+    }
+
+    if (ck.limit == 0) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("No free space");
+        waitForInput();
+        return;
+    }
+
+    integrityFinish(ck);
+}
+
+// ------------------------------------------------------------
+// Resume an integrity run interrupted by reset / power loss
+// ------------------------------------------------------------
+
+// Mounts the card the checkpoint was taken on; otherwise says why
+// on screen and that the checkpoint stays
+static bool mountCheckpointCard(const Checkpoint &ck) {
+    if (!initSD()) {
+        M5.Display.println(" Checkpoint kept");
+        return false;
+    }
+
+    cid_t cid;
+    if (!sd.card()->readCID(&cid) ||
+        cid.mid != ck.mid || cidSerial(cid) != ck.psn) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println(" Different card inserted");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        M5.Display.println(" Checkpoint kept");
+        return false;
+    }
+    return true;
+}
+
+void offerResume() {
+    Checkpoint ck;
+    if (!checkpointLoad(ck)) return;
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.setTextColor(TFT_YELLOW, TFT_BLACK);
+    M5.Display.println(" Interrupted test found\n");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.printf(" Integrity, %s phase\n",
+                      ck.phase == H2W_WRITE ? "write" : "verify");
+    M5.Display.printf(" %lu / %lu MB done\n",
+                      (unsigned long)(ck.position >> 20),
+                      (unsigned long)(ck.limit >> 20));
+    M5.Display.println(" Insert the same card\n");
+    M5.Display.println(" ENTER: resume");
+    M5.Display.println(" BKSP: discard");
+
+    bool resume = waitForEnter();
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (!resume) {
+        // The test files are only found again through the checkpoint,
+        // so it goes once they are gone from the card that holds them
+        if (mountCheckpointCard(ck)) {
+            h2wRemoveAll(ck.limit);
+            checkpointClear();
+            return;
+        }
+        M5.Display.println(" Asked again next start,");
+        M5.Display.println(" discard with that card in");
+        waitForInput();
+        return;
+    }
+
+    currentState = H2TEST;
+
+    if (!mountCheckpointCard(ck)) {
+        waitForInput();
+        return;
+    }
+
+    integrityFinish(ck);
+}
+
+// ===============================
+// Secure Erase screen
+// ===============================
+
+static bool eraseProgress(EraseStage stage, uint8_t percent) {
+    M5.Display.setCursor(0, 70);
+    M5.Display.printf(" %s: %d%%   ", stage == ERASE_STAGE_ERASE ? "Erasing" : "Verifying",
+                      percent);
+    return !abortPressed();
+}
+
+void runSecureErase() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 10);
+    M5.Display.println(" Secure Erase\n");
+    M5.Display.println(" Card ERASE commands over");
+    M5.Display.println(" the whole card, verified");
+    M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+    M5.Display.println(" ERASES EVERYTHING");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println(" ENTER: continue");
+    M5.Display.println(" BKSP: abort");
+
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (!initCard()) {
+        waitForInput();
+        return;
+    }
+
+    SdCard *card = sd.card();
+    CsdInfo csd;
+    SdStatusInfo sds;
+    if (!readCsdInfo(card, csd)) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("Read CSD Failed");
+        waitForInput();
+        return;
+    }
+    bool haveSds = readSdStatusInfo(card, sds);
+    ErasePlan plan = planErase(csd, haveSds ? &sds : nullptr);
+
+    // --- Second confirmation, with the card named ---
+    M5.Display.printf(" %lu MB card\n", (unsigned long)(card->sectorCount() / 2048));
+    printBlockSize(" Unit %s", plan.unitSectors);
+    printBlockSize("  chunk %s\n", plan.chunkSectors);
+    M5.Display.println(plan.fromSdStatus ? " Timing from SD Status"
+                                         : " No erase timing: adaptive");
+    M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+    M5.Display.println("\n All data will be lost");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println(" ENTER: ERASE");
+    M5.Display.println(" BKSP: abort");
+
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Erasing...");
+
+    SdCardDevice dev(card);
+    EraseReport rep;
+    uint32_t start = millis();
+    EraseResult res = secureErase(&dev, csd, haveSds ? &sds : nullptr, esp_random(),
+                                  rep, eraseProgress);
+    uint32_t elapsed = millis() - start;
+
+    // --- RESULT SCREEN ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.printf(" Erased %lu MB in %.1f s\n", (unsigned long)(rep.erasedSectors / 2048),
+                      rep.eraseMs / 1000.0f);
+    M5.Display.printf(" Throughput %lu MB/s\n", (unsigned long)(rep.eraseKBs / 1024));
+    M5.Display.printf(" %lu cmds", (unsigned long)rep.chunks);
+    printBlockSize(", largest %s\n", rep.largestChunk);
+    M5.Display.printf(" Max %.1f s/cmd  retry %lu\n", rep.maxChunkMs / 1000.0f,
+                      (unsigned long)rep.retries);
+    if (rep.zeroedSectors) {
+        M5.Display.printf(" Tail zeroed: %lu sectors\n", (unsigned long)rep.zeroedSectors);
+    }
+    if (rep.samples) {
+        M5.Display.printf(" Verify %lu/%lu clean (%02X)\n",
+                          (unsigned long)(rep.samples - rep.samplesBad),
+                          (unsigned long)rep.samples, rep.erasedByte);
+    }
+    M5.Display.printf(" Total %.1f s\n", elapsed / 1000.0f);
+
+    const char* verdict = "Card is blank";
+    uint16_t color = TFT_GREEN;
+    switch (res) {
+        case ERASE_NOT_CLEAN:       verdict = "Data survived erase";   color = TFT_RED;    break;
+        case ERASE_UNSUPPORTED:     verdict = "Card has no ERASE";     color = TFT_YELLOW; break;
+        case ERASE_WRITE_PROTECTED: verdict = "Write protected";       color = TFT_YELLOW; break;
+        case ERASE_IO_ERROR:        verdict = "I/O error";             color = TFT_RED;    break;
+        case ERASE_NO_MEMORY:       verdict = "Not enough RAM";        color = TFT_RED;    break;
+        case ERASE_ABORTED:         verdict = "Aborted - partial!";    color = TFT_YELLOW; break;
+        default:                                                                           break;
+    }
+    M5.Display.setTextColor(color, TFT_BLACK);
+    M5.Display.printf(" %s\n", verdict);
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    if (res == ERASE_NOT_CLEAN) {
+        M5.Display.printf(" First at sector %lu\n", (unsigned long)rep.firstBad);
+    } else if (res == ERASE_OK) {
+        M5.Display.println(" Format before use");
+    }
+
+    waitForInput();
+}
+
+// ===============================
+// USB Image screen
+// ===============================
+// The host script (tools/sdimage.py) drives this: it sends
+// "backup" or "restore" and the card streams out or in.
+
+static const char* IMAGE_RESULT_NAMES[] = {
+    "ok", "io_error", "link_error", "bad_stream", "too_big", "no_memory", "aborted"
+};
+
+static bool imageProgress(uint8_t percent) {
+    M5.Display.setCursor(0, 70);
+    M5.Display.printf(" Progress: %d%%   ", percent);
+    return !abortPressed();
+}
+
+// The binary stream, then a RESULT line. Shared with the "backup"
+// and "restore" serial commands; the caller sends START / OK.
+static ImageResult imageSession(bool backup, ImageStats &st) {
+    SdCardDevice dev(sd.card());
+    ImageResult res = backup ? imageBackup(&dev, Serial, st, imageProgress)
+                             : imageRestore(&dev, Serial, st, imageProgress);
+
+    Serial.printf("RESULT %s sectors=%lu data_sectors=%lu zero_sectors=%lu records=%lu "
+                  "wire_kb=%lu ms=%lu\n", backup ? "backup" : "restore",
+                  (unsigned long)st.sectors, (unsigned long)st.dataSectors,
+                  (unsigned long)st.zeroSectors, (unsigned long)st.records,
+                  (unsigned long)(st.wireBytes >> 10), (unsigned long)st.elapsedMs);
+    return res;
+}
+
+// One line from the host; false if BKSP was pressed first
+static bool readHostLine(char *line, size_t max) {
+    size_t len = 0;
+    while (true) {
+        while (Serial.available() > 0) {
+            char c = (char)Serial.read();
+            if (c == '\r') continue;
+            if (c == '\n') {
+                line[len] = '\0';
+                if (len) return true;
+                continue;
+            }
+            if (len + 1 < max) line[len++] = c;
+        }
+        if (inputGetKey(10) == INPUT_BACK) return false;
+    }
+}
+
+void runUsbImage() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" USB Image\n");
+
+    if (!initCard()) {
+        waitForInput();
+        return;
+    }
+
+    M5.Display.println(" On the PC run:");
+    M5.Display.println(" sdimage.py backup|restore");
+    M5.Display.println("   PORT file.sdimg");
+    M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+    M5.Display.println(" Restore overwrites card");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println(" Waiting for host...");
+    M5.Display.println(" BKSP: abort");
+
+    // Drop anything a previous session left behind
+    while (Serial.available() > 0) Serial.read();
+    inputFlush();
+
+    char cmd[16];
+    bool backup = false;
+    while (true) {
+        if (!readHostLine(cmd, sizeof(cmd))) {
+            currentState = MENU;
+            drawMenu();
+            return;
+        }
+        if (strcmp(cmd, "backup") == 0)  { backup = true;  break; }
+        if (strcmp(cmd, "restore") == 0) { backup = false; break; }
+    }
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(backup ? " Backing up to USB..." : " Restoring from USB...");
+
+    // Same replies as the serial commands, so the host script
+    // doesn't care which way the session was started
+    Serial.printf("START %s\n", cmd);
+    ImageStats st;
+    ImageResult res = imageSession(backup, st);
+    if (res == IMAGE_OK) Serial.printf("OK %s\n", cmd);
+    else                 Serial.printf("ERROR %s %s\n", cmd, IMAGE_RESULT_NAMES[res]);
+
+    // --- RESULT SCREEN ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.printf(" %s %lu MB\n", backup ? "Backup" : "Restore",
+                      (unsigned long)(st.sectors / 2048));
+    M5.Display.printf(" Data %lu MB  zero %lu MB\n", (unsigned long)(st.dataSectors / 2048),
+                      (unsigned long)(st.zeroSectors / 2048));
+    M5.Display.printf(" Records: %lu\n", (unsigned long)st.records);
+
+    float secs = st.elapsedMs / 1000.0f;
+    if (secs > 0) {
+        M5.Display.printf(" Link %.2f MB/s\n", st.wireBytes / 1048576.0f / secs);
+        M5.Display.printf(" Effective %.2f MB/s\n", st.sectors / 2048.0f / secs);
+    }
+    M5.Display.printf(" Time %.1f s\n", secs);
+
+    const char* verdict = backup ? "Backup sent" : "Restore complete";
+    uint16_t color = TFT_GREEN;
+    switch (res) {
+        case IMAGE_IO_ERROR:   verdict = "Card I/O error";      color = TFT_RED;    break;
+        case IMAGE_LINK_ERROR: verdict = "USB link lost";       color = TFT_RED;    break;
+        case IMAGE_BAD_STREAM: verdict = "Bad image stream";    color = TFT_RED;    break;
+        case IMAGE_TOO_BIG:    verdict = "Image > this card";   color = TFT_YELLOW; break;
+        case IMAGE_NO_MEMORY:  verdict = "Not enough RAM";      color = TFT_RED;    break;
+        case IMAGE_ABORTED:    verdict = "Aborted by user";     color = TFT_YELLOW; break;
+        default:                                                                    break;
+    }
+    M5.Display.setTextColor(color, TFT_BLACK);
+    M5.Display.printf(" %s\n", verdict);
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+
+    waitForInput();
+}
+
+// ===============================
+// Flash Geometry screen
+// ===============================
+
+static bool geometryProgress(GeoStage stage, uint8_t percent) {
+    static const char* names[] = { "Align reads", "Write sizes", "Open blocks" };
+    M5.Display.setCursor(0, 70);
+    M5.Display.printf(" %s: %d%%   ", names[stage], percent);
+    return !abortPressed();
+}
+
+void runGeometryProbe() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 10);
+    M5.Display.println(" Flash Geometry\n");
+    M5.Display.println(" Page / erase block /");
+    M5.Display.println(" open segments by timing");
+    M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+    M5.Display.println(" ERASES DATA on the card");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println(" ENTER: start");
+    M5.Display.println(" BKSP: abort");
+
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (!initCard()) {
+        waitForInput();
+        return;
+    }
+
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("Read CID Failed");
+        waitForInput();
+        return;
+    }
+
+    M5.Display.println(" Probing...");
+
+    SdCardDevice dev(sd.card());
+    static FlashGeometry geo;
+    GeoResult res = probeGeometry(&dev, geo, geometryProgress);
+
+    if (res != GEO_OK) {
+        const char* msg = "I/O error";
+        switch (res) {
+            case GEO_NO_MEMORY: msg = "Not enough RAM";   break;
+            case GEO_TOO_SMALL: msg = "Card under 1GB";   break;
+            case GEO_ABORTED:   msg = "Aborted by user";  break;
+            default:                                      break;
+        }
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.setCursor(0, 90);
+        M5.Display.printf(" %s\n", msg);
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        waitForInput();
+        return;
+    }
+
+    geometrySave(cid.mid, cidSerial(cid), geo);
+
+    // --- SUMMARY ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    if (geo.pageSectors) printBlockSize(" Page:        %s\n", geo.pageSectors);
+    else                 M5.Display.println(" Page:        ?");
+    if (geo.eraseSectors) printBlockSize(" Erase block: %s\n", geo.eraseSectors);
+    else                  M5.Display.println(" Erase block: ?");
+    M5.Display.printf(" Open blocks: %d%s\n", geo.openSegments,
+                      geo.openSegments == GEO_MAX_OPEN ? "+" : "");
+
+    M5.Display.println(" Size Aligned Offset KB/s");
+    for (int i = 0; i < GEO_WRITE_POINTS; i++) {
+        printBlockSize(" %-5s", geo.write[i].sizeSectors);
+        M5.Display.printf(" %7lu  %6lu\n", (unsigned long)geo.write[i].alignedKBs,
+                          (unsigned long)geo.write[i].offsetKBs);
+    }
+    M5.Display.println(geo.eraseSectors ? " Format will align to it"
+                                        : " Format keeps 1MB layout");
+    M5.Display.println(" ENTER: boundary timings");
+
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    // --- RAW ALIGN TIMINGS (flashbench -a style) ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Boundary cost (us)");
+    for (int i = 0; i < GEO_ALIGN_POINTS; i += 2) {
+        printBlockSize(" %4s", geo.align[i].blockSectors);
+        M5.Display.printf(" %+5ld", (long)geo.align[i].diffUs);
+        if (i + 1 < GEO_ALIGN_POINTS) {
+            printBlockSize("   %4s", geo.align[i + 1].blockSectors);
+            M5.Display.printf(" %+5ld", (long)geo.align[i + 1].diffUs);
+        }
+        M5.Display.println();
+    }
+
+    waitForInput();
+}
+
+// ===============================
+// FAT32 Quick Formatter — Core Types
+// ===============================
+
+// A simple 512‑byte sector buffer
+struct Sector {
+    uint8_t b[512];
+};
+
+// Zero a sector
+static inline void clearSector(Sector &s) {
+    memset(s.b, 0, 512);
+}
+
+// -------------------------------
+// FAT32 BPB template builder
+// -------------------------------
+static void buildFAT32BPB(
+    Sector &bpb,
+    uint32_t totalSectors,
+    uint32_t fatStart,
+    uint32_t fatSize,
+    uint32_t rootCluster,
+    uint32_t sectorsPerCluster,
+    uint32_t reservedSectors
+) {
+    clearSector(bpb);
+
+    // Jump instruction + OEM name
+    bpb.b[0] = 0xEB;
+    bpb.b[1] = 0x58;
+    bpb.b[2] = 0x90;
+    memcpy(&bpb.b[3], "MSDOS5.0", 8);
+
+    // Bytes per sector
+    bpb.b[11] = 0x00; // 512 bytes (0x0200 little endian)
+    bpb.b[12] = 0x02;
+
+    // Sectors per cluster
+    bpb.b[13] = sectorsPerCluster;
+
+    // Reserved sectors (BPB + FSInfo + backup, plus alignment padding)
+    bpb.b[14] = (uint8_t)(reservedSectors & 0xFF);
+    bpb.b[15] = (uint8_t)((reservedSectors >> 8) & 0xFF);
+
+    // Number of FATs
+    bpb.b[16] = 0x02;
+
+    // Root entries (FAT12/16 only)
+    bpb.b[17] = 0x00;
+    bpb.b[18] = 0x00;
+
+    // Total sectors (16‑bit) — zero for FAT32
+    bpb.b[19] = 0x00;
+    bpb.b[20] = 0x00;
+
+    // Media descriptor
+    bpb.b[21] = 0xF8;
+
+    // FAT size (16‑bit) — zero for FAT32
+    bpb.b[22] = 0x00;
+    bpb.b[23] = 0x00;
+
+    // Sectors per track / heads — dummy geometry
+    bpb.b[24] = 0x3F;
+    bpb.b[25] = 0x00;
+    bpb.b[26] = 0xFF;
+    bpb.b[27] = 0x00;
+
+    // Hidden sectors (partition start)
+    bpb.b[28] = (uint8_t)(fatStart & 0xFF);
+    bpb.b[29] = (uint8_t)((fatStart >> 8) & 0xFF);
+    bpb.b[30] = (uint8_t)((fatStart >> 16) & 0xFF);
+    bpb.b[31] = (uint8_t)((fatStart >> 24) & 0xFF);
+
+    // Total sectors (32‑bit)
+    bpb.b[32] = (uint8_t)(totalSectors & 0xFF);
+    bpb.b[33] = (uint8_t)((totalSectors >> 8) & 0xFF);
+    bpb.b[34] = (uint8_t)((totalSectors >> 16) & 0xFF);
+    bpb.b[35] = (uint8_t)((totalSectors >> 24) & 0xFF);
+
+    // FAT32 extended fields
+    bpb.b[36] = (uint8_t)(fatSize & 0xFF);
+    bpb.b[37] = (uint8_t)((fatSize >> 8) & 0xFF);
+    bpb.b[38] = (uint8_t)((fatSize >> 16) & 0xFF);
+    bpb.b[39] = (uint8_t)((fatSize >> 24) & 0xFF);
+
+    // Flags
+    bpb.b[40] = 0x00;
+    bpb.b[41] = 0x00;
+
+    // Version
+    bpb.b[42] = 0x00;
+    bpb.b[43] = 0x00;
+
+    // Root cluster
+    bpb.b[44] = (uint8_t)(rootCluster & 0xFF);
+    bpb.b[45] = (uint8_t)((rootCluster >> 8) & 0xFF);
+    bpb.b[46] = (uint8_t)((rootCluster >> 16) & 0xFF);
+    bpb.b[47] = (uint8_t)((rootCluster >> 24) & 0xFF);
+
+    // FSInfo sector
+    bpb.b[48] = 0x01;
+    bpb.b[49] = 0x00;
+
+    // Backup boot sector
+    bpb.b[50] = 0x06;
+    bpb.b[51] = 0x00;
+
+    // Drive number
+    bpb.b[64] = 0x80;
+
+    // Boot signature
+    bpb.b[66] = 0x29;
+
+    // Volume ID (random-ish)
+    uint32_t volId = 0x12345678;
+    memcpy(&bpb.b[67], &volId, 4);
+
+    // Volume label
+    memcpy(&bpb.b[71], "NO NAME    ", 11);
+
+    // File system type
+    memcpy(&bpb.b[82], "FAT32   ", 8);
+
+    // Boot sector signature
+    bpb.b[510] = 0x55;
+    bpb.b[511] = 0xAA;
+}
+
+// -------------------------------
+// FSInfo sector builder
+// -------------------------------
+static void buildFSInfo(Sector &fs) {
+    clearSector(fs);
+
+    // Lead signature
+    fs.b[0] = 0x52;
+    fs.b[1] = 0x52;
+    fs.b[2] = 0x61;
+    fs.b[3] = 0x41;
+
+    // Struct signature
+    fs.b[484] = 0x72;
+    fs.b[485] = 0x72;
+    fs.b[486] = 0x41;
+    fs.b[487] = 0x61;
+
+    // Free cluster count unknown
+    fs.b[488] = 0xFF;
+    fs.b[489] = 0xFF;
+    fs.b[490] = 0xFF;
+    fs.b[491] = 0xFF;
+
+    // Next free cluster unknown
+    fs.b[492] = 0xFF;
+    fs.b[493] = 0xFF;
+    fs.b[494] = 0xFF;
+    fs.b[495] = 0xFF;
+
+    // Boot sector signature
+    fs.b[510] = 0x55;
+    fs.b[511] = 0xAA;
+}
+
+// ===============================
+// FAT32 Quick Formatter — Raw I/O Helpers
+// ===============================
+
+// Write a 512-byte sector to the card
+static bool writeSectorRaw(SdCard *card, uint32_t sector, const Sector &s) {
+    return card->writeSector(sector, s.b);
+}
+
+// Clear a run of sectors with multi-sector writes from one zeroed
+// arena buffer (one sector at a time if the arena is short)
+static const uint32_t FORMAT_ZERO_SECTORS = 64;     // 32KB
+
+static bool clearSectorsRaw(SdCard *card, uint32_t first, uint32_t count) {
+    ArenaScope scope("format");
+    uint32_t bufSectors = FORMAT_ZERO_SECTORS;
+    uint8_t *zeros = arenaAlloc(bufSectors * 512);
+    if (!zeros) {
+        bufSectors = 1;
+        zeros = arenaAlloc(512);
+    }
+    if (!zeros) return false;
+    memset(zeros, 0, bufSectors * 512);
+
+    while (count) {
+        uint32_t n = count < bufSectors ? count : bufSectors;
+        if (!card->writeSectors(first, zeros, n)) return false;
+        first += n;
+        count -= n;
+    }
+    return true;
+}
+
+// ===============================
+// MBR Writer
+// ===============================
+static bool writeMBR(SdCard *card, uint32_t partStart, uint32_t partSize) {
+    Sector mbr;
+    clearSector(mbr);
+
+    // Partition entry at offset 446
+    uint8_t *p = &mbr.b[446];
+
+    p[0] = 0x00;          // Boot flag
+    p[1] = 0x20;          // CHS begin (dummy)
+    p[2] = 0x21;
+    p[3] = 0x00;
+
+    p[4] = 0x0C;          // Partition type = FAT32 LBA
+    p[5] = 0xFE;          // CHS end (dummy)
+    p[6] = 0xFF;
+    p[7] = 0xFF;
+
+    // LBA start
+    p[8]  = (uint8_t)(partStart & 0xFF);
+    p[9]  = (uint8_t)((partStart >> 8) & 0xFF);
+    p[10] = (uint8_t)((partStart >> 16) & 0xFF);
+    p[11] = (uint8_t)((partStart >> 24) & 0xFF);
+
+    // Total sectors in partition
+    p[12] = (uint8_t)(partSize & 0xFF);
+    p[13] = (uint8_t)((partSize >> 8) & 0xFF);
+    p[14] = (uint8_t)((partSize >> 16) & 0xFF);
+    p[15] = (uint8_t)((partSize >> 24) & 0xFF);
+
+    // Signature
+    mbr.b[510] = 0x55;
+    mbr.b[511] = 0xAA;
+
+    return writeSectorRaw(card, 0, mbr);
+}
+
+// ===============================
+// BPB Writer
+// ===============================
+static bool writeBPB(SdCard *card, uint32_t partStart, const Sector &bpb) {
+    // Write main BPB
+    if (!writeSectorRaw(card, partStart, bpb)) return false;
+
+    // Backup boot sector at partStart + 6
+    if (!writeSectorRaw(card, partStart + 6, bpb)) return false;
+
+    return true;
+}
+
+// ===============================
+// FSInfo Writer
+// ===============================
+static bool writeFSInfo(SdCard *card, uint32_t partStart, const Sector &fs) {
+    // FSInfo at partStart + 1
+    if (!writeSectorRaw(card, partStart + 1, fs)) return false;
+
+    // Backup FSInfo at partStart + 7
+    if (!writeSectorRaw(card, partStart + 7, fs)) return false;
+
+    return true;
+}
+
+// ===============================
+// FAT Header Writer
+// ===============================
+// FAT32 requires the first two FAT entries:
+//  - FAT[0] = media descriptor + reserved bits
+//  - FAT[1] = end-of-chain marker
+static bool writeFATHeaders(
+    SdCard *card,
+    uint32_t fatStart,
+    uint32_t fatSize
+) {
+    Sector s;
+    clearSector(s);
+
+    // FAT[0]
+    s.b[0] = 0xF8;  // Media descriptor
+    s.b[1] = 0xFF;
+    s.b[2] = 0xFF;
+    s.b[3] = 0x0F;
+
+    // FAT[1]
+    s.b[4] = 0xFF;
+    s.b[5] = 0xFF;
+    s.b[6] = 0xFF;
+    s.b[7] = 0x0F;
+
+    // Write first FAT sector
+    if (!writeSectorRaw(card, fatStart, s)) return false;
+
+    // Clear remaining FAT sectors
+    return clearSectorsRaw(card, fatStart + 1, fatSize - 1);
+}
+
+// ===============================
+// Root Directory Writer
+// ===============================
+// Root directory cluster is empty for Quick Format
+static bool writeRootDir(
+    SdCard *card,
+    uint32_t dataStart,
+    uint32_t sectorsPerCluster
+) {
+    // Root directory = cluster 2
+    return clearSectorsRaw(card, dataStart, sectorsPerCluster);
+}
+
+// ===============================
+// FAT32 Quick Formatter — Core quickFormat()
+// ===============================
+
+// `layout` is what was written; status != LAYOUT_OK when the
+// card was handed to SdFat's own formatter instead. A non-zero
+// eraseSectors (from the geometry probe) aligns the layout to it.
+static bool quickFormat(SdFat &sd, Fat32Layout &layout,
+                        uint32_t eraseSectors, uint32_t pageSectors) {
+    layout.status = LAYOUT_BAD_PARAMS;
+
+    SdCard *card = sd.card();
+    if (!card) return false;
+
+    uint64_t sectors64 = card->sectorCount();
+    if (sectors64 == 0) return false;
+
+    // Card size in MB
+    uint64_t sizeMB = (sectors64 * 512ULL) / (1024ULL * 1024ULL);
+
+    // FAT16 for ≤2GB — let SdFat handle that
+    if (sizeMB <= 2048) {
+        // Silent: no Serial
+        return sd.format(nullptr);
+    }
+
+    // Closed-form layout (64-bit, see fat_layout.h)
+    layout = eraseSectors ? alignFat32Layout(sectors64, eraseSectors, pageSectors)
+                          : planFat32Layout(sectors64);
+
+    // Beyond 2TB (SDUC) FAT32 cannot address the card — hand it
+    // to SdFat, which picks exFAT when that is compiled in
+    if (layout.status == LAYOUT_TOO_LARGE) {
+        return sd.format(nullptr);
+    }
+    if (layout.status != LAYOUT_OK) return false;
+
+    const uint32_t partStart = layout.partStart;
+    const uint32_t reservedSectors = layout.reservedSectors;
+    const uint32_t fatStart = layout.fatStart;
+    const uint32_t fatSize = layout.fatSize;
+    const uint32_t dataStart = layout.dataStart;
+    const uint32_t sectorsPerCluster = layout.sectorsPerCluster;
+    const uint32_t rootCluster = 2;
+
+    // Build BPB and FSInfo
+    Sector bpb;
+    buildFAT32BPB(
+        bpb,
+        layout.partSectors,       // total sectors in partition
+        partStart,
+        fatSize,
+        rootCluster,
+        sectorsPerCluster,
+        reservedSectors
+    );
+
+    Sector fsInfo;
+    buildFSInfo(fsInfo);
+
+    // Write MBR
+    if (!writeMBR(card, partStart, layout.partSectors)) return false;
+
+    // Clear reserved area (except BPB/FSInfo/backup which we overwrite).
+    // Alignment padding past the usual 32 is never read — skip it.
+    uint32_t clearSectors = reservedSectors;
+    if (clearSectors > FAT32_RESERVED_SECTORS) clearSectors = FAT32_RESERVED_SECTORS;
+    if (!clearSectorsRaw(card, partStart, clearSectors)) return false;
+
+    // Write BPB + backup
+    if (!writeBPB(card, partStart, bpb)) return false;
+
+    // Write FSInfo + backup
+    if (!writeFSInfo(card, partStart, fsInfo)) return false;
+
+    // Write both FATs
+    if (!writeFATHeaders(card, fatStart, fatSize)) return false;
+    if (!writeFATHeaders(card, fatStart + fatSize, fatSize)) return false;
+
+    // Write empty root directory (cluster 2)
+    if (!writeRootDir(card, dataStart, sectorsPerCluster)) return false;
+
+    return true;
+}
+
+// ===============================
+// Fast remount after format
+// ===============================
+// The card is still initialised on sdSpi, so there is no need to
+// tear the bus down. Re-read the boot record, check it against
+// the layout just written, then let SdFat mount the volume.
+static bool remountAfterFormat(const Fat32Layout &layout,
+                               const char* &mismatch,
+                               uint32_t &elapsedMs) {
+    uint32_t start = millis();
+    SdCard *card = sd.card();
+    Sector s;
+
+    mismatch = nullptr;
+
+    bool ok = card->syncDevice() && card->readSector(0, s.b);
+    if (ok) {
+        uint32_t partStart = mbrFirstPartition(s.b);
+        ok = card->readSector(partStart, s.b);
+
+        FatVolumeInfo vol;
+        if (ok && layout.status == LAYOUT_OK) {
+            if (!parseFatBootSector(s.b, partStart, vol)) {
+                mismatch = "boot sector";
+            } else {
+                mismatch = fat32LayoutMismatch(layout, vol);
+            }
+            ok = (mismatch == nullptr);
+        }
+    }
+
+    if (ok) ok = sd.volumeBegin();
+
+    elapsedMs = millis() - start;
+    return ok;
+}
+
+// ===============================
+// UI wrapper around quickFormat()
+// ===============================
+void runFormat() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 10);
+    M5.Display.println(" Quick Format\n");
+    M5.Display.println(" ENTER: format");
+    M5.Display.println(" BKSP: abort");
+
+    // Wait for ENTER or BACKSPACE
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    // --- Formatting Screen ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (!initCard()) {
+        waitForInput();
+        return;
+    }
+
+    // Probed geometry for this card, if any
+    uint32_t pageSectors = 0, eraseSectors = 0;
+    uint8_t openSegments = 0;
+    cid_t cid;
+    if (sd.card()->readCID(&cid)) {
+        geometryLoad(cid.mid, cidSerial(cid), pageSectors, eraseSectors, openSegments);
+    }
+
+    M5.Display.println(" Formatting...");
+    M5.Display.setCursor(0, 25);
+    M5.Display.println(" Please wait");
+    if (eraseSectors) {
+        M5.Display.setCursor(0, 75);
+        M5.Display.printf(" Aligned to %lu KB blocks\n", (unsigned long)(eraseSectors / 2));
+    }
+
+    // --- Perform quick format (silent), then straight on to the remount ---
+    uint32_t start = millis();
+    Fat32Layout layout;
+    bool ok = quickFormat(sd, layout, eraseSectors, pageSectors);
+    const uint32_t formatMs = millis() - start;
+
+    // --- Remount on the live HSPI session ---
+    const char* mismatch = nullptr;
+    uint32_t remountMs = 0;
+    bool mounted = ok && remountAfterFormat(layout, mismatch, remountMs);
+
+    // Slow path: the card really lost its state — full re-init
+    if (ok && !mounted && !mismatch) {
+        uint32_t t = millis();
+        mounted = sd.begin(SD_CONFIG);
+        remountMs += millis() - t;
+    }
+
+    // --- Result Screen ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (ok && mounted) {
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        M5.Display.println("Format OK");
+
+        uint8_t fs = sd.vol()->fatType();
+        M5.Display.setCursor(0, 20);
+        M5.Display.printf("Filesystem: FAT%d\n", fs);
+        M5.Display.printf(" Format: %lu ms\n", (unsigned long)formatMs);
+        M5.Display.printf(" Remount: %lu ms%s\n", (unsigned long)remountMs,
+                          layout.status == LAYOUT_OK ? ", VBR match" : "");
+
+        SdFile test;
+        if (test.open("format_ok.txt", O_RDWR | O_CREAT | O_TRUNC)) {
+            test.println("Cardputer SD Tool format check");
+            test.close();
+            M5.Display.println(" Test file written");
+        } else {
+            M5.Display.println(" Test file FAILED");
+        }
+
+    } else {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("Format Failed");
+        M5.Display.setCursor(0, 20);
+        if (mismatch) {
+            M5.Display.printf("VBR mismatch: %s\n", mismatch);
+        } else {
+            M5.Display.println(ok ? "Card init failed" : "Format error");
+        }
+    }
+
+    waitForInput();
+}
+
+
+// ===============================
+// FAT Analyzer screen
+// ===============================
+
+static bool analyzerProgress(uint8_t percent) {
+    M5.Display.setCursor(0, 45);
+    M5.Display.printf(" Progress: %d%%   ", percent);
+    return !abortPressed();
+}
+
+void runAnalyzer() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 10);
+    M5.Display.println(" FAT Analyzer\n");
+    M5.Display.println(" Read-only FAT/dir scan");
+    M5.Display.println(" ENTER: start");
+    M5.Display.println(" BKSP: abort");
+
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (!initCard()) {
+        waitForInput();
+        return;
+    }
+
+    M5.Display.println(" Analyzing...");
+
+    static FatReport rep;
+    FatAnalyzeResult res = analyzeFat(sd.card(), rep, analyzerProgress);
+
+    if (res != ANALYZE_OK) {
+        const char* msg = "Read error";
+        switch (res) {
+            case ANALYZE_NOT_FAT:   msg = "No FAT volume";        break;
+            case ANALYZE_EXFAT:     msg = "exFAT not supported";  break;
+            case ANALYZE_FAT12:     msg = "FAT12 not supported";  break;
+            case ANALYZE_NO_MEMORY: msg = "Not enough RAM";       break;
+            case ANALYZE_ABORTED:   msg = "Aborted by user";      break;
+            default:                                              break;
+        }
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.setCursor(0, 70);
+        M5.Display.printf(" %s\n", msg);
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        waitForInput();
+        return;
+    }
+
+    // --- RESULT SCREEN ---
+    uint32_t clusterKB = rep.vol.sectorsPerCluster / 2;
+    uint64_t freeMB = (uint64_t)rep.freeClusters * clusterKB / 1024;
+    uint32_t freePct = (uint64_t)rep.freeClusters * 100 / rep.vol.clusterCount;
+    bool clean = !rep.lostClusters && !rep.crossLinks &&
+                 !rep.brokenChains && !rep.sizeMismatches;
+
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.printf(" FAT%d, %luKB clusters\n", rep.vol.fatType, (unsigned long)clusterKB);
+    M5.Display.printf(" Free: %llu MB (%lu%%)\n", freeMB, (unsigned long)freePct);
+    M5.Display.printf(" Files: %lu  Dirs: %lu\n",
+                      (unsigned long)rep.files, (unsigned long)rep.dirs);
+    M5.Display.printf(" Fragmented: %lu\n", (unsigned long)rep.fragmentedFiles);
+    M5.Display.printf(" Lost: %lu  X-links: %lu\n",
+                      (unsigned long)rep.lostClusters, (unsigned long)rep.crossLinks);
+    M5.Display.printf(" Broken: %lu  Size: %lu\n",
+                      (unsigned long)rep.brokenChains, (unsigned long)rep.sizeMismatches);
+    M5.Display.printf(" Time: %.1f s\n", (rep.fatMs + rep.walkMs) / 1000.0f);
+
+    M5.Display.setTextColor(clean ? TFT_GREEN : TFT_RED, TFT_BLACK);
+    M5.Display.println(clean ? " Structure OK" : " Errors found");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.println("\n ENTER: worst files");
+
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
+
+    // --- WORST FRAGMENTED FILES ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Most fragmented:\n");
+
+    if (rep.worst[0].fragments == 0) {
+        M5.Display.println(" None");
+    }
+    for (int i = 0; i < FAT_WORST_FILES && rep.worst[i].fragments; i++) {
+        M5.Display.printf(" %-12s %4lu frags\n", rep.worst[i].name,
+                          (unsigned long)rep.worst[i].fragments);
+    }
+
+    waitForInput();
+}
+
+
+// --- Return to menu ---
+void waitForInput() {
+    M5.Display.println("\n Press ENTER to return");
+
+    // ENTER or BACKSPACE, pressed after the result was drawn
+    waitForEnter();
+
+    // Return to menu cleanly
+    currentState = MENU;
+    drawMenu();
+}
+
+// ===============================
+// Memory screen
+// ===============================
+// The I/O arena (io_arena.h) and the most each mode has borrowed
+// from it since boot, two modes per row
+void showMemory() {
+    M5.Display.fillScreen(TFT_BLACK);
     M5.Display.setCursor(0, 0);
-    M5.Display.printf(" Result: %s\nErrors: %d\n",
-                      err ? "FAIL" : "PASS", err);
+    M5.Display.println(" Memory\n");
+
+    if (!arenaSize()) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println(" No I/O arena (low RAM)");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    } else {
+        M5.Display.printf(" Arena %lu KB %s\n", (unsigned long)(arenaSize() >> 10),
+                          arenaInPsram() ? "PSRAM" : "internal");
+        M5.Display.printf(" Peak %lu KB  heap %lu KB\n", (unsigned long)(arenaPeak() >> 10),
+                          (unsigned long)(ESP.getFreeHeap() >> 10));
+    }
+
+    const ArenaModeStats *modes;
+    int n = arenaModes(modes);
+    if (n == 0) M5.Display.println(" No test run yet");
+    for (int i = 0; i < n; i += 2) {
+        M5.Display.printf(" %-7.7s%4luK", modes[i].name,
+                          (unsigned long)((modes[i].peakBytes + 1023) >> 10));
+        if (i + 1 < n) {
+            M5.Display.printf(" %-7.7s%4luK", modes[i + 1].name,
+                              (unsigned long)((modes[i + 1].peakBytes + 1023) >> 10));
+        }
+        M5.Display.println();
+    }
 
     waitForInput();
 }
 
 // ===============================
-// FAT32 Quick Formatter — Core Types
+// History screen
 // ===============================
+// Speed results for the inserted card, oldest first, with the
+// change between the first and latest run.
 
-// A simple 512‑byte sector buffer
-struct Sector {
-    uint8_t b[512];
-};
-
-// Zero a sector
-static inline void clearSector(Sector &s) {
-    memset(s.b, 0, 512);
+static int percentChange(uint32_t from, uint32_t to) {
+    if (from == 0) return 0;
+    return (int)(((int64_t)to - (int64_t)from) * 100 / (int64_t)from);
 }
 
-// -------------------------------
-// Cluster size selection
-// -------------------------------
-// FAT32 rules:
-//  - ≤32GB → 32KB clusters
-//  - ≥64GB → 64KB clusters
-//  - FAT16 only for ≤2GB
-static inline uint32_t chooseClusterSize(uint64_t sizeMB) {
-    if (sizeMB <= 2048) {
-        // FAT16 case — handled separately in quickFormat()
-        return 0;
+void showHistory() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+
+    if (!initCard()) {
+        waitForInput();
+        return;
     }
-    if (sizeMB <= 32768) {
-        return 32 * 1024;   // 32KB
+
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println("Read CID Failed");
+        waitForInput();
+        return;
     }
-    return 64 * 1024;       // 64KB
-}
 
-// -------------------------------
-// Partition alignment
-// -------------------------------
-// SDXC requires 1MB alignment.
-// SDHC can use 128KB or 1MB — we use 1MB for simplicity.
-static inline uint32_t partitionStartSector(uint64_t sizeMB) {
-    return 2048;   // 2048 * 512 = 1MB
-}
+    const int ROWS = 5;
+    static HistoryRecord recs[ROWS];
+    uint32_t psn = cidSerial(cid);
+    int n = historyLoad(cid.mid, psn, HIST_SPEED, recs, ROWS);
 
-// -------------------------------
-// FAT32 BPB template builder
-// -------------------------------
-static void buildFAT32BPB(
-    Sector &bpb,
-    uint32_t totalSectors,
-    uint32_t fatStart,
-    uint32_t fatSize,
-    uint32_t rootCluster,
-    uint32_t sectorsPerCluster
-) {
-    clearSector(bpb);
+    M5.Display.printf(" History  SN %08lX\n", (unsigned long)psn);
 
-    // Jump instruction + OEM name
-    bpb.b[0] = 0xEB;
-    bpb.b[1] = 0x58;
-    bpb.b[2] = 0x90;
-    memcpy(&bpb.b[3], "MSDOS5.0", 8);
+    if (n == 0) {
+        M5.Display.println(" No speed tests yet");
+    } else {
+        M5.Display.println("    #  Write  Read   Lat");
+        for (int i = 0; i < n; i++) {
+            M5.Display.printf(" %4lu %5.1f %5.1f %4lums\n",
+                              (unsigned long)recs[i].seq,
+                              recs[i].writeKBs / 1024.0f,
+                              recs[i].readKBs / 1024.0f,
+                              (unsigned long)(recs[i].maxLatencyUs / 1000));
+        }
 
-    // Bytes per sector
-    bpb.b[11] = 0x00; // 512 bytes (0x0200 little endian)
-    bpb.b[12] = 0x02;
+        if (n > 1) {
+            int dw = percentChange(recs[0].writeKBs, recs[n - 1].writeKBs);
+            int dr = percentChange(recs[0].readKBs, recs[n - 1].readKBs);
+            M5.Display.setTextColor((dw <= -20 || dr <= -20) ? TFT_RED : TFT_GREEN,
+                                    TFT_BLACK);
+            M5.Display.printf(" Trend: W %+d%%  R %+d%%\n", dw, dr);
+            M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        }
+    }
 
-    // Sectors per cluster
-    bpb.b[13] = sectorsPerCluster;
+    HistoryRecord last;
+    if (historyLoad(cid.mid, psn, HIST_INTEGRITY, &last, 1) == 1) {
+        M5.Display.printf(" Integrity #%lu: %s\n", (unsigned long)last.seq,
+                          last.errors ? "FAIL" : "PASS");
+    }
 
-    // Reserved sectors (BPB + FSInfo + backup)
-    bpb.b[14] = 0x20; // 32 reserved sectors (typical)
-    bpb.b[15] = 0x00;
+    waitForInput();
+}
 
-    // Number of FATs
-    bpb.b[16] = 0x02;
+// ===============================
+// Capacity Probe screen
+// ===============================
 
-    // Root entries (FAT12/16 only)
-    bpb.b[17] = 0x00;
-    bpb.b[18] = 0x00;
+static bool probeProgress(uint8_t percent) {
+    M5.Display.setCursor(0, 70);
+    M5.Display.printf(" Progress: %d%%   ", percent);
+    return !abortPressed();
+}
 
-    // Total sectors (16‑bit) — zero for FAT32
-    bpb.b[19] = 0x00;
-    bpb.b[20] = 0x00;
+void runCapacityProbe() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 10);
+    M5.Display.println(" Capacity Probe\n");
+    M5.Display.printf(" %d tagged sectors across\n", PROBE_DEFAULT);
+    M5.Display.println(" the card, then restored");
+    M5.Display.println(" ENTER: start");
+    M5.Display.println(" BKSP: abort");
 
-    // Media descriptor
-    bpb.b[21] = 0xF8;
+    if (!waitForEnter()) {
+        currentState = MENU;
+        drawMenu();
+        return;
+    }
 
-    // FAT size (16‑bit) — zero for FAT32
-    bpb.b[22] = 0x00;
-    bpb.b[23] = 0x00;
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
 
-    // Sectors per track / heads — dummy geometry
-    bpb.b[24] = 0x3F;
-    bpb.b[25] = 0x00;
-    bpb.b[26] = 0xFF;
-    bpb.b[27] = 0x00;
+    if (!initCard()) {
+        waitForInput();
+        return;
+    }
 
-    // Hidden sectors (partition start)
-    bpb.b[28] = (uint8_t)(fatStart & 0xFF);
-    bpb.b[29] = (uint8_t)((fatStart >> 8) & 0xFF);
-    bpb.b[30] = (uint8_t)((fatStart >> 16) & 0xFF);
-    bpb.b[31] = (uint8_t)((fatStart >> 24) & 0xFF);
+    M5.Display.println(" Probing...");
 
-    // Total sectors (32‑bit)
-    bpb.b[32] = (uint8_t)(totalSectors & 0xFF);
-    bpb.b[33] = (uint8_t)((totalSectors >> 8) & 0xFF);
-    bpb.b[34] = (uint8_t)((totalSectors >> 16) & 0xFF);
-    bpb.b[35] = (uint8_t)((totalSectors >> 24) & 0xFF);
+    SdCardDevice dev(sd.card());
+    ProbeReport rep;
+    ProbeResult res = probeCapacity(&dev, PROBE_DEFAULT, esp_random(), rep, probeProgress);
 
-    // FAT32 extended fields
-    bpb.b[36] = (uint8_t)(fatSize & 0xFF);
-    bpb.b[37] = (uint8_t)((fatSize >> 8) & 0xFF);
-    bpb.b[38] = (uint8_t)((fatSize >> 16) & 0xFF);
-    bpb.b[39] = (uint8_t)((fatSize >> 24) & 0xFF);
+    if (res == PROBE_NO_MEMORY || res == PROBE_TOO_SMALL) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.setCursor(0, 90);
+        M5.Display.println(res == PROBE_NO_MEMORY ? " Not enough RAM" : " Card too small");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        waitForInput();
+        return;
+    }
 
-    // Flags
-    bpb.b[40] = 0x00;
-    bpb.b[41] = 0x00;
+    // --- RESULT SCREEN ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.printf(" Advertised: %lu MB\n", (unsigned long)(rep.sectors / 2048));
+    M5.Display.printf(" Probes: %lu  good: %lu\n",
+                      (unsigned long)rep.probes, (unsigned long)rep.good);
+    M5.Display.printf(" Bad: %lu  I/O errors: %lu\n",
+                      (unsigned long)rep.bad, (unsigned long)rep.ioErrors);
+
+    const char* verdict = "Capacity looks real";
+    uint16_t color = TFT_GREEN;
+    switch (res) {
+        case PROBE_FAKE:     verdict = "FAKE capacity";     color = TFT_RED;    break;
+        case PROBE_IO_ERROR: verdict = "I/O errors";        color = TFT_YELLOW; break;
+        case PROBE_ABORTED:  verdict = "Aborted by user";   color = TFT_YELLOW; break;
+        default:                                                                break;
+    }
+    M5.Display.setTextColor(color, TFT_BLACK);
+    M5.Display.printf(" %s\n", verdict);
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
 
-    // Version
-    bpb.b[42] = 0x00;
-    bpb.b[43] = 0x00;
+    if (rep.bad) {
+        M5.Display.printf(" First bad at %lu MB\n", (unsigned long)(rep.firstBad / 2048));
+    }
+    if (!rep.restored) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println(" Restore failed!");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    }
 
-    // Root cluster
-    bpb.b[44] = (uint8_t)(rootCluster & 0xFF);
-    bpb.b[45] = (uint8_t)((rootCluster >> 8) & 0xFF);
-    bpb.b[46] = (uint8_t)((rootCluster >> 16) & 0xFF);
-    bpb.b[47] = (uint8_t)((rootCluster >> 24) & 0xFF);
+    waitForInput();
+}
 
-    // FSInfo sector
-    bpb.b[48] = 0x01;
-    bpb.b[49] = 0x00;
+// ===============================
+// Soak Test screen
+// ===============================
+// Repeated raw write/verify of one contiguous file's sectors.
+// Wear shows up on the curve: write (green) and read (cyan)
+// MB/s per cycle, red ticks where a cycle had bad sectors.
+
+static const uint32_t SOAK_REGIONS_MB[] = { 8, 64, 256, 1024 };
+static const uint32_t SOAK_CYCLE_COUNTS[] = { 10, 100, 1000, 10000, 0 };
+static const int SOAK_REGION_OPTIONS = sizeof(SOAK_REGIONS_MB) / sizeof(SOAK_REGIONS_MB[0]);
+static const int SOAK_CYCLE_OPTIONS = sizeof(SOAK_CYCLE_COUNTS) / sizeof(SOAK_CYCLE_COUNTS[0]);
+
+static uint32_t soakCycleTarget = 0;
+
+static void drawSoakCurve(const SoakStats &st, int y0, int h) {
+    M5.Display.fillRect(0, y0, 240, h, TFT_BLACK);
+    M5.Display.drawFastHLine(0, y0 + h - 1, 240, TFT_DARKGREY);
+    if (st.points == 0) return;
+
+    uint32_t top = 1;
+    for (int i = 0; i < st.points; i++) {
+        if (st.curve[i].writeKBs > top) top = st.curve[i].writeKBs;
+        if (st.curve[i].readKBs > top) top = st.curve[i].readKBs;
+    }
 
-    // Backup boot sector
-    bpb.b[50] = 0x06;
-    bpb.b[51] = 0x00;
+    auto yOf = [&](uint32_t kbs) {
+        return y0 + h - 2 - (int)((uint64_t)kbs * (h - 3) / top);
+    };
+
+    for (int i = 0; i < st.points; i++) {
+        int x = i * 2;
+        if (i > 0) {
+            M5.Display.drawLine(x - 2, yOf(st.curve[i - 1].readKBs),
+                                x, yOf(st.curve[i].readKBs), TFT_CYAN);
+            M5.Display.drawLine(x - 2, yOf(st.curve[i - 1].writeKBs),
+                                x, yOf(st.curve[i].writeKBs), TFT_GREEN);
+        } else {
+            M5.Display.drawPixel(x, yOf(st.curve[i].readKBs), TFT_CYAN);
+            M5.Display.drawPixel(x, yOf(st.curve[i].writeKBs), TFT_GREEN);
+        }
+        if (st.curve[i].badSectors) {
+            M5.Display.drawFastVLine(x, y0, 5, TFT_RED);
+        }
+    }
+}
 
-    // Drive number
-    bpb.b[64] = 0x80;
+// --- REGION: one contiguous file, then raw sector I/O ---
+// Fills in firstSector / sectors; the caller removes soak.bin
+static bool soakRegion(uint32_t regionMB, SoakConfig &cfg) {
+    SdFile f;
+    uint32_t first = 0, last = 0;
 
-    // Boot signature
-    bpb.b[66] = 0x29;
+    sd.remove("soak.bin");
+    if (!f.createContiguous("soak.bin", regionMB << 20) ||
+        !f.contiguousRange(&first, &last)) {
+        if (f.isOpen()) f.close();
+        sd.remove("soak.bin");
+        return false;
+    }
+    f.close();
 
-    // Volume ID (random-ish)
-    uint32_t volId = 0x12345678;
-    memcpy(&bpb.b[67], &volId, 4);
+    cfg.firstSector = first;
+    cfg.sectors     = (last - first + 1) & ~(SOAK_CHUNK_SECTORS - 1);
+    return true;
+}
 
-    // Volume label
-    memcpy(&bpb.b[71], "NO NAME    ", 11);
+static bool soakProgress(const SoakStats &st, SoakPhase phase, uint8_t percent) {
+    M5.Display.setCursor(0, 0);
+    if (soakCycleTarget) {
+        M5.Display.printf(" Cycle %lu / %lu   \n", (unsigned long)(st.cycles + 1),
+                          (unsigned long)soakCycleTarget);
+    } else {
+        M5.Display.printf(" Cycle %lu (to fail)   \n", (unsigned long)(st.cycles + 1));
+    }
+    M5.Display.printf(" %s %3d%% %s    \n", phase == SOAK_WRITE ? "Write " : "Verify",
+                      percent, soakPatternName(st.cycles % SOAK_PAT_COUNT));
+
+    if (st.cycles) {
+        M5.Display.printf(" Last W %.1f R %.1f MB/s  \n",
+                          st.last.writeKBs / 1024.0f, st.last.readKBs / 1024.0f);
+        M5.Display.setTextColor(st.badSectors ? TFT_RED : TFT_GREEN, TFT_BLACK);
+        M5.Display.printf(" Bad sectors: %lu   \n", (unsigned long)st.badSectors);
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    }
 
-    // File system type
-    memcpy(&bpb.b[82], "FAT32   ", 8);
+    // A cycle just finished — extend the curve
+    if (phase == SOAK_WRITE && percent == 0) drawSoakCurve(st, 60, 75);
 
-    // Boot sector signature
-    bpb.b[510] = 0x55;
-    bpb.b[511] = 0xAA;
+    return !abortPressed();
 }
 
-// -------------------------------
-// FSInfo sector builder
-// -------------------------------
-static void buildFSInfo(Sector &fs) {
-    clearSector(fs);
+void runSoakTest() {
+    int region = 1;
+    int count = 2;
+    bool stopOnFail = true;
 
-    // Lead signature
-    fs.b[0] = 0x52;
-    fs.b[1] = 0x52;
-    fs.b[2] = 0x61;
-    fs.b[3] = 0x41;
+    // --- OPTIONS ---
+    while (true) {
+        M5.Display.fillScreen(TFT_BLACK);
+        M5.Display.setCursor(0, 0);
+        M5.Display.println(" Soak Test\n");
+        M5.Display.printf(" R: region  %lu MB\n", (unsigned long)SOAK_REGIONS_MB[region]);
+        if (SOAK_CYCLE_COUNTS[count]) {
+            M5.Display.printf(" N: cycles  %lu\n", (unsigned long)SOAK_CYCLE_COUNTS[count]);
+        } else {
+            M5.Display.println(" N: cycles  until fail");
+        }
+        M5.Display.printf(" S: stop on fail  %s\n\n", stopOnFail ? "yes" : "no");
+        M5.Display.println(" ENTER: start");
+        M5.Display.println(" BKSP: back");
 
-    // Struct signature
-    fs.b[484] = 0x72;
-    fs.b[485] = 0x72;
-    fs.b[486] = 0x41;
-    fs.b[487] = 0x61;
+        char key = inputGetKey();
+        if (key == INPUT_BACK) {
+            currentState = MENU;
+            drawMenu();
+            return;
+        }
+        if (key == INPUT_ENTER) break;
+        if (key == 'r') region = (region + 1) % SOAK_REGION_OPTIONS;
+        if (key == 'n') count = (count + 1) % SOAK_CYCLE_OPTIONS;
+        if (key == 's') stopOnFail = !stopOnFail;
+    }
 
-    // Free cluster count unknown
-    fs.b[488] = 0xFF;
-    fs.b[489] = 0xFF;
-    fs.b[490] = 0xFF;
-    fs.b[491] = 0xFF;
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
 
-    // Next free cluster unknown
-    fs.b[492] = 0xFF;
-    fs.b[493] = 0xFF;
-    fs.b[494] = 0xFF;
-    fs.b[495] = 0xFF;
+    if (!initSD()) {
+        waitForInput();
+        return;
+    }
 
-    // Boot sector signature
-    fs.b[510] = 0x55;
-    fs.b[511] = 0xAA;
-}
+    const uint32_t regionMB = SOAK_REGIONS_MB[region];
+    SoakConfig cfg;
+    if (!soakRegion(regionMB, cfg)) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println(" Not enough contiguous");
+        M5.Display.println(" free space");
+        waitForInput();
+        return;
+    }
+    cfg.cycles      = SOAK_CYCLE_COUNTS[count];
+    cfg.stopOnFail  = stopOnFail;
+    cfg.seed        = esp_random();
+    soakCycleTarget = cfg.cycles;
 
-// ===============================
-// FAT32 Quick Formatter — Raw I/O Helpers
-// ===============================
+    static SoakStats st;
+    SdCardDevice dev(sd.card());
+    SoakResult res = runSoak(&dev, cfg, st, soakProgress);
 
-// Write a 512-byte sector to the card
-static bool writeSectorRaw(SdCard *card, uint32_t sector, const Sector &s) {
-    return card->writeSector(sector, s.b);
-}
+    sd.remove("soak.bin");
+    if (res == SOAK_NO_MEMORY) {
+        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+        M5.Display.println(" Not enough RAM");
+        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+        waitForInput();
+        return;
+    }
 
-// Clear a sector on the card
-static bool clearSectorRaw(SdCard *card, uint32_t sector) {
-    Sector s;
-    clearSector(s);
-    return card->writeSector(sector, s.b);
+    if (st.cycles) {
+        recordHistory(HIST_SOAK, regionMB, st.last.writeKBs, st.last.readKBs,
+                      st.maxLatencyUs, st.badSectors);
+    }
+
+    // --- RESULT SCREEN ---
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.setTextColor(st.badSectors ? TFT_RED : TFT_GREEN, TFT_BLACK);
+    M5.Display.printf(" Soak: %s%s\n", st.badSectors ? "FAIL" : "PASS",
+                      res == SOAK_ABORTED ? " (aborted)" : "");
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+    M5.Display.printf(" Cycles %lu  failed %lu\n",
+                      (unsigned long)st.cycles, (unsigned long)st.failedCycles);
+    M5.Display.printf(" Bad %lu  first fail #%lu\n",
+                      (unsigned long)st.badSectors, (unsigned long)st.firstFailCycle);
+    M5.Display.printf(" W %.1f>%.1f MB/s %+d%%\n",
+                      st.first.writeKBs / 1024.0f, st.last.writeKBs / 1024.0f,
+                      percentChange(st.first.writeKBs, st.last.writeKBs));
+    M5.Display.printf(" R %.1f>%.1f MB/s %+d%%\n",
+                      st.first.readKBs / 1024.0f, st.last.readKBs / 1024.0f,
+                      percentChange(st.first.readKBs, st.last.readKBs));
+
+    drawSoakCurve(st, 62, 46);
+    M5.Display.setCursor(0, 110);
+    waitForInput();
 }
 
 // ===============================
-// MBR Writer
+// Sim Self-Test screen
 // ===============================
-static bool writeMBR(SdCard *card, uint32_t partStart, uint32_t totalSectors) {
-    Sector mbr;
-    clearSector(mbr);
-
-    // Partition entry at offset 446
-    uint8_t *p = &mbr.b[446];
+// The scenarios and checks are in sim_selftest.h; one row each.
 
-    p[0] = 0x00;          // Boot flag
-    p[1] = 0x20;          // CHS begin (dummy)
-    p[2] = 0x21;
-    p[3] = 0x00;
+void runSimSelfTest() {
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Sim Self-Test");
+    M5.Display.println(" Name    Prb  Soak  ms");
 
-    p[4] = 0x0C;          // Partition type = FAT32 LBA
-    p[5] = 0xFE;          // CHS end (dummy)
-    p[6] = 0xFF;
-    p[7] = 0xFF;
+    static SimCard sim;
+    int misses = 0;
+    float engineMBs = 0;
 
-    // LBA start
-    p[8]  = (uint8_t)(partStart & 0xFF);
-    p[9]  = (uint8_t)((partStart >> 8) & 0xFF);
-    p[10] = (uint8_t)((partStart >> 16) & 0xFF);
-    p[11] = (uint8_t)((partStart >> 24) & 0xFF);
+    for (int i = 0; i < SIM_SCENARIO_COUNT; i++) {
+        SimOutcome out;
+        if (!simRunScenario(sim, i, out)) {
+            M5.Display.setTextColor(TFT_RED, TFT_BLACK);
+            M5.Display.println(" Not enough RAM");
+            M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
+            waitForInput();
+            return;
+        }
+        if (i == 0) engineMBs = out.engineMBs;
+        if (!out.ok) misses++;
 
-    // Total sectors in partition
-    uint32_t partSize = totalSectors - partStart;
-    p[12] = (uint8_t)(partSize & 0xFF);
-    p[13] = (uint8_t)((partSize >> 8) & 0xFF);
-    p[14] = (uint8_t)((partSize >> 16) & 0xFF);
-    p[15] = (uint8_t)((partSize >> 24) & 0xFF);
+        M5.Display.setTextColor(out.ok ? TFT_GREEN : TFT_RED, TFT_BLACK);
+        M5.Display.printf(" %-7s %-4s %-4s %3lu %s\n", SIM_SCENARIOS[i].name,
+                          out.probeFlag ? "FLAG" : "pass", out.soakFlag ? "FLAG" : "pass",
+                          (unsigned long)(out.maxLatencyUs / 1000), out.ok ? "ok" : "MISS");
+    }
 
-    // Signature
-    mbr.b[510] = 0x55;
-    mbr.b[511] = 0xAA;
+    M5.Display.setTextColor(misses ? TFT_RED : TFT_GREEN, TFT_BLACK);
+    M5.Display.printf(" %s  engine %.1f MB/s\n", misses ? "MISS" : "All OK", engineMBs);
+    M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
 
-    return writeSectorRaw(card, 0, mbr);
+    waitForInput();
 }
 
 // ===============================
-// BPB Writer
+// Serial command protocol
 // ===============================
-static bool writeBPB(SdCard *card, uint32_t partStart, const Sector &bpb) {
-    // Write main BPB
-    if (!writeSectorRaw(card, partStart, bpb)) return false;
+// The same engines as the menu screens, driven by a host over USB
+// CDC (protocol in serial_cmd.h). Results go back as RESULT lines;
+// the screen only says which command is running.
 
-    // Backup boot sector at partStart + 6
-    if (!writeSectorRaw(card, partStart + 6, bpb)) return false;
+static const char *serialName = "";     // Running command, for PROGRESS / ERROR
 
-    return true;
+static bool serialKeepGoing() {
+    return !cmdAbortRequested(Serial) && !abortPressed();
 }
 
-// ===============================
-// FSInfo Writer
-// ===============================
-static bool writeFSInfo(SdCard *card, uint32_t partStart, const Sector &fs) {
-    // FSInfo at partStart + 1
-    if (!writeSectorRaw(card, partStart + 1, fs)) return false;
+static bool serialProgress(uint8_t percent) {
+    cmdProgress(Serial, serialName, percent);
+    return serialKeepGoing();
+}
 
-    // Backup FSInfo at partStart + 7
-    if (!writeSectorRaw(card, partStart + 7, fs)) return false;
+static bool serialFail(const char *why) {
+    Serial.printf("ERROR %s %s\n", serialName, why);
+    return false;
+}
 
-    return true;
+static bool serialCard() {
+    return sd.cardBegin(SD_CONFIG) || serialFail("card init failed");
 }
 
-// ===============================
-// FAT Header Writer
-// ===============================
-// FAT32 requires the first two FAT entries:
-//  - FAT[0] = media descriptor + reserved bits
-//  - FAT[1] = end-of-chain marker
-static bool writeFATHeaders(
-    SdCard *card,
-    uint32_t fatStart,
-    uint32_t fatSize
-) {
-    Sector s;
-    clearSector(s);
+static bool serialMount() {
+    return sd.begin(SD_CONFIG) || serialFail("mount failed");
+}
 
-    // FAT[0]
-    s.b[0] = 0xF8;  // Media descriptor
-    s.b[1] = 0xFF;
-    s.b[2] = 0xFF;
-    s.b[3] = 0x0F;
+static bool serialMountTraced() {
+    if (!serialMount()) return false;
+    fsTrace.attach(sd.card());
+    if (!sd.vol()->begin(&fsTrace)) return serialMount();
+    fsTrace.reset();
+    return true;
+}
 
-    // FAT[1]
-    s.b[4] = 0xFF;
-    s.b[5] = 0xFF;
-    s.b[6] = 0xFF;
-    s.b[7] = 0x0F;
+// Appended to a RESULT line: the traced test's sector transfers by
+// kind (fs_trace.h), then the line ends
+static void printTrace(Stream &io) {
+    const TraceCounts &c = fsTrace.counts();
+    for (int k = 0; k < TRACE_KINDS; k++) {
+        const char *n = FsTrace::kindName((TraceKind)k);
+        io.printf(" fs_%s_r=%lu fs_%s_w=%lu fs_%s_us=%lu", n, (unsigned long)c.readSectors[k],
+                  n, (unsigned long)c.writeSectors[k], n, (unsigned long)c.us[k]);
+    }
+    io.printf(" fs_dir_updates=%lu fs_cache_miss=%lu fs_cache_flush=%lu fs_traced=%d\n",
+              (unsigned long)c.writeOps[TRACE_DIR], (unsigned long)c.cacheMisses,
+              (unsigned long)c.cacheFlushes, fsTrace.layoutKnown());
+}
 
-    // Write first FAT sector
-    if (!writeSectorRaw(card, fatStart, s)) return false;
+// Values can't hold spaces: "Silicon Power" → "Silicon_Power"
+static void printToken(Stream &io, const char *key, const char *text) {
+    io.printf(" %s=", key);
+    for (const char *p = text; *p; p++) io.write((uint8_t)(*p == ' ' ? '_' : *p));
+}
 
-    // Clear remaining FAT sectors
-    for (uint32_t i = 1; i < fatSize; i++) {
-        if (!clearSectorRaw(card, fatStart + i)) return false;
+// --- info: triage ---
+static bool serialInfo(const CmdArgs &args, Stream &io) {
+    if (!serialCard()) return false;
+
+    static TriageReport r;
+    if (!gatherTriage(sd.card(), r)) return serialFail("read CID failed");
+    uint8_t fs = sd.volumeBegin() ? sd.fatType() : 0;
+
+    io.printf("RESULT info mid=0x%02X oid=%s pnm=%s rev=%d.%d psn=0x%08lX date=%d-%02d cid_crc=%s",
+              r.cid.mid, r.cid.oid, r.cid.pnm, r.cid.prvMajor, r.cid.prvMinor,
+              (unsigned long)r.cid.psn, r.cid.year, r.cid.month, r.cid.crcOk ? "ok" : "bad");
+    printToken(io, "maker", r.maker ? r.maker->name : "unknown");
+    printToken(io, "fs", fsTypeName(fs));
+    io.println();
+
+    io.printf("RESULT info sectors=%lu", (unsigned long)r.reportedSectors);
+    if (r.haveCsd) {
+        io.printf(" csd_sectors=%lu class=%s csd_version=%d ccc=0x%03X max_khz=%lu "
+                  "erase_blk_en=%d erase_unit=%d wp=%s",
+                  (unsigned long)r.csd.sectors, cardCapacityClass(r.csd), r.csd.structure + 1,
+                  r.csd.ccc, (unsigned long)r.csd.maxKHz, r.csd.eraseBlkEn,
+                  r.csd.eraseSectorSize, r.csd.permWriteProtect ? "perm" :
+                  r.csd.tmpWriteProtect ? "temp" : "none");
+    }
+    io.println();
+
+    if (r.haveSds) {
+        io.printf("RESULT info speed_class=%d uhs=%d video=%d app=%d au_sectors=%lu "
+                  "erase_size=%u erase_timeout_s=%d erase_offset_s=%d\n",
+                  r.sds.speedClass, r.sds.uhsGrade, r.sds.videoClass, r.sds.appClass,
+                  (unsigned long)r.sds.auSectors, r.sds.eraseSize, r.sds.eraseTimeoutS,
+                  r.sds.eraseOffsetS);
     }
 
+    io.printf("RESULT info seq_read_kbs=%lu seq_write_kbs=%lu rnd_read_iops=%lu "
+              "rnd_write_iops=%lu max_write_us=%lu bench_ms=%lu io_error=%d\n",
+              (unsigned long)r.bench.seqReadKBs, (unsigned long)r.bench.seqWriteKBs,
+              (unsigned long)r.bench.rndReadIops, (unsigned long)r.bench.rndWriteIops,
+              (unsigned long)r.bench.maxWriteUs, (unsigned long)r.bench.elapsedMs,
+              r.bench.ioError);
+    io.printf("RESULT info probes=%lu probe_bad=%lu probe_io_errors=%lu probe_restored=%d\n",
+              (unsigned long)r.probe.probes, (unsigned long)r.probe.bad,
+              (unsigned long)r.probe.ioErrors, r.probe.restored);
+
+    for (int i = 0; i < r.reasonCount; i++) {
+        io.printf("RESULT info");
+        printToken(io, "reason", r.reasons[i]);
+        io.println();
+    }
+    io.printf("RESULT info verdict=%s\n", r.suspect ? "SUSPECT" : "PASS");
     return true;
 }
 
-// ===============================
-// Root Directory Writer
-// ===============================
-// Root directory cluster is empty for Quick Format
-static bool writeRootDir(
-    SdCard *card,
-    uint32_t dataStart,
-    uint32_t sectorsPerCluster
-) {
-    // Root directory = cluster 2
-    uint32_t rootSector = dataStart;
-
-    for (uint32_t i = 0; i < sectorsPerCluster; i++) {
-        if (!clearSectorRaw(card, rootSector + i)) return false;
+// --- speed size=4k count=1280 driver=dma|arduino|both ---
+static bool serialSpeed(const CmdArgs &args, Stream &io) {
+    uint64_t size;
+    uint32_t count;
+    if (!args.size("size", SPEED_BLOCK_BYTES, size) || size < 512 || size % 512) {
+        return serialFail("size must be a multiple of 512");
     }
+    if (size > arenaFree()) return serialFail("size larger than the free arena (see memory)");
+    if (!args.number("count", SPEED_BLOCKS, count) || count == 0) return serialFail("bad count");
+
+    const char *driver = args.get("driver");
+    if (!driver) driver = "dma";
+    const bool both = strcmp(driver, "both") == 0;
+    const bool want[2] = { both || strcmp(driver, "arduino") == 0,
+                           both || strcmp(driver, "dma") == 0 };
+    if (!want[0] && !want[1]) return serialFail("driver must be dma, arduino or both");
+
+    static const SdDriverMode modes[2] = { SD_DRIVER_ARDUINO, SD_DRIVER_DMA };
+    bool ok = true;
+    for (int m = 0; m < 2 && ok; m++) {
+        if (!want[m]) continue;
+        sdDriver.setMode(modes[m]);
+
+        SpeedResult res;
+        const char *err = nullptr;
+        if (!serialMountTraced() || (err = speedPass(res, size, count, serialKeepGoing))) {
+            ok = err ? serialFail(err) : false;
+            break;
+        }
+        io.printf("RESULT speed driver=%s size=%lu count=%lu write_kbs=%lu read_kbs=%lu "
+                  "max_write_us=%lu", sdDriver.modeName(), (unsigned long)size,
+                  (unsigned long)count, (unsigned long)(res.writeMBs * 1024),
+                  (unsigned long)(res.readMBs * 1024), (unsigned long)res.maxLatencyUs);
+        printTrace(io);
+
+        // Only the menu's own test goes into the history, so trends compare like with like
+        if (modes[m] == SD_DRIVER_DMA && size == SPEED_BLOCK_BYTES && count == SPEED_BLOCKS) {
+            recordHistory(HIST_SPEED, SPEED_MB, (uint32_t)(res.writeMBs * 1024),
+                          (uint32_t)(res.readMBs * 1024), res.maxLatencyUs, 0);
+        }
+    }
+    sdDriver.setMode(SD_DRIVER_DMA);
+    return ok;
+}
 
+// --- cacheread size=4k ---
+static bool serialCacheRead(const CmdArgs &args, Stream &io) {
+    uint64_t size;
+    if (!args.size("size", SPEED_BLOCK_BYTES, size) || size < 512 || size % 512) {
+        return serialFail("size must be a multiple of 512");
+    }
+    if (size > arenaFree()) return serialFail("size larger than the free arena (see memory)");
+    if (!serialMountTraced()) return false;
+
+    CacheReadResult res;
+    const char *err = cacheReadPass(res, size, serialKeepGoing);
+    if (err) return serialFail(err);
+
+    io.printf("RESULT cacheread size=%lu write_kbs=%lu warm_read_kbs=%lu cold_read_kbs=%lu "
+              "cold_fresh=%d", (unsigned long)size, (unsigned long)(res.writeMBs * 1024),
+              (unsigned long)(res.warmMBs * 1024), (unsigned long)(res.coldMBs * 1024),
+              res.coldFresh);
+    printTrace(io);
     return true;
 }
 
-// ===============================
-// FAT32 Quick Formatter — Core quickFormat()
-// ===============================
-
-static bool quickFormat(SdFat &sd) {
-    SdCard *card = sd.card();
-    if (!card) return false;
-
-    uint64_t sectors64 = card->sectorCount();
-    if (sectors64 == 0) return false;
-
-    // Limit to 32-bit sector count (up to 2TB, we only target ≤256GB)
-    uint32_t totalSectors = (uint32_t)sectors64;
-
-    // Card size in MB
-    uint64_t sizeMB = (sectors64 * 512ULL) / (1024ULL * 1024ULL);
+// --- multi secs=5 ---
+static bool serialMultiProgress(int phase, uint8_t percent) {
+    return serialProgress((phase * 100 + percent) / (MS_DEFAULT_COUNT + 1));
+}
 
-    // FAT16 for ≤2GB — let SdFat handle that
-    if (sizeMB <= 2048) {
-        // Silent: no Serial
-        return sd.format(nullptr);
+static bool serialMulti(const CmdArgs &args, Stream &io) {
+    static const char* names[] = { "ok", "file_error", "no_memory", "aborted" };
+    uint32_t secs;
+    if (!args.number("secs", MULTI_PHASE_MS / 1000, secs) || secs < 1 || secs > 600) {
+        return serialFail("secs must be 1..600");
     }
+    if (!serialMountTraced()) return false;
+
+    static MsReport rep;
+    MsResult res = runMultiStream(sd, MS_DEFAULT_STREAMS, MS_DEFAULT_COUNT, secs * 1000,
+                                  rep, serialMultiProgress);
+    if (res != MS_OK) return serialFail(names[res]);
+
+    for (int i = 0; i < rep.count; i++) {
+        const MsStreamSpec &spec = MS_DEFAULT_STREAMS[i];
+        const MsStreamReport &s = rep.streams[i];
+        io.printf("RESULT multi stream=%s kind=%s record=%lu period_ms=%lu "
+                  "solo_kbs=%lu mixed_kbs=%lu solo_avg_us=%lu mixed_avg_us=%lu "
+                  "solo_p99_us=%lu mixed_p99_us=%lu solo_max_us=%lu mixed_max_us=%lu "
+                  "late=%lu errors=%lu interference_pct=%lu\n",
+                  spec.name, spec.writer ? "write" : "read", (unsigned long)spec.recordBytes,
+                  (unsigned long)spec.periodMs, (unsigned long)msKBs(s.solo),
+                  (unsigned long)msKBs(s.mixed), (unsigned long)msAvgUs(s.solo),
+                  (unsigned long)msAvgUs(s.mixed), (unsigned long)msP99Us(s.solo),
+                  (unsigned long)msP99Us(s.mixed), (unsigned long)s.solo.maxUs,
+                  (unsigned long)s.mixed.maxUs, (unsigned long)s.mixed.late,
+                  (unsigned long)(s.solo.errors + s.mixed.errors),
+                  (unsigned long)msInterference(s));
+    }
+    io.printf("RESULT multi stream=all");
+    printTrace(io);
+    return true;
+}
 
-    // Choose cluster size for FAT32
-    uint32_t clusterBytes = chooseClusterSize(sizeMB);
-    if (clusterBytes == 0) return false;
+// --- bench: the fixed sequence for comparing builds ---
+// The same steps, sizes and order every time, so RESULT lines from
+// different sdfat-* builds (platformio.ini) on the same card line
+// up; tools/sdbench.py collects and tabulates them. Not added to
+// the history, which compares runs of one build.
 
-    uint32_t sectorsPerCluster = clusterBytes / 512;
-    if (sectorsPerCluster == 0) return false;
+static const uint32_t BENCH_FILES = 64;
+static const int BENCH_STEPS = 6;
 
-    // Partition start (1MB aligned)
-    uint32_t partStart = partitionStartSector(sizeMB);
+struct BenchSpeedStep {
+    const char *test;
+    uint32_t size;
+    uint32_t count;
+};
 
-    // Basic layout constants
-    const uint32_t reservedSectors = 32;  // BPB + FSInfo + backup etc.
-    const uint32_t fats = 2;
+static const BenchSpeedStep BENCH_SPEED[] = {
+    { "seq4k",  4096,  1280  },  // The menu speed test
+    { "seq32k", 32768, 160   },  // Multi-sector transfers, SdFat cache bypassed
+    { "rec100", 100,   10240 },  // Partial-sector records through SdFat's cache
+};
 
-    // Iteratively compute FAT size and data region
-    uint32_t fatSize = 0;
-    uint32_t prevFatSize = 0;
+// What this binary was built with: SdFat's own compile-time options
+static void printBuildConfig(Stream &io) {
+    io.printf("RESULT bench build=%s file_type=%d spi_option=%s enable_dedicated_spi=%d "
+              "spi_array_transfer=%d separate_fat_cache=%d exfat_bitmap_cache=%d "
+              "long_file_names=%d free_cluster_count=%d check_flash_programming=%d\n",
+              SDTOOL_BUILD, SDFAT_FILE_TYPE,
+              SD_SPI_OPTION == DEDICATED_SPI ? "dedicated" : "shared",
+              ENABLE_DEDICATED_SPI, USE_SPI_ARRAY_TRANSFER, USE_SEPARATE_FAT_CACHE,
+              USE_EXFAT_BITMAP_CACHE, USE_LONG_FILE_NAMES, MAINTAIN_FREE_CLUSTER_COUNT,
+              CHECK_FLASH_PROGRAMMING);
+}
 
-    for (int i = 0; i < 8; i++) {
-        prevFatSize = fatSize;
+// BENCH_FILES one-sector files created, then removed: directory
+// entries and FAT chains rather than data
+static const char* benchSmallFiles(uint32_t &createUs, uint32_t &removeUs) {
+    ArenaScope scope("bench");
+    uint8_t *buf = arenaAlloc(512);
+    if (!buf) return "Not enough RAM";
+    memset(buf, 0x3C, 512);
+
+    char name[16];
+    const char *err = nullptr;
+    uint32_t s = micros();
+    for (uint32_t i = 0; i < BENCH_FILES && !err; i++) {
+        if (!serialKeepGoing()) {
+            err = "Aborted by user";
+            break;
+        }
+        SdFile f;
+        snprintf(name, sizeof(name), "bn%03lu.tmp", (unsigned long)i);
+        if (!f.open(name, O_RDWR | O_CREAT | O_TRUNC) || f.write(buf, 512) != 512 || !f.close()) {
+            err = "Write failed";
+        }
+    }
+    createUs = micros() - s;
 
-        uint32_t dataSectors = totalSectors - partStart - reservedSectors - (fats * fatSize);
-        if ((int32_t)dataSectors <= 0) return false;
+    s = micros();
+    for (uint32_t i = 0; i < BENCH_FILES; i++) {
+        snprintf(name, sizeof(name), "bn%03lu.tmp", (unsigned long)i);
+        if (!sd.remove(name) && !err) err = "Remove failed";
+    }
+    removeUs = micros() - s;
+    return err;
+}
 
-        uint32_t clusters = dataSectors / sectorsPerCluster;
-        if (clusters < 65525) {
-            // Not enough clusters for FAT32
-            return false;
-        }
+static bool benchMultiProgress(int phase, uint8_t percent) {
+    uint32_t step = (phase * 100 + percent) / (MS_DEFAULT_COUNT + 1);
+    return serialProgress(((BENCH_STEPS - 1) * 100 + step) / BENCH_STEPS);
+}
 
-        // FAT size in sectors: ceil(clusters * 4 / 512)
-        fatSize = (clusters * 4 + 511) / 512;
+static bool serialBench(const CmdArgs &args, Stream &io) {
+    if (!serialMountTraced()) return false;
+    sdDriver.setMode(SD_DRIVER_DMA);
 
-        if (fatSize == prevFatSize && fatSize != 0) break;
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) return serialFail("read CID failed");
+    printBuildConfig(io);
+    io.printf("RESULT bench card_mid=0x%02X card_psn=0x%08lX fs=%s driver=%s\n", cid.mid,
+              (unsigned long)cidSerial(cid), fsTypeName(sd.fatType()), sdDriver.modeName());
+
+    int step = 0;
+    const char *err = nullptr;
+
+    // --- Sequential and record-sized writes ---
+    for (const BenchSpeedStep &b : BENCH_SPEED) {
+        serialProgress(step++ * 100 / BENCH_STEPS);
+        fsTrace.reset();
+        SpeedResult res;
+        if ((err = speedPass(res, b.size, b.count, serialKeepGoing))) return serialFail(err);
+        io.printf("RESULT bench test=%s size=%lu count=%lu write_kbs=%lu read_kbs=%lu "
+                  "max_write_us=%lu", b.test, (unsigned long)b.size, (unsigned long)b.count,
+                  (unsigned long)(res.writeMBs * 1024), (unsigned long)(res.readMBs * 1024),
+                  (unsigned long)res.maxLatencyUs);
+        printTrace(io);
     }
 
-    if (fatSize == 0) return false;
+    // --- Metadata ---
+    serialProgress(step++ * 100 / BENCH_STEPS);
+    fsTrace.reset();
+    uint32_t createUs, removeUs;
+    if ((err = benchSmallFiles(createUs, removeUs))) return serialFail(err);
+    io.printf("RESULT bench test=files count=%lu create_us=%lu remove_us=%lu",
+              (unsigned long)BENCH_FILES, (unsigned long)(createUs / BENCH_FILES),
+              (unsigned long)(removeUs / BENCH_FILES));
+    printTrace(io);
+
+    // --- Cold / warm reads ---
+    serialProgress(step++ * 100 / BENCH_STEPS);
+    fsTrace.reset();
+    CacheReadResult cr;
+    if ((err = cacheReadPass(cr, SPEED_BLOCK_BYTES, serialKeepGoing))) return serialFail(err);
+    io.printf("RESULT bench test=cacheread write_kbs=%lu warm_read_kbs=%lu cold_read_kbs=%lu "
+              "cold_fresh=%d", (unsigned long)(cr.writeMBs * 1024),
+              (unsigned long)(cr.warmMBs * 1024), (unsigned long)(cr.coldMBs * 1024),
+              cr.coldFresh);
+    printTrace(io);
+
+    // --- Mixed load ---
+    fsTrace.reset();
+    static MsReport rep;
+    MsResult ms = runMultiStream(sd, MS_DEFAULT_STREAMS, MS_DEFAULT_COUNT, MULTI_PHASE_MS,
+                                 rep, benchMultiProgress);
+    if (ms == MS_ABORTED) return serialFail("Aborted by user");
+    if (ms != MS_OK) return serialFail("multi-stream failed");
+    for (int i = 0; i < rep.count; i++) {
+        const MsStreamReport &s = rep.streams[i];
+        io.printf("RESULT bench test=multi_%s mixed_kbs=%lu mixed_p99_us=%lu mixed_max_us=%lu "
+                  "late=%lu interference_pct=%lu\n", MS_DEFAULT_STREAMS[i].name,
+                  (unsigned long)msKBs(s.mixed), (unsigned long)msP99Us(s.mixed),
+                  (unsigned long)s.mixed.maxUs, (unsigned long)s.mixed.late,
+                  (unsigned long)msInterference(s));
+    }
+    io.printf("RESULT bench test=multi");
+    printTrace(io);
+    return true;
+}
 
-    // Final layout
-    uint32_t fatStart = partStart + reservedSectors;
-    uint32_t dataStart = fatStart + fats * fatSize;
-    uint32_t rootCluster = 2;
+// --- probe n=64 seed=... ---
+static bool serialProbe(const CmdArgs &args, Stream &io) {
+    static const char* names[] = { "OK", "FAKE", "IO_ERROR", "no_memory", "too_small", "aborted" };
+    uint32_t n, seed;
+    if (!args.number("n", PROBE_DEFAULT, n) || n < 2 || n > PROBE_MAX) {
+        return serialFail("n must be 2..256");
+    }
+    if (!args.number("seed", esp_random(), seed)) return serialFail("bad seed");
+    if (!serialCard()) return false;
 
-    // Build BPB and FSInfo
-    Sector bpb;
-    buildFAT32BPB(
-        bpb,
-        totalSectors - partStart, // total sectors in partition
-        partStart,
-        fatSize,
-        rootCluster,
-        sectorsPerCluster
-    );
+    SdCardDevice dev(sd.card());
+    ProbeReport rep;
+    ProbeResult res = probeCapacity(&dev, n, seed, rep, serialProgress);
 
-    Sector fsInfo;
-    buildFSInfo(fsInfo);
+    io.printf("RESULT probe sectors=%lu probes=%lu good=%lu bad=%lu io_errors=%lu "
+              "first_bad=%lu restored=%d seed=0x%08lX\n", (unsigned long)rep.sectors,
+              (unsigned long)rep.probes, (unsigned long)rep.good, (unsigned long)rep.bad,
+              (unsigned long)rep.ioErrors, (unsigned long)rep.firstBad, rep.restored,
+              (unsigned long)seed);
 
-    // Write MBR
-    if (!writeMBR(card, partStart, totalSectors)) return false;
+    if (res >= PROBE_NO_MEMORY) return serialFail(names[res]);
+    io.printf("RESULT probe verdict=%s\n", names[res]);
+    return true;
+}
 
-    // Clear reserved area (except BPB/FSInfo/backup which we overwrite)
-    for (uint32_t i = 0; i < reservedSectors; i++) {
-        if (!clearSectorRaw(card, partStart + i)) return false;
+// --- soak region=64m cycles=10 stop=1 ---
+static uint32_t serialSoakTarget = 0;
+static uint32_t serialSoakReported = 0;
+
+static bool serialSoakProgress(const SoakStats &st, SoakPhase phase, uint8_t percent) {
+    // A cycle just finished — send it
+    while (serialSoakReported < st.cycles) {
+        serialSoakReported++;
+        Serial.printf("RESULT soak cycle=%lu write_kbs=%lu read_kbs=%lu bad=%lu\n",
+                      (unsigned long)serialSoakReported, (unsigned long)st.last.writeKBs,
+                      (unsigned long)st.last.readKBs, (unsigned long)st.last.badSectors);
     }
 
-    // Write BPB + backup
-    if (!writeBPB(card, partStart, bpb)) return false;
+    uint32_t done = st.cycles * 200 + phase * 100 + percent;
+    uint8_t overall = serialSoakTarget ? (uint64_t)done * 100 / (serialSoakTarget * 200ULL)
+                                       : percent;
+    return serialProgress(overall);
+}
 
-    // Write FSInfo + backup
-    if (!writeFSInfo(card, partStart, fsInfo)) return false;
+static bool serialSoak(const CmdArgs &args, Stream &io) {
+    uint64_t region;
+    uint32_t cycles, stop;
+    if (!args.size("region", 64ULL << 20, region) || region < (1 << 20) ||
+        region > (2048ULL << 20) || region % (1 << 20)) {
+        return serialFail("region must be 1m..2g in whole MB");
+    }
+    if (!args.number("cycles", 10, cycles)) return serialFail("bad cycles");
+    if (!args.number("stop", 1, stop)) return serialFail("bad stop");
+    if (!serialMount()) return false;
+
+    const uint32_t regionMB = region >> 20;
+    SoakConfig cfg;
+    if (!soakRegion(regionMB, cfg)) return serialFail("not enough contiguous free space");
+    cfg.cycles     = cycles;
+    cfg.stopOnFail = stop != 0;
+    cfg.seed       = esp_random();
+    serialSoakTarget = cycles;
+    serialSoakReported = 0;
+
+    static SoakStats st;
+    SdCardDevice dev(sd.card());
+    SoakResult res = runSoak(&dev, cfg, st, serialSoakProgress);
+    serialSoakProgress(st, SOAK_WRITE, 0);      // Flush the last cycle's line
+    sd.remove("soak.bin");
+    if (res == SOAK_NO_MEMORY) return serialFail("no_memory");
+
+    if (st.cycles) {
+        recordHistory(HIST_SOAK, regionMB, st.last.writeKBs, st.last.readKBs,
+                      st.maxLatencyUs, st.badSectors);
+    }
 
-    // Write both FATs
-    if (!writeFATHeaders(card, fatStart, fatSize)) return false;
-    if (!writeFATHeaders(card, fatStart + fatSize, fatSize)) return false;
+    io.printf("RESULT soak cycles=%lu failed_cycles=%lu bad=%lu first_fail=%lu max_write_us=%lu "
+              "verdict=%s\n", (unsigned long)st.cycles, (unsigned long)st.failedCycles,
+              (unsigned long)st.badSectors, (unsigned long)st.firstFailCycle,
+              (unsigned long)st.maxLatencyUs, st.badSectors ? "FAIL" : "PASS");
+    return res != SOAK_ABORTED || serialFail("aborted");
+}
 
-    // Write empty root directory (cluster 2)
-    if (!writeRootDir(card, dataStart, sectorsPerCluster)) return false;
+// --- geometry ---
+static bool serialGeoProgress(GeoStage stage, uint8_t percent) {
+    return serialProgress((stage * 100 + percent) / 3);
+}
 
+static bool serialGeometry(const CmdArgs &args, Stream &io) {
+    static const char* names[] = { "ok", "io_error", "no_memory", "card_under_1gb", "aborted" };
+    if (!serialCard()) return false;
+
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) return serialFail("read CID failed");
+
+    SdCardDevice dev(sd.card());
+    static FlashGeometry geo;
+    GeoResult res = probeGeometry(&dev, geo, serialGeoProgress);
+    if (res != GEO_OK) return serialFail(names[res]);
+    geometrySave(cid.mid, cidSerial(cid), geo);
+
+    for (int i = 0; i < GEO_ALIGN_POINTS; i++) {
+        io.printf("RESULT geometry align_sectors=%lu on_us=%lu diff_us=%ld\n",
+                  (unsigned long)geo.align[i].blockSectors, (unsigned long)geo.align[i].onUs,
+                  (long)geo.align[i].diffUs);
+    }
+    for (int i = 0; i < GEO_WRITE_POINTS; i++) {
+        io.printf("RESULT geometry write_sectors=%lu aligned_kbs=%lu offset_kbs=%lu\n",
+                  (unsigned long)geo.write[i].sizeSectors, (unsigned long)geo.write[i].alignedKBs,
+                  (unsigned long)geo.write[i].offsetKBs);
+    }
+    for (int i = 0; i < geo.openPoints; i++) {
+        io.printf("RESULT geometry open=%d kbs=%lu\n", geo.open[i].segments,
+                  (unsigned long)geo.open[i].kbs);
+    }
+    io.printf("RESULT geometry page_sectors=%lu erase_sectors=%lu open_segments=%d\n",
+              (unsigned long)geo.pageSectors, (unsigned long)geo.eraseSectors, geo.openSegments);
     return true;
 }
 
-// ===============================
-// UI wrapper around quickFormat()
-// ===============================
-void runFormat() {
-    M5.Display.fillScreen(TFT_BLACK);
-    M5.Display.setCursor(0, 10);
-    M5.Display.println(" Quick Format\n");
-    M5.Display.println(" ENTER: format");
-    M5.Display.println(" BKSP: abort");
+// --- erase ---
+static bool serialEraseProgress(EraseStage stage, uint8_t percent) {
+    return serialProgress(stage == ERASE_STAGE_ERASE ? percent * 9 / 10 : 90 + percent / 10);
+}
 
-    // Wait for ENTER or BACKSPACE
-    while (!M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER)) {
-        M5Cardputer.update();
-        if (M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-            currentState = MENU;
-            drawMenu();
-            return;
-        }
-        delay(10);
-    }
+static bool serialErase(const CmdArgs &args, Stream &io) {
+    static const char* names[] = { "CLEAN", "NOT_CLEAN", "unsupported", "write_protected",
+                                   "io_error", "no_memory", "aborted" };
+    if (!serialCard()) return false;
+
+    CsdInfo csd;
+    SdStatusInfo sds;
+    if (!readCsdInfo(sd.card(), csd)) return serialFail("read CSD failed");
+    bool haveSds = readSdStatusInfo(sd.card(), sds);
+
+    SdCardDevice dev(sd.card());
+    EraseReport rep;
+    EraseResult res = secureErase(&dev, csd, haveSds ? &sds : nullptr, esp_random(),
+                                  rep, serialEraseProgress);
+
+    io.printf("RESULT erase unit_sectors=%lu chunk_sectors=%lu from_sd_status=%d chunks=%lu "
+              "retries=%lu largest_chunk=%lu max_chunk_ms=%lu\n",
+              (unsigned long)rep.plan.unitSectors, (unsigned long)rep.plan.chunkSectors,
+              rep.plan.fromSdStatus, (unsigned long)rep.chunks, (unsigned long)rep.retries,
+              (unsigned long)rep.largestChunk, (unsigned long)rep.maxChunkMs);
+    io.printf("RESULT erase erased_sectors=%lu zeroed_sectors=%lu erase_ms=%lu erase_kbs=%lu "
+              "samples=%lu samples_bad=%lu first_bad=%lu erased_byte=0x%02X\n",
+              (unsigned long)rep.erasedSectors, (unsigned long)rep.zeroedSectors,
+              (unsigned long)rep.eraseMs, (unsigned long)rep.eraseKBs,
+              (unsigned long)rep.samples, (unsigned long)rep.samplesBad,
+              (unsigned long)rep.firstBad, rep.erasedByte);
+
+    if (res > ERASE_NOT_CLEAN) return serialFail(names[res]);
+    io.printf("RESULT erase verdict=%s\n", names[res]);
+    return true;
+}
 
-    // Debounce ENTER
-    while (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER)) {
-        M5Cardputer.update();
-        delay(10);
+// --- format fs=auto|fat32|exfat ---
+static bool serialFormat(const CmdArgs &args, Stream &io) {
+    const char *fs = args.get("fs");
+    if (!fs) fs = "auto";
+    if (strcmp(fs, "auto") != 0 && strcmp(fs, "fat32") != 0 && strcmp(fs, "exfat") != 0) {
+        return serialFail("fs must be auto, fat32 or exfat");
     }
+    if (!serialCard()) return false;
 
-    // --- Formatting Screen ---
-M5.Display.fillScreen(TFT_BLACK);
-M5.Display.setCursor(0, 0);
-M5.Display.println(" Formatting...");
-M5.Display.setCursor(0, 25);
-M5.Display.println(" Please wait");
+    // auto follows the SD spec: exFAT for SDXC (over 32GB)
+    SdCard *card = sd.card();
+    const bool exfat = strcmp(fs, "exfat") == 0 ||
+                       (strcmp(fs, "auto") == 0 && card->sectorCount() > 67108864UL);
+
+    uint32_t start = millis();
+    bool ok, mounted;
+    const char *mismatch = nullptr;
+
+    if (exfat) {
+        ArenaScope scope("format");
+        uint8_t *secBuf = arenaAlloc(512);
+        ExFatFormatter fmt;
+        ok = secBuf && fmt.format(card, secBuf, nullptr);
+        mounted = ok && sd.volumeBegin();
+    } else {
+        uint32_t pageSectors = 0, eraseSectors = 0;
+        uint8_t openSegments = 0;
+        cid_t cid;
+        if (card->readCID(&cid)) {
+            geometryLoad(cid.mid, cidSerial(cid), pageSectors, eraseSectors, openSegments);
+        }
 
-const char spinner[4] = {'|','/','-','\\'};
-int spinIndex = 0;
+        Fat32Layout layout;
+        ok = quickFormat(sd, layout, eraseSectors, pageSectors);
 
-uint32_t start = millis();
+        uint32_t remountMs;
+        mounted = ok && remountAfterFormat(layout, mismatch, remountMs);
+        if (ok && !mounted && !mismatch) mounted = sd.begin(SD_CONFIG);
 
-// --- Perform quick format (silent) ---
-bool ok = quickFormat(sd);
+        if (ok && layout.status == LAYOUT_OK) {
+            io.printf("RESULT format part_start=%lu data_start=%lu cluster_sectors=%lu "
+                      "aligned_to=%lu\n", (unsigned long)layout.partStart,
+                      (unsigned long)layout.dataStart, (unsigned long)layout.sectorsPerCluster,
+                      (unsigned long)eraseSectors);
+        }
+    }
+    if (!ok) return serialFail("format failed");
+    if (mismatch) return serialFail("boot record does not match the layout");
 
-// Spinner animation for ~2 seconds after format
-while (millis() - start < 2000) {
-    M5.Display.setCursor(0, 50);
-    M5.Display.printf("%c", spinner[spinIndex]);
-    spinIndex = (spinIndex + 1) % 4;
-    M5Cardputer.update();
-    delay(120);
-}
-
-// --- CRITICAL: flush controller + settle ---
-sd.card()->syncDevice();
-delay(200);
-
-// --- FULL SD + SPI RESET (Cardputer ADV dedicated SD bus) ---
-sd.end();
-delay(50);
-
-SPI.end();
-delay(50);
-
-// Re‑initialise the dedicated SD SPI bus
-SPI.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
-delay(50);
-
-
-    // Remount using DEDICATED_SPI on HSPI
-    bool mounted = sd.begin(SdSpiConfig(
-        SD_CS_PIN,
-        DEDICATED_SPI,
-        SD_SCK_MHZ(20),
-        &sdSpi
-    ));
-
-    if (!mounted) {
-        delay(150);
-        mounted = sd.begin(SdSpiConfig(
-            SD_CS_PIN,
-            DEDICATED_SPI,
-            SD_SCK_MHZ(20),
-            &sdSpi
-        ));
-    } 
+    // exFAT only mounts on a build with exFAT enabled; that is not an error
+    printToken(io, "RESULT format requested", fs);
+    printToken(io, "fs", mounted ? fsTypeName(sd.fatType()) : "No FS");
+    io.printf(" ms=%lu\n", (unsigned long)(millis() - start));
+    return true;
+}
 
-    // --- Result Screen ---
-    M5.Display.fillScreen(TFT_BLACK);
-    M5.Display.setCursor(0, 0);
+// --- backup / restore: binary stream (card_image.h) ---
+static bool serialImage(bool backup) {
+    if (!serialCard()) return false;
+    ImageStats st;
+    ImageResult res = imageSession(backup, st);
+    return res == IMAGE_OK || serialFail(IMAGE_RESULT_NAMES[res]);
+}
 
-    if (ok && mounted) {
-        M5.Display.setTextColor(TFT_GREEN, TFT_BLACK);
-        M5.Display.println("Format OK");
+static bool serialBackup(const CmdArgs &args, Stream &io)  { return serialImage(true); }
+static bool serialRestore(const CmdArgs &args, Stream &io) { return serialImage(false); }
 
-        uint8_t fs = sd.vol()->fatType();
-        M5.Display.setCursor(0, 20);
-        M5.Display.printf("Filesystem: FAT%d\n", fs);
+// --- history ---
+static bool serialHistory(const CmdArgs &args, Stream &io) {
+    static const uint8_t tests[] = { HIST_SPEED, HIST_INTEGRITY, HIST_SOAK };
+    static const char* names[] = { "speed", "integrity", "soak" };
+    if (!serialCard()) return false;
 
-        SdFile test;
-        if (test.open("format_ok.txt", O_RDWR | O_CREAT | O_TRUNC)) {
-            test.println("Cardputer SD Tool format check");
-            test.close();
-            M5.Display.println(" Test file written");
-        } else {
-            M5.Display.println(" Test file FAILED");
+    cid_t cid;
+    if (!sd.card()->readCID(&cid)) return serialFail("read CID failed");
+
+    const int ROWS = 16;
+    static HistoryRecord recs[ROWS];
+    for (int t = 0; t < 3; t++) {
+        int n = historyLoad(cid.mid, cidSerial(cid), tests[t], recs, ROWS);
+        for (int i = 0; i < n; i++) {
+            io.printf("RESULT history test=%s seq=%lu size_mb=%lu write_kbs=%lu read_kbs=%lu "
+                      "max_write_us=%lu errors=%lu\n", names[t], (unsigned long)recs[i].seq,
+                      (unsigned long)recs[i].sizeMB, (unsigned long)recs[i].writeKBs,
+                      (unsigned long)recs[i].readKBs, (unsigned long)recs[i].maxLatencyUs,
+                      (unsigned long)recs[i].errors);
         }
-
-    } else {
-        M5.Display.setTextColor(TFT_RED, TFT_BLACK);
-        M5.Display.println("Format Failed");
-        M5.Display.setCursor(0, 20);
-        M5.Display.println(ok ? "Card init failed" : "Format error");
     }
-
-    waitForInput();
+    return true;
 }
 
-
-// --- Return to menu ---
-void waitForInput() {
-    M5.Display.println("\n Press ENTER to return");
-
-    // 1. Wait for ANY key release (ENTER or BACKSPACE)
-    while (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER) ||
-           M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-        M5Cardputer.update();
-        delay(10);
+// --- memory ---
+static bool serialMemory(const CmdArgs &args, Stream &io) {
+    io.printf("RESULT memory arena_bytes=%lu free_bytes=%lu peak_bytes=%lu psram=%d "
+              "heap_free=%lu\n", (unsigned long)arenaSize(), (unsigned long)arenaFree(),
+              (unsigned long)arenaPeak(), arenaInPsram(), (unsigned long)ESP.getFreeHeap());
+
+    const ArenaModeStats *modes;
+    int n = arenaModes(modes);
+    for (int i = 0; i < n; i++) {
+        io.printf("RESULT memory mode=%s peak_bytes=%lu uses=%lu\n", modes[i].name,
+                  (unsigned long)modes[i].peakBytes, (unsigned long)modes[i].uses);
     }
+    return true;
+}
+
+static bool serialHelp(const CmdArgs &args, Stream &io);
+
+static const SerialCommand SERIAL_COMMANDS[] = {
+    { "help",      "",                                          serialHelp },
+    { "info",      "",                                          serialInfo },
+    { "speed",     "size=4k count=1280 driver=dma|arduino|both", serialSpeed },
+    { "cacheread", "size=4k",                                   serialCacheRead },
+    { "multi",     "secs=5",                                    serialMulti },
+    { "bench",     "(fixed sequence, see tools/sdbench.py)",    serialBench },
+    { "probe",     "n=64 seed=<random>",                        serialProbe },
+    { "soak",      "region=64m cycles=10 stop=1",               serialSoak },
+    { "geometry",  "",                                          serialGeometry },
+    { "erase",     "",                                          serialErase },
+    { "format",    "fs=auto|fat32|exfat",                       serialFormat },
+    { "backup",    "(binary, see tools/sdimage.py)",            serialBackup },
+    { "restore",   "(binary, see tools/sdimage.py)",            serialRestore },
+    { "history",   "",                                          serialHistory },
+    { "memory",    "",                                          serialMemory },
+};
+static const int SERIAL_COMMAND_COUNT = sizeof(SERIAL_COMMANDS) / sizeof(SERIAL_COMMANDS[0]);
 
-    // 2. Wait for a NEW key press
-    while (!M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER) &&
-           !M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-        M5Cardputer.update();
-        delay(10);
+static bool serialHelp(const CmdArgs &args, Stream &io) {
+    for (int i = 0; i < SERIAL_COMMAND_COUNT; i++) {
+        io.printf("RESULT help %s %s\n", SERIAL_COMMANDS[i].name, SERIAL_COMMANDS[i].usage);
     }
+    return true;
+}
 
-    // 3. Debounce whichever key was pressed
-    while (M5Cardputer.Keyboard.isKeyPressed(KEY_ENTER) ||
-           M5Cardputer.Keyboard.isKeyPressed(KEY_BACKSPACE)) {
-        M5Cardputer.update();
-        delay(10);
+void runSerialCommand(char *line) {
+    inputFlush();
+    M5.Display.fillScreen(TFT_BLACK);
+    M5.Display.setCursor(0, 0);
+    M5.Display.println(" Remote command\n");
+    M5.Display.printf(" %.24s\n\n", line);
+    M5.Display.println(" Ctrl-C / BKSP: abort");
+
+    CmdArgs args;
+    if (cmdParse(line, args, Serial)) {
+        serialName = args.name;
+        cmdDispatch(args, SERIAL_COMMANDS, SERIAL_COMMAND_COUNT, Serial);
     }
 
-    // 4. Return to menu cleanly
     currentState = MENU;
     drawMenu();
 }
 
+// --- Wait for ENTER (true) or BACKSPACE (false) ---
+bool waitForEnter() {
+    // Ignore presses meant for the previous screen
+    inputFlush();
+
+    while (true) {
+        char key = inputGetKey();
+        if (key == INPUT_ENTER) return true;
+        if (key == INPUT_BACK) return false;
+    }
+}
+
+// --- Abort check for long operations ---
+// Only reads the flag the input task sets, so it is cheap enough
+// for every block of an I/O loop
+bool abortPressed() {
+    return inputAbort();
+}
+
 /*
  * NOTE FOR FUTURE DEVELOPMENT — SD CARD CAPACITY VERIFICATION
  * -----------------------------------------------------------
- * The current Integrity Check writes/reads a fixed 50MB region.
- * This verifies DATA INTEGRITY (detects corruption, weak flash,
- * controller issues, SPI instability), but it does NOT verify
- * the TRUE CAPACITY of the SD card.
- *
- * To detect FAKE-CAPACITY cards (e.g., 128GB cards that are
- * really 8GB and wrap around), a full-card write/verify is
- * required — OR a faster statistical method:
- *
- *   ✔ Write small probe blocks at RANDOM OFFSETS across the
- *     advertised capacity.
- *   ✔ Read them back and compare.
- *   ✔ If any probe wraps into earlier physical storage, the
- *     card is fake or misreporting its size.
- *
- * This "Random Capacity Probe" method is fast, low-wear, and
- * suitable for embedded devices like the Cardputer ADV.
+ * The Integrity Check verifies DATA INTEGRITY over 50MB or all
+ * free space. FAKE CAPACITY is covered by the Capacity Probe
+ * (src/capacity_probe.h): tagged sectors across the advertised
+ * size, read back, originals restored. Both detectors are
+ * exercised against simulated bad cards (src/sim_card.h) from
+ * the Sim Self-Test screen and the native tests (test/).
  *
  * TODO (future):
- *   - Implement random-offset probe testing
- *   - Add menu option: "Capacity Probe (Fast)"
- *   - Add confidence scoring based on number of probes
- *   - Optionally add full-card test for thorough validation
- *
- * Circle back when ready to extend the SD Tool.
+ *   - Confidence scoring based on the number of probes
+ *   - Optional full-card write/verify for thorough validation
  */
@@ -0,0 +1,205 @@
+/**
+ * Multi-Stream Benchmark — engine
+ */
+
+#include <Arduino.h>
+
+#include "multi_stream.h"
+#include "io_arena.h"
+
+struct MsStream {
+    const MsStreamSpec *spec;
+    SdFile   file;
+    uint8_t *buf;
+    uint32_t nextDue;            // millis()
+    uint32_t records;            // Since the last sync
+    uint32_t rng;                // Reader offsets
+};
+
+// 8.3, so it still works in a USE_LONG_FILE_NAMES=0 build
+static void streamName(char *name, const MsStreamSpec &spec) {
+    snprintf(name, 24, "ms%.6s.tmp", spec.name);
+}
+
+static void record(MsPhaseStats &p, uint32_t us, uint32_t bytes, bool ok) {
+    p.ops++;
+    if (!ok) {
+        p.errors++;
+        return;
+    }
+    p.bytes += bytes;
+    p.totalUs += us;
+    if (us > p.maxUs) p.maxUs = us;
+
+    int b = 0;
+    while (b < MS_HIST_BUCKETS - 1 && (us >> (b + 1))) b++;
+    p.hist[b]++;
+}
+
+// One record on one stream
+static void streamOp(MsStream &s, MsPhaseStats &p) {
+    const MsStreamSpec &spec = *s.spec;
+    bool ok;
+    uint32_t t0 = micros();
+
+    if (spec.writer) {
+        ok = s.file.write(s.buf, spec.recordBytes) == spec.recordBytes;
+        if (ok && spec.syncEvery && ++s.records >= spec.syncEvery) {
+            ok = s.file.sync();
+            s.records = 0;
+        }
+    } else {
+        s.rng ^= s.rng << 13;
+        s.rng ^= s.rng >> 17;
+        s.rng ^= s.rng << 5;
+        uint32_t slots = spec.fileBytes / spec.recordBytes;
+        ok = s.file.seekSet((uint64_t)(s.rng % slots) * spec.recordBytes) &&
+             s.file.read(s.buf, spec.recordBytes) == (int)spec.recordBytes;
+    }
+    record(p, micros() - t0, spec.recordBytes, ok);
+}
+
+// Runs the streams flagged in `active` for phaseMs; stats into `phase`
+static bool runPhase(MsStream *streams, int count, uint32_t active, uint32_t phaseMs,
+                     MsPhaseStats **phase, int progressPhase, MsProgressFn progress) {
+    const uint32_t start = millis();
+    for (int i = 0; i < count; i++) streams[i].nextDue = start;
+
+    uint8_t lastPct = 0xFF;
+    while (true) {
+        const uint32_t now = millis();
+        const uint32_t elapsed = now - start;
+        if (elapsed >= phaseMs) break;
+
+        uint8_t pct = (uint64_t)elapsed * 100 / phaseMs;
+        if (pct != lastPct) {
+            lastPct = pct;
+            if (progress && !progress(progressPhase, pct)) return false;
+        }
+
+        // Paced streams that are due go first
+        bool didPaced = false;
+        for (int i = 0; i < count; i++) {
+            MsStream &s = streams[i];
+            if (!(active & (1u << i)) || !s.spec->periodMs) continue;
+            if ((int32_t)(now - s.nextDue) < 0) continue;
+
+            if (now - s.nextDue >= s.spec->periodMs) {
+                phase[i]->late++;
+                s.nextDue = now;             // Resync rather than burst to catch up
+            }
+            streamOp(s, *phase[i]);
+            s.nextDue += s.spec->periodMs;
+            didPaced = true;
+        }
+        if (didPaced) continue;
+
+        // Idle time goes to the unpaced streams
+        bool didFree = false;
+        for (int i = 0; i < count; i++) {
+            if (!(active & (1u << i)) || streams[i].spec->periodMs) continue;
+            streamOp(streams[i], *phase[i]);
+            didFree = true;
+        }
+        if (!didFree) delayMicroseconds(100);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!(active & (1u << i))) continue;
+        if (streams[i].spec->writer) streams[i].file.sync();
+        phase[i]->elapsedMs = millis() - start;
+    }
+    return true;
+}
+
+static bool prepareReader(MsStream &s) {
+    const MsStreamSpec &spec = *s.spec;
+    memset(s.buf, 0xC3, spec.recordBytes);
+    for (uint32_t done = 0; done < spec.fileBytes; done += spec.recordBytes) {
+        if (s.file.write(s.buf, spec.recordBytes) != spec.recordBytes) return false;
+    }
+    return s.file.sync();
+}
+
+MsResult runMultiStream(SdFat &sd, const MsStreamSpec *specs, int count, uint32_t phaseMs,
+                        MsReport &rep, MsProgressFn progress) {
+    memset(&rep, 0, sizeof(rep));
+    if (count > MS_MAX_STREAMS) count = MS_MAX_STREAMS;
+    rep.count = count;
+
+    ArenaScope scope("multi");
+    static MsStream streams[MS_MAX_STREAMS];
+    char name[24];
+    MsResult res = MS_OK;
+
+    for (int i = 0; i < count && res == MS_OK; i++) {
+        MsStream &s = streams[i];
+        s.spec = &specs[i];
+        s.records = 0;
+        s.rng = 0x9E3779B9UL * (i + 1);
+        s.buf = arenaAlloc(specs[i].recordBytes);
+        if (!s.buf) {
+            res = MS_NO_MEMORY;
+            break;
+        }
+        memset(s.buf, 'A' + i, specs[i].recordBytes);
+
+        streamName(name, specs[i]);
+        if (!s.file.open(name, O_RDWR | O_CREAT | O_TRUNC) ||
+            (!specs[i].writer && !prepareReader(s))) {
+            res = MS_FILE_ERROR;
+        }
+    }
+
+    // --- Each stream alone ---
+    MsPhaseStats *phase[MS_MAX_STREAMS];
+    for (int i = 0; i < count && res == MS_OK; i++) {
+        phase[i] = &rep.streams[i].solo;
+        if (!runPhase(streams, count, 1u << i, phaseMs, phase, i, progress)) res = MS_ABORTED;
+    }
+
+    // --- All together ---
+    if (res == MS_OK) {
+        for (int i = 0; i < count; i++) phase[i] = &rep.streams[i].mixed;
+        if (!runPhase(streams, count, (1u << count) - 1, phaseMs, phase, count, progress)) {
+            res = MS_ABORTED;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        streams[i].file.close();
+        streamName(name, specs[i]);
+        sd.remove(name);
+    }
+    return res;
+}
+
+// ===============================
+// Figures
+// ===============================
+
+uint32_t msKBs(const MsPhaseStats &p) {
+    return p.elapsedMs ? (uint32_t)(p.bytes * 1000 / 1024 / p.elapsedMs) : 0;
+}
+
+uint32_t msAvgUs(const MsPhaseStats &p) {
+    uint32_t good = p.ops - p.errors;
+    return good ? (uint32_t)(p.totalUs / good) : 0;
+}
+
+uint32_t msP99Us(const MsPhaseStats &p) {
+    uint32_t good = p.ops - p.errors;
+    if (!good) return 0;
+
+    uint32_t target = good - good / 100, seen = 0;
+    for (int b = 0; b < MS_HIST_BUCKETS; b++) {
+        seen += p.hist[b];
+        if (seen >= target) return (2UL << b) - 1;
+    }
+    return p.maxUs;
+}
+
+uint32_t msInterference(const MsStreamReport &s) {
+    uint32_t solo = msAvgUs(s.solo);
+    return solo ? (uint32_t)((uint64_t)msAvgUs(s.mixed) * 100 / solo) : 0;
+}
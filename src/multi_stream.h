@@ -0,0 +1,80 @@
+/**
+ * Multi-Stream Benchmark
+ * A device that logs, records sensor data and reads its config at
+ * the same time drives several files through SdFat's one shared
+ * sector cache. Here each stream first runs alone, then all of them
+ * run interleaved for the same time; per stream the report compares
+ * throughput and latency between the two, which is the cost of
+ * sharing the card (and the cache) with the others.
+ *
+ * Scheduling is cooperative on one task: a paced stream does one
+ * record when it is due, an unpaced one (periodMs = 0) fills the
+ * gaps. A paced record starting more than one period late counts
+ * as late — a real logger would have dropped data there.
+ */
+
+#pragma once
+
+#include <SdFat.h>
+
+constexpr int MS_MAX_STREAMS = 4;
+constexpr int MS_HIST_BUCKETS = 24;      // log2 µs: 1µs .. 8s
+
+struct MsStreamSpec {
+    const char *name;            // Also the file: ms<name>.tmp
+    bool     writer;
+    uint32_t recordBytes;
+    uint32_t periodMs;           // 0 = as fast as it can
+    uint32_t syncEvery;          // Writers: sync() every N records, 0 = never
+    uint32_t fileBytes;          // Readers: size of the file read at random
+};
+
+// The default mix: a text log, a sensor recorder and a config reader
+constexpr MsStreamSpec MS_DEFAULT_STREAMS[] = {
+    { "log",    true,   512,  5, 32, 0 },
+    { "sensor", true,  4096, 10,  8, 0 },
+    { "config", false, 1024,  0,  0, 256 * 1024 },
+};
+constexpr int MS_DEFAULT_COUNT = sizeof(MS_DEFAULT_STREAMS) / sizeof(MS_DEFAULT_STREAMS[0]);
+
+struct MsPhaseStats {
+    uint32_t ops;
+    uint64_t bytes;
+    uint32_t errors;
+    uint32_t late;               // Paced records that started a period late
+    uint32_t maxUs;
+    uint64_t totalUs;            // Sum of op latencies
+    uint32_t elapsedMs;
+    uint32_t hist[MS_HIST_BUCKETS];
+};
+
+struct MsStreamReport {
+    MsPhaseStats solo;
+    MsPhaseStats mixed;
+};
+
+struct MsReport {
+    int count;
+    MsStreamReport streams[MS_MAX_STREAMS];
+};
+
+enum MsResult : uint8_t {
+    MS_OK = 0,
+    MS_FILE_ERROR,               // A stream file could not be created
+    MS_NO_MEMORY,
+    MS_ABORTED
+};
+
+// phase: 0..count-1 = that stream alone, count = all together.
+// Return false to abort.
+typedef bool (*MsProgressFn)(int phase, uint8_t percent);
+
+MsResult runMultiStream(SdFat &sd, const MsStreamSpec *specs, int count, uint32_t phaseMs,
+                        MsReport &rep, MsProgressFn progress);
+
+uint32_t msKBs(const MsPhaseStats &p);
+uint32_t msAvgUs(const MsPhaseStats &p);
+uint32_t msP99Us(const MsPhaseStats &p);     // Upper edge of the bucket
+
+// Mixed average latency over solo, x100 (250 = 2.5 times slower)
+uint32_t msInterference(const MsStreamReport &s);
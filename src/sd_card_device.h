@@ -0,0 +1,42 @@
+/**
+ * SD Card Device
+ * The inserted card as a SectorDevice, through SdFat.
+ */
+
+#pragma once
+
+#include <SdFat.h>
+
+#include "sector_device.h"
+
+class SdCardDevice : public SectorDevice {
+public:
+    explicit SdCardDevice(SdCard *card) : card(card) {}
+
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t n) override {
+        return card->readSectors(sector, dst, n);
+    }
+    bool writeSectors(uint32_t sector, const uint8_t *src, size_t n) override {
+        return card->writeSectors(sector, src, n);
+    }
+    bool eraseSectors(uint32_t sector, uint32_t n) override {
+        return card->erase(sector, sector + n - 1);
+    }
+    uint32_t sectorCount() override { return card->sectorCount(); }
+    bool readCID(uint8_t cid[16]) override {
+        static_assert(sizeof(cid_t) == 16, "cid_t is the raw CID register");
+        return card->readCID(reinterpret_cast<cid_t *>(cid));
+    }
+    bool syncDevice() override { return card->syncDevice(); }
+    bool waitReady(uint32_t timeoutMs) override {
+        const uint32_t t0 = millis();
+        while (card->isBusy()) {
+            if (millis() - t0 > timeoutMs) return false;
+            delay(1);
+        }
+        return true;
+    }
+
+private:
+    SdCard *card;
+};
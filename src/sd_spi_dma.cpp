@@ -0,0 +1,254 @@
+/**
+ * SdFat user SPI driver — Arduino and DMA paths
+ *
+ * DMA path: the card's single-byte command/response traffic uses
+ * polling transactions; sector payloads go through two DMA bounce
+ * buffers. Two transactions are always queued, so while chunk k
+ * is on the wire the CPU copies chunk k+1 in (send) or chunk k-1
+ * out (receive), and the task sleeps instead of spinning while it
+ * waits for the bus.
+ */
+
+#include <Arduino.h>
+#include <esp_attr.h>
+
+#include "sd_spi_dma.h"
+
+// HSPI on the ESP32-S3 is the SPI3 peripheral
+static const spi_host_device_t SD_DMA_HOST = SPI3_HOST;
+
+// One 512-byte sector is split into two 256-byte chunks; multi-KB
+// payloads use up to 1KB per chunk
+static const size_t DMA_CHUNK = 1024;
+
+static DMA_ATTR uint8_t txBounce[2][DMA_CHUNK];
+static DMA_ATTR uint8_t rxBounce[2][DMA_CHUNK];
+static DMA_ATTR uint8_t ones[DMA_CHUNK];
+
+// ===============================
+// Setup / teardown
+// ===============================
+
+void SdSpiDmaDriver::begin(SdSpiConfig config) {
+    (void)config;
+
+    if (wanted == active && (active == SD_DRIVER_ARDUINO || busReady)) return;
+
+    if (active == SD_DRIVER_DMA) dmaStop();
+
+    if (wanted == SD_DRIVER_DMA && dmaStart()) {
+        active = SD_DRIVER_DMA;
+        return;
+    }
+
+    // Arduino path (also the fallback if the DMA bus fails to start)
+    spi.begin(sckPin, misoPin, mosiPin, csPin);
+    active = SD_DRIVER_ARDUINO;
+}
+
+void SdSpiDmaDriver::end() {
+    if (active == SD_DRIVER_DMA) {
+        dmaStop();
+        spi.begin(sckPin, misoPin, mosiPin, csPin);
+        active = SD_DRIVER_ARDUINO;
+    }
+}
+
+bool SdSpiDmaDriver::dmaStart() {
+    // The Arduino HAL drives the same peripheral directly; release
+    // it before spi_master claims the host
+    spi.end();
+
+    memset(ones, 0xFF, sizeof(ones));
+
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num = mosiPin;
+    bus.miso_io_num = misoPin;
+    bus.sclk_io_num = sckPin;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = DMA_CHUNK;
+
+    if (spi_bus_initialize(SD_DMA_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK) return false;
+    busReady = true;
+
+    if (!dmaAddDevice()) {
+        dmaStop();
+        return false;
+    }
+    return true;
+}
+
+bool SdSpiDmaDriver::dmaAddDevice() {
+    spi_device_interface_config_t cfg = {};
+    cfg.mode = 0;
+    cfg.clock_speed_hz = (int)sckHz;
+    cfg.spics_io_num = -1;          // SdFat drives CS itself
+    cfg.queue_size = 2;
+
+    return spi_bus_add_device(SD_DMA_HOST, &cfg, &dev) == ESP_OK;
+}
+
+void SdSpiDmaDriver::dmaStop() {
+    if (acquired) {
+        spi_device_release_bus(dev);
+        acquired = false;
+    }
+    if (dev) {
+        spi_bus_remove_device(dev);
+        dev = nullptr;
+    }
+    if (busReady) {
+        spi_bus_free(SD_DMA_HOST);
+        busReady = false;
+    }
+}
+
+void SdSpiDmaDriver::setSckSpeed(uint32_t maxSck) {
+    settings = SPISettings(maxSck, MSBFIRST, SPI_MODE0);
+    if (maxSck == sckHz) return;
+    sckHz = maxSck;
+
+    // spi_master fixes the clock per device — re-add at the new rate
+    if (active == SD_DRIVER_DMA && dev) {
+        bool wasAcquired = acquired;
+        if (acquired) {
+            spi_device_release_bus(dev);
+            acquired = false;
+        }
+        spi_bus_remove_device(dev);
+        dev = nullptr;
+        dmaAddDevice();
+        if (wasAcquired && dev) {
+            spi_device_acquire_bus(dev, portMAX_DELAY);
+            acquired = true;
+        }
+    }
+}
+
+// ===============================
+// Bus ownership
+// ===============================
+
+void SdSpiDmaDriver::activate() {
+    if (active == SD_DRIVER_ARDUINO) {
+        spi.beginTransaction(settings);
+        return;
+    }
+    if (dev && !acquired) {
+        spi_device_acquire_bus(dev, portMAX_DELAY);
+        acquired = true;
+    }
+}
+
+void SdSpiDmaDriver::deactivate() {
+    if (active == SD_DRIVER_ARDUINO) {
+        spi.endTransaction();
+        return;
+    }
+    if (acquired) {
+        spi_device_release_bus(dev);
+        acquired = false;
+    }
+}
+
+// ===============================
+// Transfers
+// ===============================
+
+uint8_t SdSpiDmaDriver::pollByte(uint8_t out) {
+    spi_transaction_t t = {};
+    t.flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+    t.length = 8;
+    t.tx_data[0] = out;
+    spi_device_polling_transmit(dev, &t);
+    return t.rx_data[0];
+}
+
+// Ping-pong over the two bounce buffers. src == nullptr clocks out
+// 0xFF (receive); dst == nullptr discards MISO (send).
+void SdSpiDmaDriver::dmaTransfer(const uint8_t* src, uint8_t* dst, size_t count) {
+    size_t chunk = (count / 2) & ~(size_t)3;
+    if (chunk > DMA_CHUNK) chunk = DMA_CHUNK;
+    if (chunk == 0) chunk = count;
+
+    const size_t chunks = (count + chunk - 1) / chunk;
+    spi_transaction_t t[2];
+
+    auto queue = [&](size_t k) {
+        const int b = k & 1;
+        const size_t off = k * chunk;
+        const size_t len = (count - off < chunk) ? count - off : chunk;
+
+        memset(&t[b], 0, sizeof(t[b]));
+        t[b].length = len * 8;
+        if (src) {
+            memcpy(txBounce[b], src + off, len);
+            t[b].tx_buffer = txBounce[b];
+        } else {
+            t[b].tx_buffer = ones;
+        }
+        if (dst) {
+            t[b].rx_buffer = rxBounce[b];
+            t[b].rxlength = len * 8;
+        }
+        spi_device_queue_trans(dev, &t[b], portMAX_DELAY);
+    };
+
+    queue(0);
+    if (chunks > 1) queue(1);
+
+    for (size_t k = 0; k < chunks; k++) {
+        spi_transaction_t *done;
+        spi_device_get_trans_result(dev, &done, portMAX_DELAY);
+
+        if (dst) {
+            const size_t off = k * chunk;
+            const size_t len = (count - off < chunk) ? count - off : chunk;
+            memcpy(dst + off, rxBounce[k & 1], len);
+        }
+        if (k + 2 < chunks) queue(k + 2);
+    }
+}
+
+uint8_t SdSpiDmaDriver::receive() {
+    if (active == SD_DRIVER_ARDUINO) return spi.transfer(0xFF);
+    return pollByte(0xFF);
+}
+
+uint8_t SdSpiDmaDriver::receive(uint8_t* buf, size_t count) {
+    if (active == SD_DRIVER_ARDUINO) {
+        spi.transferBytes(nullptr, buf, count);
+        return 0;
+    }
+
+    // DMA receive lengths must be whole words; odd tails (never
+    // seen for sector data) go byte by byte
+    if (count < 8 || (count & 3)) {
+        for (size_t i = 0; i < count; i++) buf[i] = pollByte(0xFF);
+        return 0;
+    }
+    dmaTransfer(nullptr, buf, count);
+    return 0;
+}
+
+void SdSpiDmaDriver::send(uint8_t data) {
+    if (active == SD_DRIVER_ARDUINO) {
+        spi.transfer(data);
+        return;
+    }
+    pollByte(data);
+}
+
+void SdSpiDmaDriver::send(const uint8_t* buf, size_t count) {
+    if (active == SD_DRIVER_ARDUINO) {
+        spi.writeBytes(buf, count);
+        return;
+    }
+
+    if (count < 8) {
+        for (size_t i = 0; i < count; i++) pollByte(buf[i]);
+        return;
+    }
+    dmaTransfer(buf, nullptr, count);
+}
@@ -0,0 +1,60 @@
+/**
+ * SdFat user SPI driver for the Cardputer's HSPI bus
+ * Selected with SPI_DRIVER_SELECT=3 (platformio.ini). Two modes
+ * so the speed test can compare them on the same card:
+ *  - SD_DRIVER_ARDUINO: SPIClass calls, as SdFat's own ESP32 driver
+ *  - SD_DRIVER_DMA:     ESP-IDF spi_master, queued DMA transfers
+ */
+
+#pragma once
+
+#include <SPI.h>
+#include <SdFat.h>
+#include <driver/spi_master.h>
+
+enum SdDriverMode : uint8_t {
+    SD_DRIVER_ARDUINO = 0,
+    SD_DRIVER_DMA     = 1
+};
+
+class SdSpiDmaDriver : public SdSpiBaseClass {
+public:
+    SdSpiDmaDriver(SPIClass &spi, int sck, int miso, int mosi, int cs)
+        : spi(spi), sckPin(sck), misoPin(miso), mosiPin(mosi), csPin(cs) {}
+
+    // Takes effect at the next begin() (i.e. next sd.begin / cardBegin)
+    void setMode(SdDriverMode m) { wanted = m; }
+    SdDriverMode mode() const { return active; }
+    const char* modeName() const { return active == SD_DRIVER_DMA ? "DMA" : "Arduino"; }
+
+    // --- SdSpiBaseClass ---
+    void activate();
+    void begin(SdSpiConfig config);
+    void deactivate();
+    void end();
+    uint8_t receive();
+    uint8_t receive(uint8_t* buf, size_t count);
+    void send(uint8_t data);
+    void send(const uint8_t* buf, size_t count);
+    void setSckSpeed(uint32_t maxSck);
+
+private:
+    bool dmaStart();
+    void dmaStop();
+    bool dmaAddDevice();
+    void dmaTransfer(const uint8_t* src, uint8_t* dst, size_t count);
+    uint8_t pollByte(uint8_t out);
+
+    SPIClass &spi;
+    int sckPin, misoPin, mosiPin, csPin;
+
+    SdDriverMode wanted = SD_DRIVER_DMA;
+    SdDriverMode active = SD_DRIVER_ARDUINO;
+
+    SPISettings settings = SPISettings(400000, MSBFIRST, SPI_MODE0);
+    uint32_t sckHz = 400000;
+
+    bool busReady = false;
+    bool acquired = false;
+    spi_device_handle_t dev = nullptr;
+};
@@ -0,0 +1,30 @@
+/**
+ * Sector Device
+ * The handful of raw card calls the test engines use, behind a
+ * small interface so they can run against the real card
+ * (sd_card_device.h) or a simulated one (sim_card.h) with
+ * injected faults. Nothing here needs Arduino or SdFat, so the
+ * engines built on it also run on a host (platformio.ini, native).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class SectorDevice {
+public:
+    virtual ~SectorDevice() {}
+
+    virtual bool readSectors(uint32_t sector, uint8_t *dst, size_t n) = 0;
+    virtual bool writeSectors(uint32_t sector, const uint8_t *src, size_t n) = 0;
+    // ERASE (CMD32/33/38) of n sectors; blocks until the card is ready
+    virtual bool eraseSectors(uint32_t sector, uint32_t n) = 0;
+    virtual uint32_t sectorCount() = 0;
+    // The raw 16-byte CID register
+    virtual bool readCID(uint8_t cid[16]) = 0;
+    virtual bool syncDevice() = 0;
+    // Polls until the card stops signalling busy; false if it is
+    // still busy after timeoutMs
+    virtual bool waitReady(uint32_t timeoutMs) = 0;
+};
@@ -0,0 +1,213 @@
+/**
+ * Secure Erase — chunk planning, erase loop and sample verify
+ * Erase time per the SD spec is ERASE_TIMEOUT / ERASE_SIZE per AU
+ * plus ERASE_OFFSET per command, so the chunk is as many AUs as
+ * fit in ERASE_BUDGET_MS. The spec figure is a worst case; chunks
+ * that finish in under a quarter of the budget double in size.
+ */
+
+#include <Arduino.h>
+
+#include "secure_erase.h"
+#include "io_arena.h"
+
+static const uint32_t ERASE_START_CHUNK = 8192;        // 4MB without SD Status timing
+static const uint32_t ERASE_MAX_CHUNK = 8388608;       // 4GB
+static const int ERASE_MAX_RETRIES = 8;                // In a row
+static const uint32_t ERASE_ZERO_SECTORS = 32;         // 16KB tail buffer
+static const uint32_t ERASE_READY_MS = 60000;          // Card still busy after a failed erase
+static const uint32_t ERASE_READY_SLICE_MS = 1000;     // Abort checked between slices
+
+// ===============================
+// Plan
+// ===============================
+
+static uint32_t nextPowerOfTwo(uint32_t n) {
+    uint32_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+ErasePlan planErase(const CsdInfo &csd, const SdStatusInfo *sds) {
+    ErasePlan plan;
+    plan.fromSdStatus = false;
+
+    // SdFat rejects ranges not aligned to the CSD erase unit, which it
+    // checks as a power-of-two mask
+    plan.unitSectors = csd.eraseBlkEn ? 1 : nextPowerOfTwo(csd.eraseSectorSize);
+    if (sds && sds->auSectors > plan.unitSectors && sds->auSectors % plan.unitSectors == 0) {
+        plan.unitSectors = sds->auSectors;
+    }
+
+    uint64_t chunk = ERASE_START_CHUNK;
+    if (sds && sds->eraseSize && sds->eraseTimeoutS && sds->auSectors &&
+        sds->eraseOffsetS * 1000UL < ERASE_BUDGET_MS) {
+        uint64_t availMs = ERASE_BUDGET_MS - sds->eraseOffsetS * 1000UL;
+        uint64_t aus = (uint64_t)sds->eraseSize * availMs / (sds->eraseTimeoutS * 1000UL);
+        if (aus == 0) aus = 1;
+        chunk = aus * sds->auSectors;
+        plan.fromSdStatus = true;
+    }
+    if (chunk > ERASE_MAX_CHUNK) chunk = ERASE_MAX_CHUNK;
+
+    chunk -= chunk % plan.unitSectors;
+    if (chunk < plan.unitSectors) chunk = plan.unitSectors;
+    plan.chunkSectors = (uint32_t)chunk;
+    return plan;
+}
+
+// ===============================
+// Erase
+// ===============================
+
+// After SdFat gives up on an erase, the card is most likely still
+// erasing: wait for it, a slice at a time so abort still works
+static EraseResult waitCardReady(SectorDevice *dev, uint32_t pos, const EraseReport &rep,
+                                 EraseProgressFn progress) {
+    for (uint32_t waited = 0; waited < ERASE_READY_MS; waited += ERASE_READY_SLICE_MS) {
+        if (dev->waitReady(ERASE_READY_SLICE_MS)) return ERASE_OK;
+        if (progress && !progress(ERASE_STAGE_ERASE, (uint64_t)pos * 100 / rep.sectors)) {
+            return ERASE_ABORTED;
+        }
+    }
+    return ERASE_IO_ERROR;
+}
+
+static EraseResult eraseAll(SectorDevice *dev, EraseReport &rep, EraseProgressFn progress) {
+    const uint32_t unit = rep.plan.unitSectors;
+    const uint32_t end = rep.sectors - rep.sectors % unit;
+    uint32_t chunk = rep.plan.chunkSectors;
+    uint32_t pos = 0;
+    int failsInRow = 0;
+
+    while (pos < end) {
+        uint32_t n = end - pos < chunk ? end - pos : chunk;
+
+        uint32_t t0 = millis();
+        bool ok = dev->eraseSectors(pos, n);
+        uint32_t ms = millis() - t0;
+
+        if (!ok) {
+            // Most likely the busy wait timed out: let the card finish,
+            // then go again with half the chunk
+            EraseResult ready = waitCardReady(dev, pos, rep, progress);
+            if (ready != ERASE_OK) return ready;
+            if (chunk == unit || ++failsInRow > ERASE_MAX_RETRIES) return ERASE_IO_ERROR;
+            rep.retries++;
+            chunk = chunk / 2 - (chunk / 2) % unit;
+            if (chunk < unit) chunk = unit;
+            continue;
+        }
+        failsInRow = 0;
+
+        rep.chunks++;
+        rep.erasedSectors += n;
+        rep.eraseMs += ms;
+        if (ms > rep.maxChunkMs) rep.maxChunkMs = ms;
+        if (n > rep.largestChunk) rep.largestChunk = n;
+        pos += n;
+
+        if (n == chunk && ms < ERASE_BUDGET_MS / 4 && chunk <= ERASE_MAX_CHUNK / 2) {
+            chunk *= 2;
+        }
+
+        if (progress && !progress(ERASE_STAGE_ERASE, (uint64_t)pos * 100 / rep.sectors)) {
+            return ERASE_ABORTED;
+        }
+    }
+
+    if (rep.eraseMs) rep.eraseKBs = (uint64_t)rep.erasedSectors / 2 * 1000 / rep.eraseMs;
+
+    // Tail smaller than one unit: the erase command can't reach it
+    if (end < rep.sectors) {
+        ArenaScope scope("erase");
+        uint8_t *zeros = arenaAlloc(ERASE_ZERO_SECTORS * 512);
+        if (!zeros) return ERASE_NO_MEMORY;
+        memset(zeros, 0, ERASE_ZERO_SECTORS * 512);
+
+        for (uint32_t s = end; s < rep.sectors; s += ERASE_ZERO_SECTORS) {
+            uint32_t n = rep.sectors - s < ERASE_ZERO_SECTORS ? rep.sectors - s : ERASE_ZERO_SECTORS;
+            if (!dev->writeSectors(s, zeros, n)) return ERASE_IO_ERROR;
+            rep.zeroedSectors += n;
+        }
+        dev->syncDevice();
+    }
+
+    if (progress && !progress(ERASE_STAGE_ERASE, 100)) return ERASE_ABORTED;
+    return ERASE_OK;
+}
+
+// ===============================
+// Verify
+// ===============================
+
+// 0x00 / 0xFF if every byte is that value, else -1
+static int uniformByte(const uint8_t *buf) {
+    uint8_t b = buf[0];
+    if (b != 0x00 && b != 0xFF) return -1;
+    for (int i = 1; i < 512; i++) {
+        if (buf[i] != b) return -1;
+    }
+    return b;
+}
+
+static EraseResult verifySamples(SectorDevice *dev, uint32_t seed, EraseReport &rep,
+                                 EraseProgressFn progress) {
+    ArenaScope scope("erase");
+    uint8_t *buf = arenaAlloc(512);
+    if (!buf) return ERASE_NO_MEMORY;
+
+    const uint32_t samples = rep.sectors < ERASE_SAMPLES ? rep.sectors : ERASE_SAMPLES;
+    const uint32_t stratum = rep.sectors / samples;
+    uint32_t ones = 0, zeros = 0;
+    uint32_t x = seed ? seed : 1;
+
+    for (uint32_t k = 0; k < samples; k++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        // Always check sector 0: the partition table is what a reader sees first
+        uint32_t s = k == 0 ? 0 : k * stratum + x % stratum;
+
+        if (!dev->readSectors(s, buf, 1)) return ERASE_IO_ERROR;
+        rep.samples++;
+
+        int b = uniformByte(buf);
+        if (b < 0) {
+            if (rep.samplesBad++ == 0) rep.firstBad = s;
+        } else if (b == 0xFF) {
+            ones++;
+        } else {
+            zeros++;
+        }
+
+        if (progress && !progress(ERASE_STAGE_VERIFY, (k + 1) * 100 / samples)) {
+            return ERASE_ABORTED;
+        }
+    }
+
+    rep.erasedByte = ones >= zeros ? 0xFF : 0x00;
+    return rep.samplesBad ? ERASE_NOT_CLEAN : ERASE_OK;
+}
+
+// ===============================
+// Run
+// ===============================
+
+EraseResult secureErase(SectorDevice *dev, const CsdInfo &csd, const SdStatusInfo *sds,
+                        uint32_t seed, EraseReport &rep, EraseProgressFn progress) {
+    memset(&rep, 0, sizeof(rep));
+    rep.firstBad = 0xFFFFFFFFUL;
+    rep.sectors = dev->sectorCount();
+    rep.plan = planErase(csd, sds);
+
+    if (!(csd.ccc & (1 << 5))) return ERASE_UNSUPPORTED;
+    if (csd.permWriteProtect || csd.tmpWriteProtect) return ERASE_WRITE_PROTECTED;
+    if (rep.sectors == 0) return ERASE_IO_ERROR;
+
+    EraseResult res = eraseAll(dev, rep, progress);
+    if (res != ERASE_OK) return res;
+
+    return verifySamples(dev, seed, rep, progress);
+}
@@ -0,0 +1,71 @@
+/**
+ * Secure Erase
+ * Whole-card sanitize with the card's own ERASE command instead
+ * of writing every sector over SPI. The range is erased in chunks
+ * sized so each one finishes inside SdFat's 10s busy timeout:
+ *  - from the SD Status erase timing (ERASE_SIZE AUs take
+ *    ERASE_TIMEOUT seconds, plus ERASE_OFFSET per command)
+ *  - without it, start small and double while chunks stay fast
+ * Chunks are aligned to the AU and CSD erase unit; a tail that
+ * does not fill a unit is overwritten with zeros instead.
+ * Afterwards one random sector per stratum is read back and must
+ * be uniformly 0x00 or 0xFF.
+ * DESTRUCTIVE: the whole card, including the partition table.
+ */
+
+#pragma once
+
+#include "sector_device.h"
+#include "card_id.h"
+
+// Each erase command must finish well inside SdFat's 10s wait
+constexpr uint32_t ERASE_BUDGET_MS = 8000;
+
+// Verify samples across the card
+constexpr int ERASE_SAMPLES = 256;
+
+struct ErasePlan {
+    uint32_t unitSectors;        // Alignment of every chunk
+    uint32_t chunkSectors;       // First chunk size
+    bool     fromSdStatus;       // Chunk sized from ERASE_SIZE/TIMEOUT
+};
+
+struct EraseReport {
+    ErasePlan plan;
+    uint32_t sectors;            // Card size
+    uint32_t chunks;             // Erase commands that succeeded
+    uint32_t retries;            // Failed commands retried at half size
+    uint32_t erasedSectors;
+    uint32_t zeroedSectors;      // Unaligned tail, written instead
+    uint32_t largestChunk;       // Sectors
+    uint32_t maxChunkMs;
+    uint32_t eraseMs;            // Erase stage only
+    uint32_t eraseKBs;           // Erase throughput
+
+    uint32_t samples;
+    uint32_t samplesBad;         // Still holding data
+    uint32_t firstBad;           // 0xFFFFFFFF if none
+    uint8_t  erasedByte;         // 0x00 or 0xFF, as the card reads back
+};
+
+enum EraseResult : uint8_t {
+    ERASE_OK = 0,
+    ERASE_NOT_CLEAN,             // Samples still hold data
+    ERASE_UNSUPPORTED,           // Card lacks command class 5
+    ERASE_WRITE_PROTECTED,
+    ERASE_IO_ERROR,
+    ERASE_NO_MEMORY,
+    ERASE_ABORTED
+};
+
+enum EraseStage : uint8_t { ERASE_STAGE_ERASE = 0, ERASE_STAGE_VERIFY };
+
+// Called after each chunk / sample with the stage and 0-100.
+// Return false to abort.
+typedef bool (*EraseProgressFn)(EraseStage stage, uint8_t percent);
+
+// sds is nullptr when the SD Status could not be read
+ErasePlan planErase(const CsdInfo &csd, const SdStatusInfo *sds);
+
+EraseResult secureErase(SectorDevice *dev, const CsdInfo &csd, const SdStatusInfo *sds,
+                        uint32_t seed, EraseReport &rep, EraseProgressFn progress);
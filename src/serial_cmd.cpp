@@ -0,0 +1,162 @@
+/**
+ * Serial Commands — line assembly, parsing and dispatch
+ */
+
+#include "serial_cmd.h"
+
+// Last PROGRESS sent, so a command only reports changes
+static const char *progressName = nullptr;
+static int progressPercent = -1;
+
+// ===============================
+// Arguments
+// ===============================
+
+const char* CmdArgs::get(const char *k) const {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(key[i], k) == 0) return value[i];
+    }
+    return nullptr;
+}
+
+bool CmdArgs::size(const char *k, uint64_t def, uint64_t &out) const {
+    const char *v = get(k);
+    if (!v) {
+        out = def;
+        return true;
+    }
+    return cmdParseSize(v, out);
+}
+
+bool CmdArgs::number(const char *k, uint32_t def, uint32_t &out) const {
+    uint64_t n;
+    if (!size(k, def, n) || n > 0xFFFFFFFFULL) return false;
+    out = (uint32_t)n;
+    return true;
+}
+
+bool cmdParseSize(const char *text, uint64_t &bytes) {
+    if (!text || !*text) return false;
+
+    uint64_t n = 0;
+    const char *p = text;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+        if (!*p) return false;
+        for (; *p; p++) {
+            int d;
+            if (*p >= '0' && *p <= '9')      d = *p - '0';
+            else if (*p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+            else if (*p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+            else return false;
+            if (n >> 60) return false;
+            n = (n << 4) | d;
+        }
+        bytes = n;
+        return true;
+    }
+
+    for (; *p >= '0' && *p <= '9'; p++) {
+        if (n > (UINT64_MAX - 9) / 10) return false;
+        n = n * 10 + (*p - '0');
+    }
+    if (p == text) return false;
+
+    int shift = 0;
+    switch (*p) {
+        case '\0':           break;
+        case 'k': case 'K':  shift = 10; p++; break;
+        case 'm': case 'M':  shift = 20; p++; break;
+        case 'g': case 'G':  shift = 30; p++; break;
+        default:             return false;
+    }
+    if (*p) return false;
+    if (shift && (n >> (64 - shift))) return false;
+
+    bytes = n << shift;
+    return true;
+}
+
+// ===============================
+// Lines
+// ===============================
+
+bool cmdPoll(Stream &io, char *line, size_t max, size_t &len) {
+    while (io.available() > 0) {
+        char c = (char)io.read();
+        if (c == '\r' || c == CMD_ABORT) continue;
+        if (c == '\n') {
+            line[len] = '\0';
+            bool done = len > 0;
+            len = 0;
+            if (done) return true;
+            continue;
+        }
+        if (len + 1 < max) line[len++] = c;
+    }
+    return false;
+}
+
+static char *skipSpaces(char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+bool cmdParse(char *line, CmdArgs &args, Stream &io) {
+    args.name = "";
+    args.count = 0;
+
+    char *p = skipSpaces(line);
+    args.name = p;
+    while (*p && *p != ' ' && *p != '\t') p++;
+    if (*p) *p++ = '\0';
+
+    while (*(p = skipSpaces(p))) {
+        char *tok = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        if (*p) *p++ = '\0';
+
+        char *eq = strchr(tok, '=');
+        if (!eq || eq == tok || args.count == CMD_MAX_ARGS) {
+            io.printf("ERROR %s bad argument %s\n", args.name, tok);
+            return false;
+        }
+        *eq = '\0';
+        args.key[args.count] = tok;
+        args.value[args.count] = eq + 1;
+        args.count++;
+    }
+    return true;
+}
+
+void cmdDispatch(const CmdArgs &args, const SerialCommand *table, int count, Stream &io) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(table[i].name, args.name) != 0) continue;
+
+        progressName = nullptr;
+        progressPercent = -1;
+        io.printf("START %s\n", args.name);
+        if (table[i].run(args, io)) io.printf("OK %s\n", args.name);
+        return;
+    }
+    io.printf("ERROR %s unknown command (try help)\n", args.name);
+}
+
+// ===============================
+// While a command runs
+// ===============================
+
+void cmdProgress(Stream &io, const char *name, uint8_t percent) {
+    if (name == progressName && percent == progressPercent) return;
+    progressName = name;
+    progressPercent = percent;
+    io.printf("PROGRESS %s %d\n", name, percent);
+}
+
+bool cmdAbortRequested(Stream &io) {
+    if (io.available() > 0 && io.peek() == CMD_ABORT) {
+        io.read();
+        return true;
+    }
+    return false;
+}
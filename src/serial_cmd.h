@@ -0,0 +1,74 @@
+/**
+ * Serial Commands
+ * Line-based command protocol on USB CDC, so a test rig can run
+ * the engines without anyone at the keyboard:
+ *
+ *   speed size=64k count=100
+ *   probe n=256
+ *   format fs=exfat
+ *
+ * A line is a command name and key=value arguments. Sizes take
+ * k / m / g suffixes (powers of 1024), numbers may be 0x hex;
+ * values cannot contain spaces. Every command answers with
+ * lines of the form
+ *
+ *   START <cmd>
+ *   PROGRESS <cmd> <percent>          (as it runs)
+ *   RESULT <cmd> key=value ...        (as results arrive)
+ *   OK <cmd>  |  ERROR <cmd> <reason> (always exactly one, last)
+ *
+ * OK means the command ran to the end, not that the card passed:
+ * the verdict is in its RESULT lines. Commands are taken while the
+ * menu is showing; Ctrl-C (0x03) from the host aborts a running
+ * one. The command table itself lives with the UI in main.cpp.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+constexpr int CMD_MAX_ARGS = 8;
+constexpr size_t CMD_MAX_LINE = 128;
+
+constexpr char CMD_ABORT = 0x03;
+
+struct CmdArgs {
+    const char *name;
+    int count;
+    const char *key[CMD_MAX_ARGS];
+    const char *value[CMD_MAX_ARGS];
+
+    // nullptr if the key was not given
+    const char* get(const char *k) const;
+
+    // Missing key → def. False if the value does not parse.
+    bool size(const char *k, uint64_t def, uint64_t &out) const;
+    bool number(const char *k, uint32_t def, uint32_t &out) const;
+};
+
+typedef bool (*CmdHandler)(const CmdArgs &args, Stream &io);
+
+struct SerialCommand {
+    const char *name;
+    const char *usage;           // Arguments, for "help"
+    CmdHandler  run;             // False = failed (handler printed ERROR)
+};
+
+// Collects bytes into `line`; true once a non-empty line is complete.
+// `len` carries the partial line between calls.
+bool cmdPoll(Stream &io, char *line, size_t max, size_t &len);
+
+// Splits `line` in place. False (and ERROR sent) on a malformed line.
+bool cmdParse(char *line, CmdArgs &args, Stream &io);
+
+// Runs the matching entry, wrapped in START / OK. Unknown → ERROR.
+void cmdDispatch(const CmdArgs &args, const SerialCommand *table, int count, Stream &io);
+
+// "64k" → 65536. False on junk or overflow.
+bool cmdParseSize(const char *text, uint64_t &bytes);
+
+// PROGRESS only when the percentage changes
+void cmdProgress(Stream &io, const char *name, uint8_t percent);
+
+// True once the host has sent CMD_ABORT (consumed)
+bool cmdAbortRequested(Stream &io);
@@ -0,0 +1,122 @@
+/**
+ * Simulated SD Card — RAM store and fault injection
+ * Faults draw from one xorshift32 stream seeded from
+ * SimFaults::seed, so a run is repeatable call for call.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_card.h"
+#include "clock_source.h"
+
+bool SimCard::begin(uint32_t sectors, const SimFaults &f) {
+    end();
+
+    store = (uint8_t *)calloc(sectors, 512);
+    if (!store) return false;
+
+    realSectors = sectors;
+    faults = f;
+    rng = f.seed ? f.seed : 1;
+    writeCalls = 0;
+    memset(&count, 0, sizeof(count));
+    return true;
+}
+
+void SimCard::end() {
+    free(store);
+    store = nullptr;
+    realSectors = 0;
+}
+
+uint32_t SimCard::next() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+uint32_t SimCard::sectorCount() {
+    return faults.advertisedSectors ? faults.advertisedSectors : realSectors;
+}
+
+// Fake capacity: everything past the real size lands on the real
+// sectors again, modulo their count
+uint8_t *SimCard::physical(uint32_t sector) {
+    return store + (size_t)(sector % realSectors) * 512;
+}
+
+bool SimCard::readSectors(uint32_t sector, uint8_t *dst, size_t n) {
+    if (!store || sector + n > sectorCount()) return false;
+
+    for (size_t i = 0; i < n; i++) {
+        uint8_t *out = dst + i * 512;
+        memcpy(out, physical(sector + i), 512);
+        count.reads++;
+
+        if (faults.bitFlipPpm && next() % 1000000 < faults.bitFlipPpm) {
+            uint32_t bit = next() % (512 * 8);
+            out[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+            count.flips++;
+        }
+    }
+    return true;
+}
+
+bool SimCard::writeSectors(uint32_t sector, const uint8_t *src, size_t n) {
+    if (!store || sector + n > sectorCount()) return false;
+
+    writeCalls++;
+    if (faults.spikeEvery && writeCalls % faults.spikeEvery == 0) {
+        clockDelayUs(faults.spikeUs);
+        count.spikes++;
+    }
+    if (faults.failEvery && writeCalls % faults.failEvery == 0) {
+        count.failedWrites++;
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t phys = (sector + i) % realSectors;
+        count.writes++;
+
+        if (faults.stuckCount && phys >= faults.stuckFirst &&
+            phys - faults.stuckFirst < faults.stuckCount) {
+            count.stuckWrites++;
+            continue;
+        }
+        memcpy(store + (size_t)phys * 512, src + i * 512, 512);
+    }
+    return true;
+}
+
+bool SimCard::eraseSectors(uint32_t sector, uint32_t n) {
+    if (!store || n == 0 || sector + n > sectorCount()) return false;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t phys = (sector + i) % realSectors;
+        if (faults.stuckCount && phys >= faults.stuckFirst &&
+            phys - faults.stuckFirst < faults.stuckCount) {
+            continue;
+        }
+        memset(store + (size_t)phys * 512, 0xFF, 512);
+        count.erased++;
+    }
+    return true;
+}
+
+// Raw register bytes, like cidSerial() reads them: MID 0x00 (no
+// real maker), OID "SM", PNM "SIMCD", PSN = seed
+bool SimCard::readCID(uint8_t raw[16]) {
+    memset(raw, 0, 16);
+
+    memcpy(raw + 1, "SMSIMCD", 7);
+    raw[8]  = 0x10;
+    raw[9]  = (uint8_t)(faults.seed >> 24);
+    raw[10] = (uint8_t)(faults.seed >> 16);
+    raw[11] = (uint8_t)(faults.seed >> 8);
+    raw[12] = (uint8_t)faults.seed;
+    raw[15] = 0x01;
+    return store != nullptr;
+}
@@ -0,0 +1,72 @@
+/**
+ * Simulated SD Card
+ * A RAM-backed SectorDevice that misbehaves on purpose, so the
+ * soak test and capacity probe can be checked against known-bad
+ * "cards" without owning any. Fully deterministic for a given
+ * seed: the same faults hit the same sectors every run.
+ *
+ * Faults:
+ *  - fake capacity: advertises more sectors than it stores and
+ *    wraps addresses onto the real ones, like counterfeit cards
+ *  - bit flips:     random single-bit errors on read
+ *  - stuck sectors: a range that silently ignores writes
+ *  - latency:       every Nth write stalls
+ *  - write errors:  every Nth write fails without writing
+ * Erase sets sectors to 0xFF; stuck sectors ignore it too.
+ */
+
+#pragma once
+
+#include "sector_device.h"
+
+struct SimFaults {
+    uint32_t advertisedSectors;  // 0 = the real size (no wrap)
+    uint32_t bitFlipPpm;         // Chance per sector read, parts per million
+    uint32_t stuckFirst;         // Sectors that ignore writes
+    uint32_t stuckCount;
+    uint32_t spikeEvery;         // Every Nth write call stalls (0 = never)
+    uint32_t spikeUs;            // Length of a stall
+    uint32_t failEvery;          // Every Nth write call fails (0 = never)
+    uint32_t seed;
+};
+
+struct SimCounters {
+    uint32_t reads;              // Sector-level
+    uint32_t writes;
+    uint32_t flips;
+    uint32_t stuckWrites;
+    uint32_t spikes;
+    uint32_t failedWrites;
+    uint32_t erased;             // Sector-level
+};
+
+class SimCard : public SectorDevice {
+public:
+    SimCard() {}
+    ~SimCard() { end(); }
+
+    // Allocates `realSectors` * 512 bytes. False if out of memory.
+    bool begin(uint32_t realSectors, const SimFaults &faults);
+    void end();
+
+    const SimCounters& counters() const { return count; }
+
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t n) override;
+    bool writeSectors(uint32_t sector, const uint8_t *src, size_t n) override;
+    bool eraseSectors(uint32_t sector, uint32_t n) override;
+    uint32_t sectorCount() override;
+    bool readCID(uint8_t cid[16]) override;
+    bool syncDevice() override { return store != nullptr; }
+    bool waitReady(uint32_t) override { return store != nullptr; }   // Never busy
+
+private:
+    uint32_t next();
+    uint8_t *physical(uint32_t sector);
+
+    uint8_t *store = nullptr;
+    uint32_t realSectors = 0;
+    uint32_t rng = 1;
+    uint32_t writeCalls = 0;
+    SimFaults faults = {};
+    SimCounters count = {};
+};
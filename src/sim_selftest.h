@@ -0,0 +1,43 @@
+/**
+ * Sim Self-Test
+ * Runs the capacity probe and a short soak against RAM-backed
+ * simulated cards with known faults, and checks each detector
+ * flags exactly what it should. The healthy run doubles as a
+ * benchmark of the soak engine itself (pattern + compare cost).
+ *
+ * Shared by the Sim Self-Test screen and the native tests (test/),
+ * so both hold the detectors to the same expectations.
+ */
+
+#pragma once
+
+#include "sim_card.h"
+
+// Expectation per detector: -1 don't care, 0 must pass, 1 must flag
+struct SimScenario {
+    const char* name;
+    SimFaults   faults;
+    int8_t      probe;
+    int8_t      soak;
+    int8_t      latency;
+};
+
+constexpr uint32_t SIM_SECTORS = 192;            // 96KB of RAM
+constexpr uint32_t SIM_SPIKE_US = 20000;
+constexpr uint32_t SIM_SLOW_US = 10000;          // "Flagged" latency
+
+// The first one is the healthy card
+extern const SimScenario SIM_SCENARIOS[];
+extern const int SIM_SCENARIO_COUNT;
+
+struct SimOutcome {
+    bool     probeFlag;
+    bool     soakFlag;
+    bool     slowFlag;
+    uint32_t maxLatencyUs;       // Slowest soak write
+    float    engineMBs;          // Soak engine speed, healthy scenario only
+    bool     ok;                 // Every detector as expected
+};
+
+// Runs scenario `index` on `sim`. False if the card does not fit in RAM.
+bool simRunScenario(SimCard &sim, int index, SimOutcome &out);
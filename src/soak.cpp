@@ -0,0 +1,195 @@
+/**
+ * Endurance Soak Test — engine
+ * Every cycle gets its own pattern and seed, so data left over
+ * from the previous cycle (a dropped write) never verifies.
+ * Errors are counted per 512-byte sector.
+ */
+
+#include <string.h>
+
+#include "soak.h"
+#include "io_arena.h"
+#include "clock_source.h"
+
+// Progress callback interval: 1MB
+static const uint32_t SOAK_REPORT_SECTORS = 2048;
+
+const char* soakPatternName(uint8_t pattern) {
+    switch (pattern) {
+        case SOAK_PAT_ADDRESS: return "address";
+        case SOAK_PAT_INVERSE: return "inverse";
+        case SOAK_PAT_RANDOM:  return "random";
+        case SOAK_PAT_CHECKER: return "checker";
+    }
+    return "?";
+}
+
+// ===============================
+// Patterns
+// ===============================
+
+static void fillSector(uint32_t *w, uint8_t pattern, uint32_t sector, uint32_t seed) {
+    switch (pattern) {
+        case SOAK_PAT_ADDRESS:
+            for (uint32_t i = 0; i < 128; i++) w[i] = ((sector << 7) | i) ^ seed;
+            break;
+
+        case SOAK_PAT_INVERSE:
+            for (uint32_t i = 0; i < 128; i++) w[i] = ~(((sector << 7) | i) ^ seed);
+            break;
+
+        case SOAK_PAT_RANDOM: {
+            uint32_t x = (sector * 0x9E3779B9UL) ^ seed;
+            if (x == 0) x = 1;
+            for (uint32_t i = 0; i < 128; i++) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                w[i] = x;
+            }
+            break;
+        }
+
+        default: {
+            // Word 0 carries the sector so aliased sectors still differ
+            uint32_t v = (sector & 1) ? 0x55AA55AAUL : 0xAA55AA55UL;
+            w[0] = sector ^ seed;
+            for (uint32_t i = 1; i < 128; i++) w[i] = v;
+            break;
+        }
+    }
+}
+
+static uint32_t checkChunk(const uint8_t *buf, uint32_t n, uint8_t pattern,
+                           uint32_t sector, uint32_t seed) {
+    uint32_t expect[128];
+    uint32_t bad = 0;
+
+    for (uint32_t s = 0; s < n; s++) {
+        fillSector(expect, pattern, sector + s, seed);
+        if (memcmp(buf + s * 512, expect, 512) != 0) bad++;
+    }
+    return bad;
+}
+
+// ===============================
+// Curve
+// ===============================
+
+static void addToCurve(SoakStats &st, const SoakCycle &c) {
+    st.accWrite += c.writeKBs;
+    st.accRead  += c.readKBs;
+    st.accBad   += c.badSectors;
+    st.accCycles++;
+
+    if (st.accCycles < st.span) return;
+
+    // Full: halve the resolution, each point now covers twice as many cycles
+    if (st.points == SOAK_CURVE_POINTS) {
+        for (int i = 0; i < SOAK_CURVE_POINTS / 2; i++) {
+            const SoakPoint &a = st.curve[2 * i];
+            const SoakPoint &b = st.curve[2 * i + 1];
+            st.curve[i].writeKBs   = (a.writeKBs + b.writeKBs) / 2;
+            st.curve[i].readKBs    = (a.readKBs + b.readKBs) / 2;
+            st.curve[i].badSectors = a.badSectors + b.badSectors;
+        }
+        st.points = SOAK_CURVE_POINTS / 2;
+        st.span *= 2;
+
+        // The pending point was sized for the old span — keep filling it
+        if (st.accCycles < st.span) return;
+    }
+
+    SoakPoint &p = st.curve[st.points++];
+    p.writeKBs   = (uint32_t)(st.accWrite / st.accCycles);
+    p.readKBs    = (uint32_t)(st.accRead / st.accCycles);
+    p.badSectors = st.accBad;
+
+    st.accWrite = st.accRead = 0;
+    st.accBad = st.accCycles = 0;
+}
+
+// ===============================
+// Run
+// ===============================
+
+SoakResult runSoak(SectorDevice *card, const SoakConfig &cfg, SoakStats &st,
+                   SoakProgressFn progress) {
+    memset(&st, 0, sizeof(st));
+    st.span = 1;
+
+    ArenaScope scope("soak");
+    uint8_t *chunk = arenaAlloc(SOAK_CHUNK_SECTORS * 512);
+    if (!chunk) return SOAK_NO_MEMORY;
+
+    const uint32_t end = cfg.firstSector + cfg.sectors;
+    const uint64_t regionKB = (uint64_t)cfg.sectors / 2;
+
+    for (uint32_t c = 0; cfg.cycles == 0 || c < cfg.cycles; c++) {
+        const uint8_t pattern = c % SOAK_PAT_COUNT;
+        const uint32_t seed = cfg.seed + c * 0x9E3779B9UL;
+        SoakCycle cyc;
+        memset(&cyc, 0, sizeof(cyc));
+
+        // --- WRITE ---
+        uint32_t t = clockMillis();
+        for (uint32_t s = cfg.firstSector; s < end; s += SOAK_CHUNK_SECTORS) {
+            for (uint32_t i = 0; i < SOAK_CHUNK_SECTORS; i++) {
+                fillSector((uint32_t *)(chunk + i * 512), pattern, s + i, seed);
+            }
+
+            uint32_t t0 = clockMicros();
+            bool ok = card->writeSectors(s, chunk, SOAK_CHUNK_SECTORS);
+            uint32_t lat = clockMicros() - t0;
+            if (lat > cyc.maxLatencyUs) cyc.maxLatencyUs = lat;
+
+            // A failed write shows up as bad sectors in the verify pass
+            if (!ok) card->syncDevice();
+
+            uint32_t done = s + SOAK_CHUNK_SECTORS - cfg.firstSector;
+            if (progress && done % SOAK_REPORT_SECTORS == 0 &&
+                !progress(st, SOAK_WRITE, (uint8_t)((uint64_t)done * 100 / cfg.sectors))) {
+                return SOAK_ABORTED;
+            }
+        }
+        card->syncDevice();
+        uint32_t ms = clockMillis() - t;
+        cyc.writeKBs = ms ? (uint32_t)(regionKB * 1000 / ms) : 0;
+
+        // --- VERIFY ---
+        t = clockMillis();
+        for (uint32_t s = cfg.firstSector; s < end; s += SOAK_CHUNK_SECTORS) {
+            if (!card->readSectors(s, chunk, SOAK_CHUNK_SECTORS)) {
+                cyc.badSectors += SOAK_CHUNK_SECTORS;
+            } else {
+                cyc.badSectors += checkChunk(chunk, SOAK_CHUNK_SECTORS, pattern, s, seed);
+            }
+
+            uint32_t done = s + SOAK_CHUNK_SECTORS - cfg.firstSector;
+            if (progress && done % SOAK_REPORT_SECTORS == 0 &&
+                !progress(st, SOAK_VERIFY, (uint8_t)((uint64_t)done * 100 / cfg.sectors))) {
+                return SOAK_ABORTED;
+            }
+        }
+        ms = clockMillis() - t;
+        cyc.readKBs = ms ? (uint32_t)(regionKB * 1000 / ms) : 0;
+
+        // --- BOOKKEEPING ---
+        if (st.cycles == 0) st.first = cyc;
+        st.last = cyc;
+        st.cycles++;
+        st.badSectors += cyc.badSectors;
+        if (cyc.maxLatencyUs > st.maxLatencyUs) st.maxLatencyUs = cyc.maxLatencyUs;
+        addToCurve(st, cyc);
+
+        if (cyc.badSectors) {
+            st.failedCycles++;
+            if (!st.firstFailCycle) st.firstFailCycle = st.cycles;
+            if (cfg.stopOnFail || cfg.cycles == 0) return SOAK_STOPPED;
+        }
+
+        if (progress && !progress(st, SOAK_WRITE, 0)) return SOAK_ABORTED;
+    }
+
+    return SOAK_DONE;
+}
@@ -0,0 +1,86 @@
+/**
+ * Endurance Soak Test
+ * Writes and verifies the same region of the card over and over,
+ * cycling through data patterns, and keeps per-cycle throughput
+ * and error counts as a downsampled curve so wear shows up as a
+ * falling line. Raw multi-sector I/O, no filesystem in the loop.
+ */
+
+#pragma once
+
+#include "sector_device.h"
+
+// Points kept for the degradation curve (2px each on screen)
+constexpr int SOAK_CURVE_POINTS = 120;
+
+// Sectors per read/write call (32KB)
+constexpr uint32_t SOAK_CHUNK_SECTORS = 64;
+
+enum SoakPattern : uint8_t {
+    SOAK_PAT_ADDRESS = 0,        // Sector/word index ^ seed
+    SOAK_PAT_INVERSE,            // Bitwise inverse of the above
+    SOAK_PAT_RANDOM,             // xorshift32, seeded per sector
+    SOAK_PAT_CHECKER,            // 0x55/0xAA, tagged with the sector
+    SOAK_PAT_COUNT
+};
+
+struct SoakConfig {
+    uint32_t firstSector;        // Region to hammer
+    uint32_t sectors;            // Multiple of SOAK_CHUNK_SECTORS
+    uint32_t cycles;             // 0 = until the first failing cycle
+    bool     stopOnFail;
+    uint32_t seed;
+};
+
+struct SoakCycle {
+    uint32_t writeKBs;
+    uint32_t readKBs;
+    uint32_t badSectors;         // Mismatched or unreadable
+    uint32_t maxLatencyUs;       // Slowest single chunk write
+};
+
+// One curve point = the average of `span` consecutive cycles
+struct SoakPoint {
+    uint32_t writeKBs;
+    uint32_t readKBs;
+    uint32_t badSectors;         // Sum over the span
+};
+
+struct SoakStats {
+    uint32_t cycles;             // Completed
+    uint32_t badSectors;         // Total across all cycles
+    uint32_t failedCycles;
+    uint32_t firstFailCycle;     // 1-based, 0 = none
+    uint32_t maxLatencyUs;
+
+    SoakCycle first;
+    SoakCycle last;
+
+    SoakPoint curve[SOAK_CURVE_POINTS];
+    uint16_t  points;
+    uint32_t  span;              // Cycles per point, doubles when full
+
+    // Partially filled point
+    uint64_t  accWrite;
+    uint64_t  accRead;
+    uint32_t  accBad;
+    uint32_t  accCycles;
+};
+
+enum SoakPhase : uint8_t { SOAK_WRITE = 0, SOAK_VERIFY = 1 };
+
+enum SoakResult : uint8_t {
+    SOAK_DONE = 0,               // All cycles ran
+    SOAK_STOPPED,                // Stopped on the first failing cycle
+    SOAK_ABORTED,
+    SOAK_NO_MEMORY
+};
+
+// Called about every 1MB and after each cycle (phase/percent of
+// the cycle in progress). Return false to abort.
+typedef bool (*SoakProgressFn)(const SoakStats &st, SoakPhase phase, uint8_t percent);
+
+const char* soakPatternName(uint8_t pattern);
+
+SoakResult runSoak(SectorDevice *card, const SoakConfig &cfg, SoakStats &st,
+                   SoakProgressFn progress);
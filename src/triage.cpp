@@ -0,0 +1,143 @@
+/**
+ * Card Triage — micro-benchmark and verdict rules
+ * Thresholds are for SPI mode at 20MHz, where even a fast card
+ * tops out around 2.5 MB/s; they catch broken and fake cards,
+ * not slow-but-genuine ones.
+ */
+
+#include <Arduino.h>
+
+#include "triage.h"
+#include "io_arena.h"
+
+static const uint32_t BENCH_CHUNK = 64;              // 32KB
+static const int BENCH_READ_CHUNKS = 16;             // 512KB
+static const int BENCH_WRITE_CHUNKS = 8;             // 256KB
+static const int BENCH_RANDOM_OPS = 32;
+static const uint32_t BENCH_RANDOM_SECTORS = 8;      // 4KB
+
+static const uint32_t SUSPECT_READ_KBS = 600;
+static const uint32_t SUSPECT_WRITE_KBS = 300;
+static const uint32_t SUSPECT_STALL_US = 250000;
+
+// Year the firmware was built — a card can't be made later than that
+static const uint16_t BUILD_YEAR = (__DATE__[7] - '0') * 1000 + (__DATE__[8] - '0') * 100 +
+                                   (__DATE__[9] - '0') * 10 + (__DATE__[10] - '0');
+
+// ===============================
+// Benchmark
+// ===============================
+
+bool triageBench(SectorDevice *dev, TriageBench &b) {
+    memset(&b, 0, sizeof(b));
+    uint32_t start = millis();
+
+    const uint32_t sectors = dev->sectorCount();
+    if (sectors < 8192) {
+        b.ioError = true;
+        return false;
+    }
+    const uint32_t area = (sectors / 2) & ~(uint32_t)2047;
+    const uint32_t span = sectors / 4;
+
+    ArenaScope scope("triage");
+    uint8_t *buf = arenaAlloc(BENCH_CHUNK * 512);
+    if (!buf) {
+        b.ioError = true;
+        return false;
+    }
+
+    // --- SEQUENTIAL READ ---
+    uint32_t us = 0;
+    for (int i = 0; i < BENCH_READ_CHUNKS && !b.ioError; i++) {
+        uint32_t t0 = micros();
+        if (!dev->readSectors(area + i * BENCH_CHUNK, buf, BENCH_CHUNK)) b.ioError = true;
+        us += micros() - t0;
+    }
+    if (us) b.seqReadKBs = (uint64_t)BENCH_READ_CHUNKS * BENCH_CHUNK / 2 * 1000000 / us;
+
+    // --- SEQUENTIAL REWRITE (read untimed, write back timed) ---
+    us = 0;
+    for (int i = 0; i < BENCH_WRITE_CHUNKS && !b.ioError; i++) {
+        uint32_t s = area + i * BENCH_CHUNK;
+        if (!dev->readSectors(s, buf, BENCH_CHUNK)) {
+            b.ioError = true;
+            break;
+        }
+        uint32_t t0 = micros();
+        if (!dev->writeSectors(s, buf, BENCH_CHUNK)) b.ioError = true;
+        uint32_t lat = micros() - t0;
+        us += lat;
+        if (lat > b.maxWriteUs) b.maxWriteUs = lat;
+    }
+    dev->syncDevice();
+    if (us) b.seqWriteKBs = (uint64_t)BENCH_WRITE_CHUNKS * BENCH_CHUNK / 2 * 1000000 / us;
+
+    // --- RANDOM 4KB READ + REWRITE ---
+    uint32_t readUs = 0, writeUs = 0;
+    uint32_t x = 0x9E3779B9UL ^ sectors;
+    for (int i = 0; i < BENCH_RANDOM_OPS && !b.ioError; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        uint32_t s = area + (x % (span / BENCH_RANDOM_SECTORS)) * BENCH_RANDOM_SECTORS;
+
+        uint32_t t0 = micros();
+        if (!dev->readSectors(s, buf, BENCH_RANDOM_SECTORS)) {
+            b.ioError = true;
+            break;
+        }
+        uint32_t t1 = micros();
+        if (!dev->writeSectors(s, buf, BENCH_RANDOM_SECTORS)) b.ioError = true;
+        uint32_t t2 = micros();
+
+        readUs += t1 - t0;
+        writeUs += t2 - t1;
+        if (t2 - t1 > b.maxWriteUs) b.maxWriteUs = t2 - t1;
+    }
+    dev->syncDevice();
+    if (readUs)  b.rndReadIops  = (uint64_t)BENCH_RANDOM_OPS * 1000000 / readUs;
+    if (writeUs) b.rndWriteIops = (uint64_t)BENCH_RANDOM_OPS * 1000000 / writeUs;
+
+    b.elapsedMs = millis() - start;
+    return !b.ioError;
+}
+
+// ===============================
+// Verdict
+// ===============================
+
+static void addReason(TriageReport &r, const char *why) {
+    r.suspect = true;
+    if (r.reasonCount < TRIAGE_MAX_REASONS) r.reasons[r.reasonCount++] = why;
+}
+
+void triageVerdict(TriageReport &r) {
+    r.suspect = false;
+    r.reasonCount = 0;
+
+    // --- Identity ---
+    if (!r.cid.crcOk) addReason(r, "CID CRC mismatch");
+    if (!r.maker) {
+        addReason(r, "Unknown maker ID");
+    } else if (r.maker->oid && strcmp(r.maker->oid, r.cid.oid) != 0) {
+        addReason(r, "OEM ID unusual for maker");
+    }
+    if (r.cid.month == 0 || r.cid.year > BUILD_YEAR) addReason(r, "Bad manufacture date");
+    if (r.cid.psn == 0 || r.cid.psn == 0xFFFFFFFFUL) addReason(r, "Blank serial number");
+
+    // --- Capacity (the reported size is the CSD's, so only a probe can check it) ---
+    if (r.haveCsd && r.csd.structure == 0 && r.csd.sectors > 4194304ULL) {
+        addReason(r, "SDSC over 2GB");
+    }
+    if (r.probeResult == PROBE_FAKE) addReason(r, "Capacity probe failed");
+
+    // --- Benchmark ---
+    if (r.bench.ioError) {
+        addReason(r, "I/O error in benchmark");
+        return;
+    }
+    if (r.bench.seqReadKBs < SUSPECT_READ_KBS)   addReason(r, "Slow reads");
+    if (r.bench.seqWriteKBs < SUSPECT_WRITE_KBS) addReason(r, "Slow writes");
+    if (r.bench.maxWriteUs > SUSPECT_STALL_US)   addReason(r, "Write stalls");
+}
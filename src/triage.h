@@ -0,0 +1,52 @@
+/**
+ * Card Triage
+ * Everything the card says about itself plus a ~1 second raw
+ * micro-benchmark, boiled down to PASS or SUSPECT so only the
+ * suspect cards go on to the long tests. The benchmark rewrites
+ * the data it reads, and a short capacity probe (capacity_probe.h)
+ * restores what it overwrote, so the card contents are unchanged.
+ */
+
+#pragma once
+
+#include "sector_device.h"
+#include "card_id.h"
+#include "capacity_probe.h"
+
+constexpr int TRIAGE_MAX_REASONS = 4;
+
+// Probes in the triage pass; the Capacity Probe screen runs PROBE_DEFAULT
+constexpr int TRIAGE_PROBES = 16;
+
+struct TriageBench {
+    uint32_t seqReadKBs;         // 32KB multi-sector reads
+    uint32_t seqWriteKBs;        // 32KB multi-sector rewrites
+    uint32_t rndReadIops;        // 4KB at random positions
+    uint32_t rndWriteIops;
+    uint32_t maxWriteUs;         // Slowest single write
+    uint32_t elapsedMs;
+    bool     ioError;
+};
+
+struct TriageReport {
+    CidInfo      cid;
+    CsdInfo      csd;
+    SdStatusInfo sds;
+    bool         haveCsd;
+    bool         haveSds;
+    const CardMaker* maker;      // nullptr = unknown MID
+    uint32_t     reportedSectors;
+    TriageBench  bench;
+    ProbeReport  probe;
+    ProbeResult  probeResult;
+
+    bool         suspect;
+    int          reasonCount;
+    const char*  reasons[TRIAGE_MAX_REASONS];
+};
+
+// Rewrite-in-place benchmark half way into the card
+bool triageBench(SectorDevice *dev, TriageBench &b);
+
+// Fill in suspect/reasons from the decoded registers and bench
+void triageVerdict(TriageReport &r);
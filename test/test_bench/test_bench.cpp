@@ -0,0 +1,86 @@
+/**
+ * Native benchmark — engine cost on the simulated card
+ * The RAM card has no transfer time of its own, so these are the
+ * ceilings the soak and probe engines allow (pattern generation,
+ * compare, bookkeeping) on the host. Figures go out as Unity
+ * messages: pio test -e native -f test_bench -v
+ */
+
+#include <stdio.h>
+#include <unity.h>
+
+#include "sim_selftest.h"
+#include "capacity_probe.h"
+#include "soak.h"
+#include "io_arena.h"
+#include "clock_source.h"
+
+static const uint32_t BENCH_SECTORS = 16384;        // 8MB of RAM
+static const uint32_t BENCH_CYCLES = 8;
+
+static SimCard sim;
+static SoakStats st;
+
+static void report(const char *what, double value, const char *unit) {
+    char line[96];
+    snprintf(line, sizeof(line), "%-24s %10.1f %s", what, value, unit);
+    TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() { sim.end(); }
+
+// The Sim Self-Test's own figure, as the screen shows it
+void test_bench_selftest_engine() {
+    SimOutcome out;
+    TEST_ASSERT_TRUE(simRunScenario(sim, 0, out));
+    TEST_ASSERT_TRUE(out.ok);
+    report("selftest soak engine", out.engineMBs, "MB/s");
+}
+
+void test_bench_soak() {
+    SimFaults f = {};
+    TEST_ASSERT_TRUE(sim.begin(BENCH_SECTORS, f));
+
+    SoakConfig cfg;
+    cfg.firstSector = 0;
+    cfg.sectors     = BENCH_SECTORS;
+    cfg.cycles      = BENCH_CYCLES;
+    cfg.stopOnFail  = false;
+    cfg.seed        = 0xC0FFEE;
+
+    uint32_t t = clockMicros();
+    TEST_ASSERT_EQUAL(SOAK_DONE, runSoak(&sim, cfg, st, nullptr));
+    t = clockMicros() - t;
+    TEST_ASSERT_EQUAL_UINT32(0, st.badSectors);
+    TEST_ASSERT_EQUAL_UINT32(BENCH_CYCLES, st.cycles);
+
+    const double mb = (double)BENCH_SECTORS * 512 * 2 * BENCH_CYCLES / 1048576.0;
+    report("soak write + verify", mb / (t / 1e6), "MB/s");
+    report("soak last cycle write", st.last.writeKBs / 1024.0, "MB/s");
+    report("soak last cycle read", st.last.readKBs / 1024.0, "MB/s");
+}
+
+// A full-size probe on a 2GB "card" that really holds 8MB
+void test_bench_probe() {
+    SimFaults f = {};
+    f.advertisedSectors = 1u << 22;
+    TEST_ASSERT_TRUE(sim.begin(BENCH_SECTORS, f));
+
+    ProbeReport rep;
+    uint32_t t = clockMicros();
+    TEST_ASSERT_EQUAL(PROBE_FAKE, probeCapacity(&sim, PROBE_MAX, 0x1234, rep, nullptr));
+    t = clockMicros() - t;
+    TEST_ASSERT_TRUE(rep.restored);
+
+    report("probe, PROBE_MAX probes", t / 1000.0, "ms");
+}
+
+int main() {
+    arenaBegin();
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_selftest_engine);
+    RUN_TEST(test_bench_soak);
+    RUN_TEST(test_bench_probe);
+    return UNITY_END();
+}
@@ -0,0 +1,178 @@
+/**
+ * Native tests — simulated card and the detectors
+ * Every Sim Self-Test scenario must come out as the screen
+ * expects, plus the fault model itself: wrap-around, stuck
+ * sectors, erase and determinism.
+ */
+
+#include <string.h>
+#include <unity.h>
+
+#include "sim_selftest.h"
+#include "capacity_probe.h"
+#include "io_arena.h"
+
+static SimCard sim;
+
+static int scenarioIndex(const char *name) {
+    for (int i = 0; i < SIM_SCENARIO_COUNT; i++) {
+        if (strcmp(SIM_SCENARIOS[i].name, name) == 0) return i;
+    }
+    TEST_FAIL_MESSAGE("no such scenario");
+    return -1;
+}
+
+static SimOutcome runScenario(const char *name) {
+    SimOutcome out;
+    TEST_ASSERT_TRUE(simRunScenario(sim, scenarioIndex(name), out));
+    TEST_ASSERT_TRUE_MESSAGE(out.ok, name);
+    return out;
+}
+
+void setUp() {}
+void tearDown() { sim.end(); }
+
+// ===============================
+// Scenarios
+// ===============================
+
+void test_healthy_passes() {
+    SimOutcome out = runScenario("healthy");
+    TEST_ASSERT_FALSE(out.probeFlag);
+    TEST_ASSERT_FALSE(out.soakFlag);
+    TEST_ASSERT_FALSE(out.slowFlag);
+}
+
+void test_fake_capacity_caught_by_probe() {
+    SimOutcome out = runScenario("fake");
+    TEST_ASSERT_TRUE(out.probeFlag);
+    TEST_ASSERT_FALSE(out.soakFlag);
+}
+
+void test_bit_flips_caught_by_soak() {
+    TEST_ASSERT_TRUE(runScenario("flips").soakFlag);
+}
+
+void test_stuck_sectors_caught_by_soak() {
+    TEST_ASSERT_TRUE(runScenario("stuck").soakFlag);
+}
+
+void test_write_failures_caught_by_soak() {
+    TEST_ASSERT_TRUE(runScenario("wfail").soakFlag);
+}
+
+void test_latency_spike_caught() {
+    SimOutcome out = runScenario("spike");
+    TEST_ASSERT_TRUE(out.slowFlag);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SIM_SPIKE_US, out.maxLatencyUs);
+}
+
+// ===============================
+// Fault model
+// ===============================
+
+void test_fake_card_wraps() {
+    SimFaults f = {};
+    f.advertisedSectors = 1024;
+    TEST_ASSERT_TRUE(sim.begin(64, f));
+    TEST_ASSERT_EQUAL_UINT32(1024, sim.sectorCount());
+
+    uint8_t a[512], b[512];
+    memset(a, 0xA5, sizeof(a));
+    TEST_ASSERT_TRUE(sim.writeSectors(64 + 3, a, 1));
+    TEST_ASSERT_TRUE(sim.readSectors(3, b, 1));
+    TEST_ASSERT_EQUAL_MEMORY(a, b, 512);
+    TEST_ASSERT_FALSE(sim.readSectors(1024, b, 1));
+}
+
+void test_stuck_sectors_ignore_writes_and_erase() {
+    SimFaults f = {};
+    f.stuckFirst = 8;
+    f.stuckCount = 2;
+    TEST_ASSERT_TRUE(sim.begin(32, f));
+
+    uint8_t a[512 * 4], b[512 * 4];
+    memset(a, 0x5A, sizeof(a));
+    TEST_ASSERT_TRUE(sim.writeSectors(7, a, 4));
+    TEST_ASSERT_TRUE(sim.readSectors(7, b, 4));
+    TEST_ASSERT_EQUAL_UINT8(0x5A, b[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, b[512]);           // Still the initial zeros
+    TEST_ASSERT_EQUAL_UINT8(0x00, b[1024]);
+    TEST_ASSERT_EQUAL_UINT8(0x5A, b[1536]);
+    TEST_ASSERT_EQUAL_UINT32(2, sim.counters().stuckWrites);
+
+    TEST_ASSERT_TRUE(sim.eraseSectors(7, 4));
+    TEST_ASSERT_TRUE(sim.readSectors(7, b, 4));
+    TEST_ASSERT_EQUAL_UINT8(0xFF, b[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, b[512]);
+    TEST_ASSERT_EQUAL_UINT32(2, sim.counters().erased);
+}
+
+void test_faults_repeat_for_a_seed() {
+    SimFaults f = {};
+    f.bitFlipPpm = 100000;
+    f.seed = 42;
+
+    uint32_t sums[2] = {0, 0};
+    uint8_t buf[512 * 16];
+    for (int run = 0; run < 2; run++) {
+        TEST_ASSERT_TRUE(sim.begin(16, f));
+        for (int pass = 0; pass < 8; pass++) {
+            TEST_ASSERT_TRUE(sim.readSectors(0, buf, 16));
+            for (size_t i = 0; i < sizeof(buf); i++) sums[run] = sums[run] * 31 + buf[i];
+        }
+        TEST_ASSERT_GREATER_THAN_UINT32(0, sim.counters().flips);
+    }
+    TEST_ASSERT_EQUAL_UINT32(sums[0], sums[1]);
+}
+
+void test_cid_carries_the_seed() {
+    SimFaults f = {};
+    f.seed = 0x12345678;
+    TEST_ASSERT_TRUE(sim.begin(8, f));
+
+    uint8_t cid[16];
+    TEST_ASSERT_TRUE(sim.readCID(cid));
+    TEST_ASSERT_EQUAL_MEMORY("SMSIMCD", cid + 1, 7);
+    TEST_ASSERT_EQUAL_HEX8(0x12, cid[9]);
+    TEST_ASSERT_EQUAL_HEX8(0x78, cid[12]);
+}
+
+void test_probe_restores_originals() {
+    SimFaults f = {};
+    TEST_ASSERT_TRUE(sim.begin(SIM_SECTORS, f));
+
+    uint8_t pattern[512];
+    for (uint32_t s = 0; s < SIM_SECTORS; s++) {
+        memset(pattern, (uint8_t)s, sizeof(pattern));
+        TEST_ASSERT_TRUE(sim.writeSectors(s, pattern, 1));
+    }
+
+    ProbeReport rep;
+    TEST_ASSERT_EQUAL(PROBE_OK, probeCapacity(&sim, 32, 7, rep, nullptr));
+    TEST_ASSERT_TRUE(rep.restored);
+
+    uint8_t back[512];
+    for (uint32_t s = 0; s < SIM_SECTORS; s++) {
+        memset(pattern, (uint8_t)s, sizeof(pattern));
+        TEST_ASSERT_TRUE(sim.readSectors(s, back, 1));
+        TEST_ASSERT_EQUAL_MEMORY(pattern, back, 512);
+    }
+}
+
+int main() {
+    arenaBegin();
+    UNITY_BEGIN();
+    RUN_TEST(test_healthy_passes);
+    RUN_TEST(test_fake_capacity_caught_by_probe);
+    RUN_TEST(test_bit_flips_caught_by_soak);
+    RUN_TEST(test_stuck_sectors_caught_by_soak);
+    RUN_TEST(test_write_failures_caught_by_soak);
+    RUN_TEST(test_latency_spike_caught);
+    RUN_TEST(test_fake_card_wraps);
+    RUN_TEST(test_stuck_sectors_ignore_writes_and_erase);
+    RUN_TEST(test_faults_repeat_for_a_seed);
+    RUN_TEST(test_cid_carries_the_seed);
+    RUN_TEST(test_probe_restores_originals);
+    return UNITY_END();
+}
@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Compare Cardputer SD Tool builds on the same card (serial "bench" command).
+
+  sdbench.py run     PORT results.csv [--label NAME]
+  sdbench.py compare results.csv [--card PSN]
+
+run sends "bench" to the tool on its main menu, waits for the fixed
+sequence to finish (about a minute; the first run on a card also
+writes the 16MB cold-read file) and appends every figure to the CSV,
+one row per build, card, test and metric. Flash the next sdfat-*
+environment from platformio.ini and run again on the same card.
+
+compare prints one column per build: the median of its runs, and
+for the other builds the change against the first one ("default"
+when it is there). Needs pyserial for run (pip install pyserial).
+"""
+
+import argparse
+import csv
+import os
+import statistics
+import sys
+import time
+
+FIELDS = ["time", "build", "card", "test", "metric", "value"]
+
+# Higher is better for throughput, lower for everything timed and
+# for every FS trace count (sectors moved, updates, misses, flushes)
+LOWER_IS_BETTER = ("_us", "late", "interference_pct")
+LOWER_IS_BETTER_PREFIX = "fs_"
+
+# Not figures (fs_traced is a 0/1 flag): compare skips them
+SKIP_METRICS = ("size", "count", "fs_traced")
+
+
+class BenchError(Exception):
+    pass
+
+
+# ------------------------------------------------------------
+# Device link
+# ------------------------------------------------------------
+
+def open_port(name):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("pyserial is needed: pip install pyserial")
+    return serial.Serial(name, 115200, timeout=30)
+
+
+def fields(text):
+    """'RESULT bench a=1 b=x' -> {'a': '1', 'b': 'x'}"""
+    out = {}
+    for tok in text.split()[2:]:
+        key, _, value = tok.partition("=")
+        out[key] = value
+    return out
+
+
+def run_bench(port):
+    """Send bench; return (config, card, [(test, {metric: value})])."""
+    port.reset_input_buffer()
+    port.write(b"bench\n")
+    config, card, tests = {}, "", []
+    while True:
+        line = port.readline()
+        if not line:
+            raise BenchError("no answer from the device (main menu showing?)")
+        text = line.decode("ascii", "replace").strip()
+        if text.startswith("PROGRESS bench "):
+            sys.stderr.write("\r%3s%% " % text.split()[2])
+        elif text.startswith("RESULT bench "):
+            f = fields(text)
+            if "build" in f:
+                config = f
+            elif "card_psn" in f:
+                card = "%s:%s" % (f["card_mid"], f["card_psn"])
+            elif "test" in f:
+                test = f.pop("test")
+                tests.append((test, f))
+        elif text == "OK bench":
+            sys.stderr.write("\r100%\n")
+            return config, card, tests
+        elif text.startswith("ERROR bench"):
+            sys.stderr.write("\n")
+            raise BenchError(text.split(" ", 2)[-1])
+
+
+def cmd_run(args):
+    port = open_port(args.port)
+    config, card, tests = run_bench(port)
+    build = args.label or config.get("build", "unknown")
+
+    print("Build %s on card %s" % (build, card))
+    print("  " + " ".join("%s=%s" % kv for kv in sorted(config.items()) if kv[0] != "build"))
+
+    new = not os.path.exists(args.csv)
+    stamp = time.strftime("%Y-%m-%d %H:%M:%S")
+    with open(args.csv, "a", newline="") as out:
+        w = csv.writer(out)
+        if new:
+            w.writerow(FIELDS)
+        for test, metrics in tests:
+            for metric, value in metrics.items():
+                if not value.lstrip("-").isdigit():
+                    continue
+                w.writerow([stamp, build, card, test, metric, value])
+                print("  %-16s %-18s %s" % (test, metric, value))
+    print("Appended to %s" % args.csv)
+
+
+# ------------------------------------------------------------
+# Comparison
+# ------------------------------------------------------------
+
+def cmd_compare(args):
+    runs = {}                    # (test, metric) -> build -> [values]
+    builds, cards = [], set()
+    with open(args.csv, newline="") as src:
+        for row in csv.DictReader(src):
+            if args.card and not row["card"].endswith(args.card):
+                continue
+            if row["metric"] in SKIP_METRICS:
+                continue
+            cards.add(row["card"])
+            if row["build"] not in builds:
+                builds.append(row["build"])
+            key = (row["test"], row["metric"])
+            runs.setdefault(key, {}).setdefault(row["build"], []).append(int(row["value"]))
+
+    if not runs:
+        sys.exit("no results%s" % (" for that card" if args.card else ""))
+    if len(cards) > 1:
+        print("warning: %d different cards mixed, use --card" % len(cards))
+    if "default" in builds:
+        builds.remove("default")
+        builds.insert(0, "default")
+
+    base = builds[0]
+    width = max(14, max(len(b) for b in builds) + 2)
+    print("%-30s" % "test / metric" + "".join("%*s" % (width, b) for b in builds))
+    for (test, metric), per in runs.items():
+        ref = statistics.median(per[base]) if base in per else None
+        cells = []
+        for b in builds:
+            if b not in per:
+                cells.append("%*s" % (width, "-"))
+                continue
+            v = statistics.median(per[b])
+            if b == base or not ref:
+                cells.append("%*d" % (width, v))
+                continue
+            pct = (v - ref) * 100.0 / ref
+            if metric.endswith(LOWER_IS_BETTER) or metric.startswith(LOWER_IS_BETTER_PREFIX):
+                pct = -pct or 0.0
+            cells.append("%*s" % (width, "%d %+.0f%%" % (v, pct)))
+        print("%-30s" % ("%s %s" % (test, metric)) + "".join(cells))
+    print("\n+%% = better than %s; medians of all runs per build" % base)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Cardputer SD Tool build comparison")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("run", help="run the bench sequence and append the results")
+    p.add_argument("port")
+    p.add_argument("csv")
+    p.add_argument("--label", help="build name to record (default: the firmware's)")
+    p.set_defaults(func=cmd_run)
+
+    p = sub.add_parser("compare", help="tabulate the builds in a results file")
+    p.add_argument("csv")
+    p.add_argument("--card", help="only this card (serial number, e.g. 0x1234ABCD)")
+    p.set_defaults(func=cmd_compare)
+
+    args = ap.parse_args()
+    try:
+        args.func(args)
+    except BenchError as e:
+        sys.exit("error: %s" % e)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,348 @@
+#!/usr/bin/env python3
+"""
+Host side of the Cardputer SD Tool card image (src/card_image.h).
+
+  sdimage.py backup  PORT card.sdimg          save the card in the tool
+  sdimage.py restore PORT card.sdimg [--sparse]
+  sdimage.py unpack  card.sdimg card.img      to a raw (sparse) disk image
+  sdimage.py pack    card.img card.sdimg      raw disk image to the stream format
+  sdimage.py info    card.sdimg
+
+backup / restore need pyserial (pip install pyserial) and the tool on
+its main menu or the "USB Image" screen; either way the session is
+framed by the serial command replies (START / RESULT / OK | ERROR).
+--sparse skips zero runs on restore; use it only when the target card
+already reads as zeros.
+
+An .sdimg file is the stream exactly as the card sends it:
+  header  "SDIMG001", u32 sectors, u32 flags, 16 bytes raw CID
+  records u8 type, 3 pad, u32 first, u32 count
+          'D' + count*512 bytes + u32 CRC-32
+          'Z' zero run, no payload
+          'E' first = 0, count = sectors covered
+All little-endian.
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"SDIMG001"
+HEADER = struct.Struct("<8sII16s")
+RECORD = struct.Struct("<B3xII")
+SECTOR = 512
+RECORD_SECTORS = 128
+FLAG_SKIP_ZERO = 1
+ACK, NAK = b"K", b"N"
+
+
+class StreamError(Exception):
+    pass
+
+
+# ------------------------------------------------------------
+# Stream parsing
+# ------------------------------------------------------------
+
+def read_exact(src, n):
+    data = src.read(n)
+    if len(data) != n:
+        raise StreamError("stream ended early")
+    return data
+
+
+def read_header(src):
+    magic, sectors, flags, cid = HEADER.unpack(read_exact(src, HEADER.size))
+    if magic != MAGIC:
+        raise StreamError("not an SD image (bad magic)")
+    return sectors, flags, cid
+
+
+def records(src, sectors):
+    """Yield (type, first, count, data) and check order and CRCs."""
+    covered = 0
+    while True:
+        kind, first, count = RECORD.unpack(read_exact(src, RECORD.size))
+        if kind == ord("E"):
+            if count != covered:
+                raise StreamError("end record says %d sectors, got %d" % (count, covered))
+            yield "E", first, count, None
+            return
+        if first != covered or count == 0 or first + count > sectors:
+            raise StreamError("record out of order at sector %d" % covered)
+        if kind == ord("D"):
+            if count > RECORD_SECTORS:
+                raise StreamError("data record too long")
+            data = read_exact(src, count * SECTOR)
+            (crc,) = struct.unpack("<I", read_exact(src, 4))
+            if crc != zlib.crc32(data):
+                raise StreamError("CRC mismatch at sector %d" % first)
+            yield "D", first, count, data
+        elif kind == ord("Z"):
+            yield "Z", first, count, None
+        else:
+            raise StreamError("unknown record type 0x%02X" % kind)
+        covered += count
+
+
+def encode(kind, first, count, data=None):
+    out = RECORD.pack(ord(kind), first, count)
+    if data is not None:
+        out += data + struct.pack("<I", zlib.crc32(data))
+    return out
+
+
+def cid_text(cid):
+    if not any(cid):
+        return "none"
+    name = cid[3:8].decode("ascii", "replace")
+    psn = struct.unpack(">I", cid[9:13])[0]
+    return "MID %02X %s SN %08X" % (cid[0], name, psn)
+
+
+class Progress:
+    def __init__(self, total):
+        self.total = max(total, 1)
+        self.start = time.time()
+        self.last = 0
+
+    def show(self, done, wire, final=False):
+        now = time.time()
+        if not final and now - self.last < 0.5:
+            return
+        self.last = now
+        secs = max(now - self.start, 1e-3)
+        sys.stderr.write("\r%5.1f%%  %8.1f MB  link %6.2f MB/s  effective %7.2f MB/s "
+                         % (done * 100.0 / self.total, done * SECTOR / 1048576.0,
+                            wire / 1048576.0 / secs, done * SECTOR / 1048576.0 / secs))
+        if final:
+            sys.stderr.write("\n")
+
+
+# ------------------------------------------------------------
+# Device link
+# ------------------------------------------------------------
+
+class SerialReader:
+    """File-like read() over a serial port, counting bytes."""
+
+    def __init__(self, port):
+        self.port = port
+        self.bytes = 0
+
+    def read(self, n):
+        data = self.port.read(n)
+        self.bytes += len(data)
+        return data
+
+
+def open_port(name):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("pyserial is needed: pip install pyserial")
+    return serial.Serial(name, 115200, timeout=10)
+
+
+def start_session(port, cmd):
+    """Send the command and wait for START; the binary stream follows."""
+    port.reset_input_buffer()
+    port.write(cmd.encode() + b"\n")
+    while True:
+        line = port.readline()
+        if not line:
+            raise StreamError("no answer from the device (menu or USB Image screen?)")
+        text = line.decode("ascii", "replace").strip()
+        if text == "START " + cmd:
+            return
+        if text.startswith("ERROR "):
+            raise StreamError(text.split(" ", 2)[-1])
+
+
+def finish_session(port, cmd):
+    """Read the text trailer: RESULT, then OK or ERROR."""
+    port.timeout = 10
+    while True:
+        line = port.readline()
+        if not line:
+            raise StreamError("device did not finish the %s" % cmd)
+        text = line.decode("ascii", "replace").strip()
+        if text == "OK " + cmd:
+            return
+        if text.startswith("ERROR " + cmd):
+            raise StreamError(text.split(" ", 2)[-1])
+
+
+def cmd_backup(args):
+    port = open_port(args.port)
+    start_session(port, "backup")
+
+    src = SerialReader(port)
+    sectors, flags, cid = read_header(src)
+    print("Card: %d MB, %s" % (sectors * SECTOR // 1048576, cid_text(cid)))
+
+    progress = Progress(sectors)
+    zero = 0
+    with open(args.image, "wb") as out:
+        out.write(HEADER.pack(MAGIC, sectors, flags, cid))
+        for kind, first, count, data in records(src, sectors):
+            out.write(encode(kind, first, count, data))
+            if kind == "Z":
+                zero += count
+            if kind != "E":
+                progress.show(first + count, src.bytes)
+    progress.show(sectors, src.bytes, final=True)
+    finish_session(port, "backup")
+    print("Saved %s: %.1f%% of the card was zero runs" % (args.image, zero * 100.0 / max(sectors, 1)))
+
+
+def wait_ack(port, what):
+    port.timeout = None          # a long zero run takes as long as it takes
+    answer = port.read(1)
+    if answer != ACK:
+        finish_session(port, "restore")     # raises with the device's reason
+        raise StreamError("device refused %s (%r)" % (what, answer))
+
+
+def cmd_restore(args):
+    with open(args.image, "rb") as src:
+        sectors, flags, cid = read_header(src)
+        for _ in records(src, sectors):     # check the whole file before touching the card
+            pass
+
+    print("Image: %d MB, %s" % (sectors * SECTOR // 1048576, cid_text(cid)))
+    if args.sparse:
+        flags |= FLAG_SKIP_ZERO
+
+    port = open_port(args.port)
+    start_session(port, "restore")
+    port.write(HEADER.pack(MAGIC, sectors, flags, cid))
+    wait_ack(port, "the image (too big for this card?)")
+
+    progress = Progress(sectors)
+    wire = 0
+    with open(args.image, "rb") as src:
+        read_header(src)
+        for kind, first, count, data in records(src, sectors):
+            chunk = encode(kind, first, count, data)
+            port.write(chunk)
+            wire += len(chunk)
+            wait_ack(port, "sector %d" % first)
+            if kind != "E":
+                progress.show(first + count, wire)
+    progress.show(sectors, wire, final=True)
+    finish_session(port, "restore")
+    print("Restored")
+
+
+# ------------------------------------------------------------
+# Offline conversions
+# ------------------------------------------------------------
+
+def cmd_unpack(args):
+    with open(args.image, "rb") as src, open(args.raw, "wb") as out:
+        sectors, _, _ = read_header(src)
+        for kind, first, count, data in records(src, sectors):
+            if kind == "D":
+                out.seek(first * SECTOR)
+                out.write(data)
+        out.truncate(sectors * SECTOR)      # zero runs stay holes
+    print("Wrote %s (%d MB)" % (args.raw, sectors * SECTOR // 1048576))
+
+
+def cmd_pack(args):
+    zero_sector = bytes(SECTOR)
+    with open(args.raw, "rb") as src, open(args.image, "wb") as out:
+        src.seek(0, 2)
+        size = src.tell()
+        if size % SECTOR:
+            sys.exit("raw image is not a whole number of sectors")
+        sectors = size // SECTOR
+        src.seek(0)
+        out.write(HEADER.pack(MAGIC, sectors, 0, bytes(16)))
+
+        zero_first, zero_count, pos = 0, 0, 0
+        while pos < sectors:
+            buf = src.read(RECORD_SECTORS * SECTOR)
+            n = len(buf) // SECTOR
+            i = 0
+            while i < n:
+                if buf[i * SECTOR:(i + 1) * SECTOR] == zero_sector:
+                    if zero_count == 0:
+                        zero_first = pos + i
+                    zero_count += 1
+                    i += 1
+                    continue
+                if zero_count:
+                    out.write(encode("Z", zero_first, zero_count))
+                    zero_count = 0
+                j = i + 1
+                while j < n and buf[j * SECTOR:(j + 1) * SECTOR] != zero_sector:
+                    j += 1
+                out.write(encode("D", pos + i, j - i, buf[i * SECTOR:j * SECTOR]))
+                i = j
+            pos += n
+        if zero_count:
+            out.write(encode("Z", zero_first, zero_count))
+        out.write(encode("E", 0, sectors))
+    print("Wrote %s" % args.image)
+
+
+def cmd_info(args):
+    with open(args.image, "rb") as src:
+        sectors, flags, cid = read_header(src)
+        data = zero = count = 0
+        for kind, _, n, _ in records(src, sectors):
+            count += 1
+            if kind == "D":
+                data += n
+            elif kind == "Z":
+                zero += n
+    print("Card:    %d MB (%d sectors)" % (sectors * SECTOR // 1048576, sectors))
+    print("Source:  %s" % cid_text(cid))
+    print("Records: %d" % count)
+    print("Data:    %d MB" % (data * SECTOR // 1048576))
+    print("Zero:    %d MB (%.1f%%)" % (zero * SECTOR // 1048576, zero * 100.0 / max(sectors, 1)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Cardputer SD Tool card images")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("backup", help="save the card in the tool to a file")
+    p.add_argument("port")
+    p.add_argument("image")
+    p.set_defaults(func=cmd_backup)
+
+    p = sub.add_parser("restore", help="write a file back to the card in the tool")
+    p.add_argument("port")
+    p.add_argument("image")
+    p.add_argument("--sparse", action="store_true",
+                   help="skip zero runs (target card already reads as zeros)")
+    p.set_defaults(func=cmd_restore)
+
+    p = sub.add_parser("unpack", help="convert to a raw disk image")
+    p.add_argument("image")
+    p.add_argument("raw")
+    p.set_defaults(func=cmd_unpack)
+
+    p = sub.add_parser("pack", help="convert a raw disk image")
+    p.add_argument("raw")
+    p.add_argument("image")
+    p.set_defaults(func=cmd_pack)
+
+    p = sub.add_parser("info", help="summarise an image file")
+    p.add_argument("image")
+    p.set_defaults(func=cmd_info)
+
+    args = ap.parse_args()
+    try:
+        args.func(args)
+    except StreamError as e:
+        sys.exit("error: %s" % e)
+
+
+if __name__ == "__main__":
+    main()